@@ -20,6 +20,7 @@
 #include "ref_aligner.h"
 #include "reference.h"
 #include "aligner_metrics.h"
+#include "insert_size.h"
 #include "search_globals.h"
 
 #ifdef PER_THREAD_TIMING
@@ -171,6 +172,7 @@ public:
 					if(ret.first && (*patsrcs_)[i]->rdid() < qUpto_) {
 						(*aligners_)[i]->setQuery((*patsrcs_)[i]);
 					} else if (ret.first) {
+						(*patsrcs_)[i]->stop();
 						saw_last_read = true;
 					}
 				}
@@ -294,6 +296,7 @@ public:
 							seOrPe_[0] = true; // true = unpaired
 						}
 					} else if (ret.first) {
+						ps->stop();
 						break;
 					}
 				}
@@ -341,6 +344,7 @@ public:
 								seOrPe_[i] = true; // true = unpaired
 							}
 						} else if (ret.first) {
+							ps->stop();
 							break;
 						}
 					}
@@ -393,7 +397,8 @@ public:
 		int maxBts,
 		ChunkPool *pool,
 		int *btCnt = NULL,
-		AlignerMetrics *metrics = NULL) :
+		AlignerMetrics *metrics = NULL,
+		BacktrackBudget *budget = NULL) :
 		Aligner(true, rangeMode),
 		refs_(refs),
 		doneFirst_(true),
@@ -409,7 +414,8 @@ public:
 		maxBts_(maxBts),
 		pool_(pool),
 		btCnt_(btCnt),
-		metrics_(metrics)
+		metrics_(metrics),
+		budget_(budget)
 	{
 		assert(pool_   != NULL);
 		assert(sinkPt_ != NULL);
@@ -443,11 +449,20 @@ public:
 			sinkPt_->finishRead(*patsrc_, true, true);
 			return;
 		}
+		if(sinkPt_->replayDuplicate(*patsrc)) {
+			// Reported as a copy of an earlier read
+			this->done = true;
+			return;
+		}
 		driver_->setQuery(patsrc, NULL);
 		this->done = driver_->done;
 		doneFirst_ = false;
 		// Reset #-backtrack countdown
-		if(btCnt_ != NULL) *btCnt_ = maxBts_;
+		if(btCnt_ != NULL) {
+			*btCnt_ = (budget_ == NULL) ? maxBts_ :
+				budget_->nextRead(rdBudget_, patsrc->bufa().patFw,
+				                  patsrc->bufa().qual);
+		}
 		if(sinkPt_->setHits(patsrc->bufa().hitset)) {
 			this->done = true;
 			sinkPt_->finishRead(*patsrc_, true, true);
@@ -466,6 +481,7 @@ public:
 			TIndexOffU second,
 	                   uint32_t tlen)
 	{
+		if(budget_ != NULL) budget_->foundHit(rdBudget_, *btCnt_);
 		bool ebwtFw = ra.ebwt->fw();
 		params_->setFw(ra.fw);
 		assert_eq(bufa_->color, color);
@@ -565,6 +581,7 @@ public:
 			}
 		}
 		if(this->done) {
+			if(budget_ != NULL && btCnt_ != NULL && *btCnt_ == 0) sinkPt_->reportCutoff();
 			sinkPt_->finishRead(*patsrc_, true, true);
 		}
 		return this->done;
@@ -600,6 +617,8 @@ protected:
 	ChunkPool *pool_;
 	int *btCnt_;
 	AlignerMetrics *metrics_;
+	BacktrackBudget *budget_; // sets each read's backtrack budget, if non-NULL
+	ReadBudget rdBudget_;
 };
 
 /**
@@ -629,6 +648,7 @@ public:
 		bool fw1, bool fw2,
 		uint32_t minInsert,
 		uint32_t maxInsert,
+		InsertSizeEstimator *insEst,
 		bool dontReconcile,
 		uint32_t symCeiling,
 		uint32_t mixedThresh,
@@ -639,7 +659,8 @@ public:
 		bool quiet,
 		int maxBts,
 		ChunkPool *pool,
-		int *btCnt) :
+		int *btCnt,
+		BacktrackBudget *budget = NULL) :
 		Aligner(true, rangeMode),
 		refs_(refs),
 		patsrc_(NULL), qlen1_(0), qlen2_(0), doneFw_(true),
@@ -654,6 +675,9 @@ public:
 		params_(params),
 		minInsert_(minInsert),
 		maxInsert_(maxInsert),
+		insEst_(insEst),
+		insTally_(insEst == NULL ? NULL : insEst->newTally()),
+		insRecorded_(false),
 		dontReconcile_(dontReconcile),
 		symCeiling_(symCeiling),
 		mixedThresh_(mixedThresh),
@@ -666,6 +690,7 @@ public:
 		maxBts_(maxBts),
 		pool_(pool),
 		btCnt_(btCnt),
+		budget_(budget),
 		driver1Fw_(driver1Fw), driver1Rc_(driver1Rc),
 		offs1FwSz_(0), offs1RcSz_(0),
 		driver2Fw_(driver2Fw), driver2Rc_(driver2Rc),
@@ -759,7 +784,12 @@ public:
 		driver2Rc_->setQuery(patsrc, NULL);
 		qlen1_ = patsrc_->bufa().length();
 		qlen2_ = patsrc_->bufb().length();
-		if(btCnt_ != NULL) (*btCnt_) = maxBts_;
+		if(btCnt_ != NULL) {
+			(*btCnt_) = (budget_ == NULL) ? maxBts_ :
+				budget_->nextPair(rdBudget_,
+				                  patsrc_->bufa().patFw, patsrc_->bufa().qual,
+				                  patsrc_->bufb().patFw, patsrc_->bufb().qual);
+		}
 		// Neither orientation is done
 		doneFw_   = false;
 		doneFwFirst_ = true;
@@ -773,6 +803,7 @@ public:
 		delayedChase1Rc_ = false;
 		delayedChase2Fw_ = false;
 		delayedChase2Rc_ = false;
+		insRecorded_ = false;
 		// Clear all intermediate ranges
 		for(size_t i = 0; i < 32; i++) {
 			offs1FwArr_[i].clear();   offs1RcArr_[i].clear();
@@ -846,6 +877,7 @@ public:
 		advanceOrientation(!doneFw_);
 		if(this->done) {
 			if(verbose2_) cout << "----" << endl;
+			if(budget_ != NULL && btCnt_ != NULL && *btCnt_ == 0) sinkPt_->reportCutoff();
 			sinkPt_->finishRead(*patsrc_, true, true);
 		}
 		return this->done;
@@ -869,6 +901,7 @@ protected:
 	            bool ebwtFwR)
 	{
 		assert(gAllowMateContainment || upstreamOff < dnstreamOff);
+		if(budget_ != NULL) budget_->foundHit(rdBudget_, *btCnt_);
 		TIndexOffU spreadL = rL.bot - rL.top;
 		TIndexOffU spreadR = rR.bot - rR.top;
 		TIndexOffU oms = min(spreadL, spreadR) - 1;
@@ -970,6 +1003,41 @@ protected:
 	                             const UPair& off,
 	                             const TIndexOffU tlen,
 	                             const Range& range)
+	{
+		bool found = false;
+		uint32_t lo, hi;
+		if(insEst_ != NULL && insEst_->window(lo, hi)) {
+			// Try where mates usually are first
+			insTally_->narrowed++;
+			bool ret = resolveOutstandingInRef(off1, off, tlen, range, lo, hi, found);
+			if(ret || found) return ret;
+			// Try the rest of the -I/-X window
+			insTally_->fallbacks++;
+			if(lo > minInsert_) {
+				ret = resolveOutstandingInRef(off1, off, tlen, range, minInsert_, lo - 1, found);
+				if(ret || found) return ret;
+			}
+			if(hi < maxInsert_) {
+				return resolveOutstandingInRef(off1, off, tlen, range, hi + 1, maxInsert_, found);
+			}
+			return false;
+		}
+		return resolveOutstandingInRef(off1, off, tlen, range,
+		                               minInsert_, maxInsert_, found);
+	}
+
+	/**
+	 * Look for the outstanding mate such that the insert is between
+	 * minIns and maxIns long.  Set 'found' iff a new paired alignment
+	 * was found.
+	 */
+	bool resolveOutstandingInRef(const bool off1,
+	                             const UPair& off,
+	                             const TIndexOffU tlen,
+	                             const Range& range,
+	                             uint32_t minIns,
+	                             uint32_t maxIns,
+	                             bool& found)
 	{
 		assert(refs_->loaded());
 		assert_lt(off.first, refs_->numRefs());
@@ -995,8 +1063,8 @@ protected:
 		uint32_t qlen = (uint32_t)seqan::length(seq);  // length of outstanding mate
 		uint32_t alen = (off1 ? patsrc_->bufa().length() :
 		                        patsrc_->bufb().length());
-		int minins = minInsert_;
-		int maxins = maxInsert_;
+		int minins = minIns;
+		int maxins = maxIns;
 		// Let minins and maxins be the minimum and maximum insert
 		// lengths once we account for the trimming applied to the
 		// mates.  The idea is that the insert constraint placed by
@@ -1075,6 +1143,7 @@ protected:
 		                  offs, doneFw_ ? &pairs_rc_ : &pairs_fw_,
 		                  toff, fw);
 		assert_eq(ranges.size(), offs.size());
+		found = !ranges.empty();
 		for(size_t i = 0; i < ranges.size(); i++) {
 			Range& r = ranges[i];
 			// Fill in fields that aren't filled in by the RefAligner
@@ -1082,6 +1151,14 @@ protected:
 			r.cost |= (r.stratum << 14);
 			r.mate1 = !off1;
 			const TIndexOffU result = offs[i];
+			if(insTally_ != NULL && !insRecorded_) {
+				// Undo the trimming adjustment so the estimate is in
+				// the same terms as -I/-X
+				TIndexOffU left = min(toff, result);
+				TIndexOffU right = max(toff + alen, result + qlen);
+				insEst_->record(insTally_, (uint32_t)(right - left) + (maxIns - maxins));
+				insRecorded_ = true;
+			}
 			// NOTE: We have no idea what the BW range delimiting the
 			// opposite hit is, because we were operating entirely in
 			// reference space when we found it.  For now, we just copy
@@ -1377,6 +1454,11 @@ protected:
 	const uint32_t minInsert_;
 	const uint32_t maxInsert_;
 
+	// Learns the insert-size window, if --learnins is set
+	InsertSizeEstimator *insEst_;
+	InsertSizeTally *insTally_;
+	bool insRecorded_; // recorded this pair's insert size yet?
+
 	// Don't attempt pairwise all-versus-all style of mate
 	// reconciliation; just rely on mixed mode
 	const bool dontReconcile_;
@@ -1407,6 +1489,8 @@ protected:
 	int maxBts_;
 	ChunkPool *pool_;
 	int *btCnt_;
+	BacktrackBudget *budget_; // sets each pair's backtrack budget, if non-NULL
+	ReadBudget rdBudget_;
 
 	// Range-finding state for first mate
 	TDriver*      driver1Fw_;
@@ -1523,6 +1607,7 @@ public:
 		bool fw1, bool fw2,
 		uint32_t minInsert,
 		uint32_t maxInsert,
+		InsertSizeEstimator *insEst,
 		uint32_t mixedAttemptLim,
 		const BitPairReference* refs,
 		bool rangeMode,
@@ -1530,7 +1615,8 @@ public:
 		bool quiet,
 		int maxBts,
 		ChunkPool *pool,
-		int *btCnt) :
+		int *btCnt,
+		BacktrackBudget *budget = NULL) :
 		Aligner(true, rangeMode),
 		refs_(refs),
 		patsrc_(NULL),
@@ -1549,6 +1635,9 @@ public:
 		paramsSe2_(paramsSe2),
 		minInsert_(minInsert),
 		maxInsert_(maxInsert),
+		insEst_(insEst),
+		insTally_(insEst == NULL ? NULL : insEst->newTally()),
+		insRecorded_(false),
 		mixedAttemptLim_(mixedAttemptLim),
 		mixedAttempts_(0),
 		fw1_(fw1), fw2_(fw2),
@@ -1558,7 +1647,8 @@ public:
 		verbose_(verbose),
 		quiet_(quiet),
 		maxBts_(maxBts),
-		btCnt_(btCnt)
+		btCnt_(btCnt),
+		budget_(budget)
 	{
 		assert(sinkPt_ != NULL);
 		assert(params_ != NULL);
@@ -1603,7 +1693,12 @@ public:
 		driver_->setQuery(patsrc, NULL);
 		qlen1_ = patsrc_->bufa().length();
 		qlen2_ = patsrc_->bufb().length();
-		if(btCnt_ != NULL) (*btCnt_) = maxBts_;
+		if(btCnt_ != NULL) {
+			(*btCnt_) = (budget_ == NULL) ? maxBts_ :
+				budget_->nextPair(rdBudget_,
+				                  patsrc_->bufa().patFw, patsrc_->bufa().qual,
+				                  patsrc_->bufb().patFw, patsrc_->bufb().qual);
+		}
 		mixedAttempts_ = 0;
 		// Neither orientation is done
 		this->done = false;
@@ -1612,6 +1707,7 @@ public:
 		donePe_ = doneSe1_ = doneSe2_ = false;
 		pairs_fw_.clear();
 		pairs_rc_.clear();
+		insRecorded_ = false;
 	}
 
 	/**
@@ -1715,6 +1811,7 @@ public:
 		}
 
 		if(this->done) {
+			if(budget_ != NULL && btCnt_ != NULL && *btCnt_ == 0) sinkPt_->reportCutoff();
 			bool reportedPe = (sinkPt_->finishRead(*patsrc_, true, true) > 0);
 			if(sinkPtSe1_ != NULL) {
 				sinkPtSe1_->finishRead(*patsrc_, !reportedPe, false);
@@ -1742,6 +1839,7 @@ protected:
 	            bool ebwtFwR)
 	{
 		assert(gAllowMateContainment || upstreamOff < dnstreamOff);
+		if(budget_ != NULL) budget_->foundHit(rdBudget_, *btCnt_);
 		TIndexOffU spreadL = rL.bot - rL.top;
 		TIndexOffU spreadR = rR.bot - rR.top;
 		TIndexOffU oms = min(spreadL, spreadR) - 1;
@@ -1910,6 +2008,40 @@ protected:
 	bool resolveOutstandingInRef(const UPair& off,
 	                             const TIndexOffU tlen,
 	                             const Range& range)
+	{
+		bool found = false;
+		uint32_t lo, hi;
+		if(insEst_ != NULL && insEst_->window(lo, hi)) {
+			// Try where mates usually are first
+			insTally_->narrowed++;
+			bool ret = resolveOutstandingInRef(off, tlen, range, lo, hi, found);
+			if(ret || found) return ret;
+			// Try the rest of the -I/-X window
+			insTally_->fallbacks++;
+			if(lo > minInsert_) {
+				ret = resolveOutstandingInRef(off, tlen, range, minInsert_, lo - 1, found);
+				if(ret || found) return ret;
+			}
+			if(hi < maxInsert_) {
+				return resolveOutstandingInRef(off, tlen, range, hi + 1, maxInsert_, found);
+			}
+			return false;
+		}
+		return resolveOutstandingInRef(off, tlen, range,
+		                               minInsert_, maxInsert_, found);
+	}
+
+	/**
+	 * Look for the outstanding mate such that the insert is between
+	 * minIns and maxIns long.  Set 'found' iff a new paired alignment
+	 * was found.
+	 */
+	bool resolveOutstandingInRef(const UPair& off,
+	                             const TIndexOffU tlen,
+	                             const Range& range,
+	                             uint32_t minIns,
+	                             uint32_t maxIns,
+	                             bool& found)
 	{
 		assert(!donePe_);
 		assert(refs_->loaded());
@@ -1939,8 +2071,8 @@ protected:
 		uint32_t qlen = (uint32_t)seqan::length(seq);  // length of outstanding mate
 		uint32_t alen = (range.mate1 ? patsrc_->bufa().length() :
 		                               patsrc_->bufb().length());
-		int minins = minInsert_;
-		int maxins = maxInsert_;
+		int minins = minIns;
+		int maxins = maxIns;
 		if(fw1_) {
 			minins = max<int>(0, minins - patsrc_->bufa().trimmed5);
 			maxins = max<int>(0, maxins - patsrc_->bufa().trimmed5);
@@ -2010,12 +2142,21 @@ protected:
 		                  offs, pairFw ? &pairs_fw_ : &pairs_rc_,
 		                  toff, fw);
 		assert_eq(ranges.size(), offs.size());
+		found = !ranges.empty();
 		for(size_t i = 0; i < ranges.size(); i++) {
 			Range& r = ranges[i];
 			r.fw = fw;
 			r.cost |= (r.stratum << 14);
 			r.mate1 = !range.mate1;
 			const TIndexOffU result = offs[i];
+			if(insTally_ != NULL && !insRecorded_) {
+				// Undo the trimming adjustment so the estimate is in
+				// the same terms as -I/-X
+				TIndexOffU left = min(toff, result);
+				TIndexOffU right = max(toff + alen, result + qlen);
+				insEst_->record(insTally_, (uint32_t)(right - left) + (maxIns - maxins));
+				insRecorded_ = true;
+			}
 			// Just copy the known range's top and bot for now
 			r.top = range.top;
 			r.bot = range.bot;
@@ -2062,6 +2203,11 @@ protected:
 	const uint32_t minInsert_;
 	const uint32_t maxInsert_;
 
+	// Learns the insert-size window, if --learnins is set
+	InsertSizeEstimator *insEst_;
+	InsertSizeTally *insTally_;
+	bool insRecorded_; // recorded this pair's insert size yet?
+
 	const uint32_t mixedAttemptLim_;
 	uint32_t mixedAttempts_;
 
@@ -2083,6 +2229,8 @@ protected:
 
 	int maxBts_; // maximum allowed # backtracks
 	int *btCnt_; // current backtrack count
+	BacktrackBudget *budget_; // sets each pair's backtrack budget, if non-NULL
+	ReadBudget rdBudget_;
 
 	/// For keeping track of paired alignments that have already been
 	/// found for the forward and reverse-comp pair orientations
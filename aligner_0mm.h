@@ -155,6 +155,7 @@ public:
 			bool mate2fw,
 			uint32_t peInner,
 			uint32_t peOuter,
+			InsertSizeEstimator* insEst,
 			bool dontReconcile,
 			uint32_t symCeil,
 			uint32_t mixedThresh,
@@ -184,6 +185,7 @@ public:
 			mate2fw_(mate2fw),
 			peInner_(peInner),
 			peOuter_(peOuter),
+			insEst_(insEst),
 			dontReconcile_(dontReconcile),
 			symCeil_(symCeil),
 			mixedThresh_(mixedThresh),
@@ -304,7 +306,7 @@ public:
 		}
 
 		RefAligner<String<Dna5> >* refAligner
-			= new ExactRefAligner<String<Dna5> >(color_, verbose_, quiet_);
+			= new HammingRefAligner<String<Dna5> >(color_, verbose_, quiet_, 0);
 
 		// Set up a RangeChaser
 		RangeChaser<String<Dna> > *rchase =
@@ -319,7 +321,7 @@ public:
 				driver2Rc == NULL ? (new StubRangeSourceDriver<EbwtRangeSource>()) : driver2Rc,
 				refAligner,
 				rchase, sink_, sinkPtFactory_, sinkPt, mate1fw_, mate2fw_,
-				peInner_, peOuter_, dontReconcile_, symCeil_, mixedThresh_,
+				peInner_, peOuter_, insEst_, dontReconcile_, symCeil_, mixedThresh_,
 				mixedAttemptLim_, refs_, rangeMode_, verbose_,
 				quiet_, INT_MAX, pool_, NULL);
 			return al;
@@ -335,7 +337,7 @@ public:
 				refAligner,
 				rchase, sink_, sinkPtFactory_, sinkPt,
 				sinkPtSe1, sinkPtSe2, mate1fw_, mate2fw_,
-				peInner_, peOuter_,
+				peInner_, peOuter_, insEst_,
 				mixedAttemptLim_, refs_, rangeMode_,
 				verbose_, quiet_, INT_MAX, pool_, NULL);
 			delete drVec;
@@ -356,6 +358,7 @@ private:
 	const bool mate2fw_;
 	const uint32_t peInner_;
 	const uint32_t peOuter_;
+	InsertSizeEstimator *insEst_;
 	const bool dontReconcile_;
 	const uint32_t symCeil_;
 	const uint32_t mixedThresh_;
@@ -192,6 +192,7 @@ public:
 			bool mate2fw,
 			uint32_t peInner,
 			uint32_t peOuter,
+			InsertSizeEstimator* insEst,
 			bool dontReconcile,
 			uint32_t symCeil,
 			uint32_t mixedThresh,
@@ -222,6 +223,7 @@ public:
 			mate2fw_(mate2fw),
 			peInner_(peInner),
 			peOuter_(peOuter),
+			insEst_(insEst),
 			dontReconcile_(dontReconcile),
 			symCeil_(symCeil),
 			mixedThresh_(mixedThresh),
@@ -416,7 +418,7 @@ public:
 		}
 
 		RefAligner<String<Dna5> >* refAligner =
-			new OneMMRefAligner<String<Dna5> >(color_, verbose_, quiet_);
+			new HammingRefAligner<String<Dna5> >(color_, verbose_, quiet_, 1);
 
 		// Set up a RangeChaser
 		RangeChaser<String<Dna> > *rchase =
@@ -431,7 +433,7 @@ public:
 				new TCostAwareRangeSrcDr(strandFix_, dr2RcVec, verbose_, quiet_, false),
 				refAligner, rchase,
 				sink_, sinkPtFactory_, sinkPt, mate1fw_, mate2fw_,
-				peInner_, peOuter_, dontReconcile_, symCeil_, mixedThresh_,
+				peInner_, peOuter_, insEst_, dontReconcile_, symCeil_, mixedThresh_,
 				mixedAttemptLim_, refs_, rangeMode_, verbose_,
 				quiet_, INT_MAX, pool_, NULL);
 			delete dr1FwVec;
@@ -447,7 +449,7 @@ public:
 				sink_, sinkPtFactory_,
 				sinkPt, sinkPtSe1, sinkPtSe2,
 				mate1fw_, mate2fw_,
-				peInner_, peOuter_,
+				peInner_, peOuter_, insEst_,
 				mixedAttemptLim_, refs_, rangeMode_,
 				verbose_, quiet_, INT_MAX, pool_, NULL);
 			delete dr1FwVec;
@@ -468,6 +470,7 @@ private:
 	const bool mate2fw_;
 	const uint32_t peInner_;
 	const uint32_t peOuter_;
+	InsertSizeEstimator *insEst_;
 	const bool dontReconcile_;
 	const uint32_t symCeil_;
 	const uint32_t mixedThresh_;
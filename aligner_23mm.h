@@ -264,6 +264,7 @@ public:
 			bool mate2fw,
 			uint32_t peInner,
 			uint32_t peOuter,
+			InsertSizeEstimator* insEst,
 			bool dontReconcile,
 			uint32_t symCeil,
 			uint32_t mixedThresh,
@@ -295,6 +296,7 @@ public:
 			mate2fw_(mate2fw),
 			peInner_(peInner),
 			peOuter_(peOuter),
+			insEst_(insEst),
 			dontReconcile_(dontReconcile),
 			symCeil_(symCeil),
 			mixedThresh_(mixedThresh),
@@ -607,12 +609,8 @@ public:
 			}
 		}
 
-		RefAligner<String<Dna5> >* refAligner;
-		if(two_) {
-			refAligner = new TwoMMRefAligner<String<Dna5> >(color_, verbose_, quiet_);
-		} else {
-			refAligner = new ThreeMMRefAligner<String<Dna5> >(color_, verbose_, quiet_);
-		}
+		RefAligner<String<Dna5> >* refAligner =
+			new HammingRefAligner<String<Dna5> >(color_, verbose_, quiet_, two_ ? 2 : 3);
 
 		// Set up a RangeChaser
 		RangeChaser<String<Dna> > *rchase =
@@ -627,7 +625,7 @@ public:
 				new TCostAwareRangeSrcDr(strandFix_, dr2RcVec, verbose_, quiet_, false),
 				refAligner, rchase,
 				sink_, sinkPtFactory_, sinkPt, mate1fw_, mate2fw_,
-				peInner_, peOuter_, dontReconcile_, symCeil_, mixedThresh_,
+				peInner_, peOuter_, insEst_, dontReconcile_, symCeil_, mixedThresh_,
 				mixedAttemptLim_, refs_, rangeMode_, verbose_,
 				quiet_, INT_MAX, pool_, NULL);
 			delete dr1FwVec;
@@ -643,7 +641,7 @@ public:
 				sink_, sinkPtFactory_,
 				sinkPt, sinkPtSe1, sinkPtSe2,
 				mate1fw_, mate2fw_,
-				peInner_, peOuter_,
+				peInner_, peOuter_, insEst_,
 				mixedAttemptLim_, refs_, rangeMode_,
 				verbose_, quiet_, INT_MAX, pool_, NULL);
 			delete dr1FwVec;
@@ -665,6 +663,7 @@ private:
 	const bool mate2fw_;
 	const uint32_t peInner_;
 	const uint32_t peOuter_;
+	InsertSizeEstimator *insEst_;
 	const bool dontReconcile_;
 	const uint32_t symCeil_;
 	const uint32_t mixedThresh_;
@@ -6,7 +6,9 @@
 #define ALIGNER_METRICS_H_
 
 #include <math.h>
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include <seqan/sequence.h>
 #include "alphabet.h"
 #include "timer.h"
@@ -333,4 +335,171 @@ protected:
 	Timer timer_;
 };
 
+/**
+ * One read's share of a BacktrackBudget: its kind, how many
+ * backtracks it was given, and whether it's one of the reads whose
+ * backtracks are being sampled.
+ */
+struct ReadBudget {
+	int  kind;    /// index of the read's kind
+	int  bts;     /// # backtracks the read was given
+	bool probe;   /// read got the full budget and will be sampled
+	bool sampled; /// read's first hit was already sampled
+};
+
+/**
+ * Chooses each read's backtracking budget from how many backtracks
+ * earlier reads of the same kind needed before their first hit.  A
+ * read's kind is its number of Ns (0, 1, 2 or more) and whether its
+ * mean quality is below Q20.  The budget is the smallest one that
+ * would have let a 'sens' fraction of recently sampled reads of that
+ * kind find their first hit, and never more than the global limit.
+ *
+ * A read searched under a tight budget can't tell us what it would
+ * have needed, so only reads given the full budget are sampled: all
+ * reads while too few samples exist, and one in PROBE_EVERY after.
+ * One per thread; not synchronized.
+ */
+class BacktrackBudget {
+
+	static const int KINDS       = 6;   // 3 N classes x 2 quality classes
+	static const int WINDOW      = 256; // samples kept per kind
+	static const int MIN_SAMPLES = 32;  // samples needed to trust a kind
+	static const int PROBE_EVERY = 16;  // sample one read in this many
+
+	/**
+	 * The last WINDOW backtrack counts sampled, and the budget that
+	 * covers a given fraction of them.
+	 */
+	class Samples {
+	public:
+		Samples() : n_(0), budget_(0), dirty_(true) { }
+
+		void push(int bts) {
+			if(vals_.size() < (size_t)WINDOW) vals_.push_back(bts);
+			else vals_[n_ % WINDOW] = bts;
+			n_++;
+			dirty_ = true;
+		}
+
+		size_t size() const { return vals_.size(); }
+
+		/**
+		 * Return the smallest budget under which a 'sens' fraction of
+		 * the sampled reads would have found their first hit.
+		 */
+		int budget(float sens) {
+			assert(!vals_.empty());
+			if(dirty_) {
+				sorted_ = vals_;
+				size_t i = (size_t)ceil(sens * sorted_.size());
+				i = std::max<size_t>(i, 1) - 1;
+				std::nth_element(sorted_.begin(), sorted_.begin() + i, sorted_.end());
+				// The search ends when the countdown reaches 0
+				budget_ = sorted_[i] + 1;
+				dirty_ = false;
+			}
+			return budget_;
+		}
+
+	private:
+		std::vector<int> vals_;
+		std::vector<int> sorted_;
+		uint64_t n_;
+		int budget_;
+		bool dirty_;
+	};
+
+public:
+
+	BacktrackBudget(int maxBts, float sens) :
+		maxBts_(maxBts), sens_(sens), reads_(0)
+	{
+		assert_gt(sens, 0.0f);
+		assert_leq(sens, 1.0f);
+	}
+
+	/**
+	 * Set up 'rb' for an unpaired read and return its budget.
+	 */
+	int nextRead(ReadBudget& rb,
+	             const seqan::String<seqan::Dna5>& seq,
+	             const seqan::String<char>& qual)
+	{
+		int ns = 0, qsum = 0;
+		tally(seq, qual, ns, qsum);
+		return start(rb, ns, qsum, (int)seqan::length(seq));
+	}
+
+	/**
+	 * Set up 'rb' for a pair and return its budget.
+	 */
+	int nextPair(ReadBudget& rb,
+	             const seqan::String<seqan::Dna5>& seq1,
+	             const seqan::String<char>& qual1,
+	             const seqan::String<seqan::Dna5>& seq2,
+	             const seqan::String<char>& qual2)
+	{
+		int ns = 0, qsum = 0;
+		tally(seq1, qual1, ns, qsum);
+		tally(seq2, qual2, ns, qsum);
+		return start(rb, ns, qsum,
+		             (int)(seqan::length(seq1) + seqan::length(seq2)));
+	}
+
+	/**
+	 * Note that the read found a hit with 'left' backtracks left of
+	 * its budget.  Only a probe read's first hit is sampled.
+	 */
+	void foundHit(ReadBudget& rb, int left) {
+		if(!rb.probe || rb.sampled) return;
+		rb.sampled = true;
+		assert_leq(left, rb.bts);
+		int used = rb.bts - left;
+		kinds_[rb.kind].push(used);
+		all_.push(used);
+	}
+
+private:
+
+	/**
+	 * Add the Ns and the qualities of a read to the running totals.
+	 */
+	static void tally(const seqan::String<seqan::Dna5>& seq,
+	                  const seqan::String<char>& qual,
+	                  int& ns, int& qsum)
+	{
+		const size_t len = seqan::length(seq);
+		for(size_t i = 0; i < len; i++) {
+			if((int)seq[i] == 4) ns++;
+			if(i < seqan::length(qual)) qsum += (qual[i] - 33);
+		}
+	}
+
+	/**
+	 * Pick the kind and the budget for a read with 'ns' Ns and
+	 * qualities summing to 'qsum' over 'len' chars.
+	 */
+	int start(ReadBudget& rb, int ns, int qsum, int len) {
+		rb.kind = std::min(ns, 2) * 2 + ((qsum < 20 * len) ? 1 : 0);
+		rb.sampled = false;
+		Samples *s = NULL;
+		if(kinds_[rb.kind].size() >= (size_t)MIN_SAMPLES) {
+			s = &kinds_[rb.kind];
+		} else if(all_.size() >= (size_t)MIN_SAMPLES) {
+			s = &all_;
+		}
+		// Keeping every hit takes the full limit for every read
+		rb.probe = (s == NULL || sens_ >= 1.0f || (reads_++ % PROBE_EVERY) == 0);
+		rb.bts = rb.probe ? maxBts_ : std::min(s->budget(sens_), maxBts_);
+		return rb.bts;
+	}
+
+	const int maxBts_;
+	const float sens_;
+	uint64_t reads_;
+	Samples kinds_[KINDS];
+	Samples all_;
+};
+
 #endif /* ALIGNER_METRICS_H_ */
@@ -47,7 +47,8 @@ public:
 			bool verbose,
 			bool quiet,
 			uint32_t seed,
-			AlignerMetrics *metrics) :
+			AlignerMetrics *metrics,
+			BacktrackBudget *budget = NULL) :
 			ebwtFw_(ebwtFw),
 			ebwtBw_(ebwtBw),
 			doFw_(doFw), doRc_(doRc),
@@ -69,7 +70,8 @@ public:
 			rangeMode_(rangeMode),
 			verbose_(verbose),
 			quiet_(quiet),
-			metrics_(metrics)
+			metrics_(metrics),
+			budget_(budget)
 	{
 		assert(ebwtFw.isInMemory());
 	}
@@ -537,7 +539,7 @@ public:
 			params, dr, rchase,
 			sink_, sinkPtFactory_, sinkPt, os_, refs_,
 			rangeMode_, verbose_, quiet_, maxBts_, pool_, btCnt,
-			metrics_);
+			metrics_, budget_);
 	}
 
 private:
@@ -564,6 +566,7 @@ private:
 	bool verbose_;
 	bool quiet_;
 	AlignerMetrics *metrics_;
+	BacktrackBudget *budget_;
 };
 
 /**
@@ -591,6 +594,7 @@ public:
 			bool mate2fw,
 			uint32_t peInner,
 			uint32_t peOuter,
+			InsertSizeEstimator* insEst,
 			bool dontReconcile,
 			uint32_t symCeil,
 			uint32_t mixedThresh,
@@ -608,7 +612,8 @@ public:
 			bool rangeMode,
 			bool verbose,
 			bool quiet,
-			uint32_t seed) :
+			uint32_t seed,
+			BacktrackBudget *budget = NULL) :
 			ebwtFw_(ebwtFw),
 			ebwtBw_(ebwtBw),
 			color_(color),
@@ -625,6 +630,7 @@ public:
 			mate2fw_(mate2fw),
 			peInner_(peInner),
 			peOuter_(peOuter),
+			insEst_(insEst),
 			dontReconcile_(dontReconcile),
 			symCeil_(symCeil),
 			mixedThresh_(mixedThresh),
@@ -640,7 +646,8 @@ public:
 			strandFix_(strandFix),
 			rangeMode_(rangeMode),
 			verbose_(verbose),
-			quiet_(quiet)
+			quiet_(quiet),
+			budget_(budget)
 	{
 		assert(ebwtFw.isInMemory());
 		assert(ebwtBw->isInMemory());
@@ -663,18 +670,11 @@ public:
 			paramsSe2 =
 				new EbwtSearchParams<String<Dna> >(*sinkPtSe2, os_);
 		}
-		RefAligner<String<Dna5> >* refAligner = NULL;
+		RefAligner<String<Dna5> >* refAligner =
+			new HammingRefAligner<String<Dna5> >(
+				color_, verbose_, quiet_, seedMms_, seedLen_, qualCutoff_, maqPenalty_);
 		int *btCnt = new int[1];
 		*btCnt = maxBts_;
-		if(seedMms_ == 0) {
-			refAligner = new Seed0RefAligner<String<Dna5> >(color_, verbose_, quiet_, seedLen_, qualCutoff_, maqPenalty_);
-		} else if(seedMms_ == 1) {
-			refAligner = new Seed1RefAligner<String<Dna5> >(color_, verbose_, quiet_, seedLen_, qualCutoff_, maqPenalty_);
-		} else if(seedMms_ == 2) {
-			refAligner = new Seed2RefAligner<String<Dna5> >(color_, verbose_, quiet_, seedLen_, qualCutoff_, maqPenalty_);
-		} else {
-			refAligner = new Seed3RefAligner<String<Dna5> >(color_, verbose_, quiet_, seedLen_, qualCutoff_, maqPenalty_);
-		}
 		bool do1Fw = true;
 		bool do1Rc = true;
 		bool do2Fw = true;
@@ -1328,10 +1328,10 @@ public:
 				new TCostAwareRangeSrcDr(strandFix_, dr2FwVec, verbose_, quiet_, false),
 				new TCostAwareRangeSrcDr(strandFix_, dr2RcVec, verbose_, quiet_, false),
 				refAligner, rchase, sink_, sinkPtFactory_, sinkPt,
-				mate1fw_, mate2fw_, peInner_, peOuter_, dontReconcile_,
+				mate1fw_, mate2fw_, peInner_, peOuter_, insEst_, dontReconcile_,
 				symCeil_, mixedThresh_, mixedAttemptLim_, refs_,
 				rangeMode_, verbose_, quiet_, maxBts_, pool_,
-				btCnt);
+				btCnt, budget_);
 			delete dr1FwVec;
 			delete dr1RcVec;
 			delete dr2FwVec;
@@ -1343,9 +1343,9 @@ public:
 				params, paramsSe1, paramsSe2,
 				new TCostAwareRangeSrcDr(strandFix_, dr1FwVec, verbose_, quiet_, true),
 				refAligner, rchase, sink_, sinkPtFactory_, sinkPt,
-				sinkPtSe1, sinkPtSe2, mate1fw_, mate2fw_, peInner_, peOuter_,
+				sinkPtSe1, sinkPtSe2, mate1fw_, mate2fw_, peInner_, peOuter_, insEst_,
 				mixedAttemptLim_, refs_, rangeMode_, verbose_,
-				quiet_, maxBts_, pool_, btCnt);
+				quiet_, maxBts_, pool_, btCnt, budget_);
 			delete dr1FwVec;
 			return al;
 		}
@@ -1368,6 +1368,7 @@ private:
 	const bool mate2fw_;
 	const uint32_t peInner_;
 	const uint32_t peOuter_;
+	InsertSizeEstimator *insEst_;
 	const bool dontReconcile_;
 	const uint32_t symCeil_;
 	const uint32_t mixedThresh_;
@@ -1385,6 +1386,7 @@ private:
 	const bool rangeMode_;
 	const bool verbose_;
 	const bool quiet_;
+	BacktrackBudget *budget_;
 };
 
 #endif /* ALIGNER_SEED_MM_H_ */
@@ -47,116 +47,6 @@ bitsetRealloc(TIndexOffU& sz, TIndexOffU* words, const char *errmsg = NULL) {
 	return newwords; // return new array
 }
 
-/**
- * A simple synchronized bitset class.
- */
-class SyncBitset {
-
-public:
-	/**
-	 * Allocate enough words to accommodate 'sz' bits.  Output the given
-	 * error message and quit if allocation fails.
-	 */
-	SyncBitset(TIndexOffU sz, const char *errmsg = NULL) : _errmsg(errmsg) {
-		TIndexOffU nwords = (sz / WORD_SIZE)+1; // divide by 32 and add 1
-		try {
-			_words = new TIndexOffU[nwords];
-		} catch(std::bad_alloc& ba) {
-			if(_errmsg != NULL) {
-				std::cerr << _errmsg;
-			}
-			throw 1;
-		}
-		assert(_words != NULL);
-		memset(_words, 0, nwords * OFF_SIZE /* words to bytes */);
-		_sz = nwords * WORD_SIZE /* words to bits */;
-	}
-
-	/**
-	 * Free memory for words.
-	 */
-	~SyncBitset() {
-		delete[] _words;
-	}
-
-	/**
-	 * Test whether the given bit is set in an unsynchronized manner.
-	 */
-	bool testUnsync(TIndexOffU i) {
-		if(i < _sz) {
-			return ((_words[i / WORD_SIZE] >> (i & BITSET_MASK)) & 1) != 0;
-		}
-		return false;
-	}
-
-	/**
-	 * Test whether the given bit is set in a synchronized manner.
-	 */
-	bool test(TIndexOffU i) {
-		bool ret;
-		ThreadSafe _ts(&mutex_m);
-		ret = testUnsync(i);
-		return ret;
-	}
-
-	/**
-	 * Set a bit in the vector that hasn't been set before.  Assert if
-	 * it has been set.  Uses synchronization.
-	 */
-	void set(TIndexOffU i) {
-		ThreadSafe _ts(&mutex_m);
-		while(i >= _sz) {
-			// Slow path: bitset needs to be expanded before the
-			// specified bit can be set
-			ASSERT_ONLY(TIndexOffU oldsz = _sz);
-			expand();
-			assert_gt(_sz, oldsz);
-		}
-		// Fast path
-		assert_lt(i, _sz);
-		assert(((_words[i / WORD_SIZE] >> (i & BITSET_MASK)) & 1) == 0);
-		_words[i / WORD_SIZE] |= ((TIndexOffU)1 << (i & BITSET_MASK));
-		assert(((_words[i / WORD_SIZE] >> (i & BITSET_MASK)) & 1) == 1);
-	}
-
-	/**
-	 * Set a bit in the vector that might have already been set.  Uses
-	 * synchronization.
-	 */
-	void setOver(TIndexOffU i) {
-		ThreadSafe _ts(&mutex_m);
-		while(i >= _sz) {
-			// Slow path: bitset needs to be expanded before the
-			// specified bit can be set
-			ASSERT_ONLY(TIndexOffU oldsz = _sz);
-			expand();
-			assert_gt(_sz, oldsz);
-		}
-		// Fast path
-		assert_lt(i, _sz);
-		_words[i / WORD_SIZE] |= ((TIndexOffU)1 << (i & BITSET_MASK));
-		assert(((_words[i / WORD_SIZE] >> (i & BITSET_MASK)) & 1) == 1);
-	}
-
-
-private:
-
-	/**
-	 * Expand the size of the _words array by 50% to accommodate more
-	 * bits.
-	 */
-	void expand() {
-		TIndexOffU *newwords = bitsetRealloc(_sz, _words, _errmsg);
-		delete[] _words;   // delete old array
-		_words = newwords; // install new array
-	}
-
-	const char *_errmsg; // error message if an allocation fails
-	TIndexOffU _sz;        // size as # of bits
-	MUTEX_T mutex_m;       // mutex
-	TIndexOffU *_words;    // storage
-};
-
 /**
  * A simple unsynchronized bitset class.
  */
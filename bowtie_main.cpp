@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <vector>
 #include "tokenize.h"
+#include "server.h"
 
 using namespace std;
 
@@ -26,8 +27,20 @@ extern "C" {
  * will interpret that file as having one set of command-line arguments
  * per line, and will dispatch each batch of arguments one at a time to
  * bowtie.
+ *
+ * If the user specifies --client <socket>, the remaining arguments are
+ * sent as a job to the bowtie --server listening on <socket>.
  */
 int main(int argc, const char **argv) {
+	for(int i = 1; i + 1 < argc; i++) {
+		if(strcmp(argv[i], "--client") == 0) {
+			vector<const char*> args;
+			for(int j = 1; j < argc; j++) {
+				if(j != i && j != i + 1) args.push_back(argv[j]);
+			}
+			return submitJob(argv[i + 1], (int)args.size(), args.empty() ? NULL : &args[0]);
+		}
+	}
 	if(argc > 2 && strcmp(argv[1], "-A") == 0) {
 		const char *file = argv[2];
 		ifstream in;
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <string>
 #include <stdlib.h>
+#include <algorithm>
+#include <climits>
 #include "alphabet.h"
 #include "color_dec.h"
 #include "color.h"
@@ -28,12 +30,12 @@ static int firsts[] = {
 /**
  * Given a nucleotide mask, pick one matching nucleotide at random.
  */
-static int randFromMask(int mask) {
+static int randFromMask(RandomSource& rnd, int mask) {
 	assert_gt(mask, 0);
 	if(alts[mask] == 1) return firsts[mask];
 	assert_gt(mask, 0);
 	assert_lt(mask, 16);
-	int r = rand() % alts[mask];
+	int r = (int)(rnd.nextU32() % alts[mask]);
 	assert_geq(r, 0);
 	assert_lt(r, alts[mask]);
 	for(int i = 0; i < 4; i++) {
@@ -55,14 +57,15 @@ static inline bool matches(int i, int j) {
 }
 
 /**
- * Given the dynamic programming table, trace backwards from the last
- * column and populate the 's' and 'cmm' strings accordingly.  Whenever
- * there are multiple equally good ways of backtracking, choose one at
- * random.
+ * Given the backtrack masks, trace backwards from the last column and
+ * populate the 's' and 'cmm' strings accordingly.  Whenever there are
+ * multiple equally good ways of backtracking, choose one at random.
  */
-static void backtrack(int table[4][6][1025], // filled-in table
+static void backtrack(const uint8_t masks[][4], // masks[t][to] = best predecessors
+                      const int *last,  // costs of each nucleotide in last column
                       const char *read, size_t readi, size_t readf,
                       const char *ref, size_t refi, size_t reff,
+                      RandomSource& rnd,
                       char *s,    // final nucleotide string
                       char *cmm,  // color mismatches
                       char *nmm,  // nucleotide mismatches
@@ -73,10 +76,9 @@ static void backtrack(int table[4][6][1025], // filled-in table
 	cmms = nmms = 0;
 	int min = INT_MAX;
 	int bests = 0;
-	// Determine best base in final column of table
+	// Determine best base in final column
 	for(int i = 0; i < 4; i++) {
-		// Install minimum and backtrack info
-		int m = table[i][4][len-1];
+		int m = last[i];
 		if(m < min) {
 			min = m;
 			bests = (1 << i);
@@ -87,14 +89,14 @@ static void backtrack(int table[4][6][1025], // filled-in table
 	// i <- position of rightmost nucleotide
 	int i = (int)len-1;
 	// to <- rightmost nucleotide
-	int to = randFromMask(bests);
+	int to = randFromMask(rnd, bests);
 	while(true) {
-		bests = table[to][5][i]; // get next best mask
+		bests = masks[i][to]; // get next best mask
 		s[i--] = to; // install best nucleotide
 		if(i < 0) break; // done
 		assert_gt(bests, 0);
 		assert_lt(bests, 16);
-		to = randFromMask(bests); // select
+		to = randFromMask(rnd, bests); // select
 	}
 	// Determine what reference nucleotides were matched against
 	for(size_t i = 0; i < len; i++) {
@@ -129,7 +131,7 @@ static void backtrack(int table[4][6][1025], // filled-in table
 
 /**
  * Decode the colorspace read 'read' as aligned against the reference
- * string 'ref', assuming that it's a hit.
+ * string 'ref', assuming that it's a hit.  Ties are broken with 'rnd'.
  */
 void decodeHit(
 		const char *read, // ASCII colors, '0', '1', '2', '3', '.'
@@ -140,6 +142,7 @@ void decodeHit(
 		size_t refi, // offset of first character within 'ref' to consider
 		size_t reff, // offset of last char (exclusive) in 'ref' to consider
 		int snpPhred, // penalty incurred by a SNP
+		RandomSource& rnd, // breaks ties between equally good decodings
 		char *ns,  // decoded nucleotides are appended here
 		char *cmm, // where the color mismatches are in the string
 		char *nmm, // where nucleotide mismatches are in the string
@@ -149,95 +152,61 @@ void decodeHit(
 	assert_lt(refi, reff);
 	assert_lt(readi, readf);
 	assert_eq(reff-refi-1, readf-readi);
+	assert_leq(reff-refi, 1025);
 
 	//
-	// Dynamic programming table; good for colorspace reads up to 1024
-	// colors in length.
+	// Dynamic programming: only the previous column's cost for each
+	// nucleotide is kept, plus, for every column, each nucleotide's
+	// mask of equally good predecessors.  Good for colorspace reads up
+	// to 1024 colors in length.
 	//
-	int table[4][6][1025];
-	// 0 -> A, 1 -> C, 2 -> G, 3 -> T, 4 -> min(A, C, G, T),
-	// 5 -> backtrack mask, 6 -> min mismatches
+	uint8_t masks[1025][4];
+	int cost[4];
 
-	// The first column of the table just considers the first
-	// nucleotide and whether it matches the ref nucleotide.
+	// The first column just considers the first nucleotide and
+	// whether it matches the ref nucleotide; if not, it's a SNP
 	for(int to = 0; to < 4; to++) {
-		if(matches(to, ref[refi])) {
-			// The assigned subject nucleotide matches the reference;
-			// no penalty
-			table[to][0][0] = 0;
-			table[to][1][0] = 0;
-			table[to][2][0] = 0;
-			table[to][3][0] = 0;
-			table[to][4][0] = 0;
-			table[to][5][0] = 15;
-		} else {
-			// The assigned subject nucleotide does not match the
-			// reference nucleotide, so we add a SNP penalty
-			table[to][0][0] = snpPhred;
-			table[to][1][0] = snpPhred;
-			table[to][2][0] = snpPhred;
-			table[to][3][0] = snpPhred;
-			table[to][4][0] = snpPhred;
-			table[to][5][0] = 15;
-		}
+		cost[to] = matches(to, ref[refi]) ? 0 : snpPhred;
+		masks[0][to] = 15;
 	}
 
 	// Successive columns examine successive alignment positions
-	int omin = INT_MAX, t = 0;
+	int t = 0;
 	for(size_t c = readi; c < readf; c++) {
 		const int readc = (int)read[c];
 		assert_leq(readc, 4);
 		assert_geq(readc, 0);
-		omin = INT_MAX;
-		// t <- index of column in dynamic programming table
+		// t <- index of column
 		t = (int)(c - readi + 1);
 		const int refc = ref[refi + t];
-		int from[] = { table[0][4][t-1], table[1][4][t-1],
-		               table[2][4][t-1], table[3][4][t-1] };
+		const int q = qual[c];
+		int next[4];
 		// For each downstream nucleotide
 		for(int to = 0; to < 4; to++) {
-			// For each upstream nucleotide
-			int min = INT_MAX;
+			// Cost of arriving from each upstream nucleotide; the one
+			// that agrees with the read color is rewarded
 			const int goodfrom = nuccol2nuc[to][readc];
-			int q = qual[c];
-			// Reward the preceding position
-			if(goodfrom < 4) from[goodfrom] -= q;
-			min = from[0];
-			table[to][5][t] = 1;
-			if(from[1] < min) {
-				min = from[1];
-				table[to][5][t] = 2;
-			} else if(from[1] == min) {
-				table[to][5][t] |= 2;
-			}
-			if(from[2] < min) {
-				min = from[2];
-				table[to][5][t] = 4;
-			} else if(from[2] == min) {
-				table[to][5][t] |= 4;
-			}
-			if(from[3] < min) {
-				min = from[3];
-				table[to][5][t] = 8;
-			} else if(from[3] == min) {
-				table[to][5][t] |= 8;
-			}
-			min += q;
-			if(!matches(to, refc)) {
-				min += snpPhred;
+			int from[4];
+			for(int f = 0; f < 4; f++) {
+				from[f] = cost[f] - ((f == goodfrom) ? q : 0);
 			}
-			table[to][4][t] = min;
-			if(min < omin) omin = min;
-			if(goodfrom < 4) from[goodfrom] += q;
+			int min = std::min(std::min(from[0], from[1]), std::min(from[2], from[3]));
+			masks[t][to] = (uint8_t)((from[0] == min ? 1 : 0) |
+			                         (from[1] == min ? 2 : 0) |
+			                         (from[2] == min ? 4 : 0) |
+			                         (from[3] == min ? 8 : 0));
+			next[to] = min + q + (matches(to, refc) ? 0 : snpPhred);
 		}
+		for(int to = 0; to < 4; to++) cost[to] = next[to];
 	}
 
 	t++;
 	assert_eq(t, (int)(reff - refi));
 	// Install the best backward path into ns, cmm, nmm
-	backtrack(table,
+	backtrack(masks, cost,
 	          read, readi, readi + t - 1,
 	          ref, refi, refi + t,
+	          rnd,
 	          ns, cmm, nmm, cmms, nmms);
 }
 
@@ -12,6 +12,7 @@
 #include <string>
 #include <utility>
 #include "alphabet.h"
+#include "random_source.h"
 
 void decodeHit(
 		const char *read, // ASCII colors, '0', '1', '2', '3', '.'
@@ -22,6 +23,7 @@ void decodeHit(
 		size_t refi, // offset of first character within 'ref' to consider
 		size_t reff, // offset of last char (exclusive) in 'ref' to consider
 		int snpPhred, // penalty incurred by a SNP
+		RandomSource& rnd, // breaks ties between equally good decodings
 		char *ns,  // decoded nucleotides are appended here
 		char *cmm, // where the color mismatches are in the string
 		char *nmm, // where nucleotide mismatches are in the string
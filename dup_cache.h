@@ -0,0 +1,188 @@
+/*
+ * dup_cache.h
+ *
+ * A cache of recent alignment outcomes, keyed by read sequence (and,
+ * where the search looks at them, binned qualities), so that a read
+ * identical to one aligned recently can be reported without searching
+ * the index again.  Amplicon, small-RNA and screening libraries are
+ * dominated by such duplicates.
+ *
+ * One DupReadCache is shared by all search threads.  It is split into
+ * shards, each with its own lock, map and least-recently-used list;
+ * each shard gets an equal part of the memory budget and evicts its
+ * least recently used entries to stay under it.
+ */
+
+#ifndef DUP_CACHE_H_
+#define DUP_CACHE_H_
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "assert_helpers.h"
+#include "hit.h"
+#include "pat.h"
+#include "qual.h"
+#include "threading.h"
+
+/// Number of independently locked parts of a DupReadCache
+static const size_t DUP_CACHE_SHARDS = 64;
+
+class DupReadCache {
+
+	struct Entry;
+	typedef std::map<std::string, Entry> TMap;
+	typedef std::list<TMap::iterator> TLru;
+
+	/// What finishRead() made of a read
+	struct Entry {
+		uint32_t         ret;   /// # reportable alignments
+		std::vector<Hit> hits;  /// hits, minus per-read strings
+		size_t           bytes; /// approximate memory used
+		TLru::iterator   lru;   /// position in shard's LRU list
+	};
+
+	struct Shard {
+		Shard() : bytes(0), lookups(0), hits(0), evictions(0) { }
+		TMap     map;
+		TLru     lru;       /// most recently used first
+		size_t   bytes;
+		uint64_t lookups;
+		uint64_t hits;
+		uint64_t evictions;
+		MUTEX_T  lock;
+	};
+
+public:
+
+	/**
+	 * Create a cache using about 'bytes' bytes of memory.  If
+	 * 'quals' is true, reads only match if their qualities fall in the
+	 * same mismatch-penalty bins (rounded Maq-style if 'maqRound').
+	 */
+	DupReadCache(size_t bytes, bool quals, bool maqRound) :
+		shardLim_(bytes / DUP_CACHE_SHARDS),
+		quals_(quals),
+		maqRound_(maqRound) { }
+
+	/**
+	 * Return true iff 'r' is a read we'd cache: unpaired, nucleotide,
+	 * and not carrying hits from an earlier run.
+	 */
+	static bool cacheable(const Read& r) {
+		return r.mate == 0 && !r.color && r.hitset.empty();
+	}
+
+	/**
+	 * If an identical read is in the cache, copy its outcome into ret
+	 * and hits and return true.  The hits' name, sequence and quality
+	 * fields are left empty for the caller to fill in.
+	 */
+	bool lookup(const Read& r, uint32_t& ret, std::vector<Hit>& hits) {
+		std::string key;
+		makeKey(r, key);
+		Shard& s = shard(key);
+		ThreadSafe _ts(&s.lock);
+		s.lookups++;
+		TMap::iterator it = s.map.find(key);
+		if(it == s.map.end()) return false;
+		s.hits++;
+		s.lru.splice(s.lru.begin(), s.lru, it->second.lru);
+		ret = it->second.ret;
+		hits = it->second.hits;
+		return true;
+	}
+
+	/**
+	 * Remember that read 'r' yielded 'ret' reportable alignments and
+	 * buffered hits 'hits'.
+	 */
+	void insert(const Read& r, uint32_t ret, const std::vector<Hit>& hits) {
+		std::string key;
+		makeKey(r, key);
+		size_t bytes = key.length() + sizeof(Entry) + 64 + hits.size() * sizeof(Hit);
+		if(bytes > shardLim_ / 4) return; // would crowd out too much else
+		Shard& s = shard(key);
+		ThreadSafe _ts(&s.lock);
+		if(s.map.find(key) != s.map.end()) return; // another thread beat us
+		while(s.bytes + bytes > shardLim_ && !s.lru.empty()) {
+			TMap::iterator victim = s.lru.back();
+			s.bytes -= victim->second.bytes;
+			s.lru.pop_back();
+			s.map.erase(victim);
+			s.evictions++;
+		}
+		Entry& e = s.map[key];
+		e.ret = ret;
+		e.hits = hits;
+		for(size_t i = 0; i < e.hits.size(); i++) {
+			// These come from the read being reported
+			seqan::clear(e.hits[i].patName);
+			seqan::clear(e.hits[i].patSeq);
+			seqan::clear(e.hits[i].quals);
+		}
+		e.bytes = bytes;
+		s.lru.push_front(s.map.find(key));
+		e.lru = s.lru.begin();
+		s.bytes += bytes;
+	}
+
+	/**
+	 * Print hit rate and evictions.
+	 */
+	void printStats(std::ostream& os) {
+		uint64_t lookups = 0, hits = 0, evictions = 0, entries = 0;
+		for(size_t i = 0; i < DUP_CACHE_SHARDS; i++) {
+			ThreadSafe _ts(&shards_[i].lock);
+			lookups += shards_[i].lookups;
+			hits += shards_[i].hits;
+			evictions += shards_[i].evictions;
+			entries += shards_[i].map.size();
+		}
+		os << "Duplicate-read cache: " << hits << " of " << lookups << " reads";
+		if(lookups > 0) {
+			os << " (" << (100.0 * hits / lookups) << "%)";
+		}
+		os << " were duplicates; " << entries << " sequences cached, "
+		   << evictions << " evicted" << std::endl;
+	}
+
+private:
+
+	/**
+	 * Fill 'key' with the bases of 'r' and, if qualities matter, their
+	 * mismatch-penalty bins.
+	 */
+	void makeKey(const Read& r, std::string& key) const {
+		size_t len = seqan::length(r.patFw);
+		key.resize(quals_ ? 2 * len : len);
+		for(size_t i = 0; i < len; i++) {
+			key[i] = (char)(int)r.patFw[i];
+		}
+		if(quals_) {
+			for(size_t i = 0; i < len; i++) {
+				key[len + i] = (char)mmPenalty(maqRound_, phredCharToPhredQual(r.qual[i]));
+			}
+		}
+	}
+
+	/**
+	 * Return the shard responsible for 'key'.
+	 */
+	Shard& shard(const std::string& key) {
+		uint32_t h = 2166136261u; // FNV-1a
+		for(size_t i = 0; i < key.length(); i++) {
+			h = (h ^ (uint8_t)key[i]) * 16777619u;
+		}
+		return shards_[h % DUP_CACHE_SHARDS];
+	}
+
+	const size_t shardLim_; /// bytes each shard may use
+	const bool   quals_;    /// do qualities go in the key?
+	const bool   maqRound_; /// round them Maq-style first?
+	Shard        shards_[DUP_CACHE_SHARDS];
+};
+
+#endif /* DUP_CACHE_H_ */
@@ -1364,19 +1364,14 @@ public:
 		if(color) {
 			hit.colSeq = hit.patSeq;
 			hit.colQuals = hit.quals;
-			hit.crefcs.resize(qlen, 0);
-			// Turn the mmui32 and refcs arrays into the mm FixedBitset and
-			// the refc vector
+			// Turn the mmui32 and refcs arrays into the color edit list
 			for(size_t i = 0; i < numMms; i++) {
 				if (ebwtFw != _fw) {
 					// The 3' end is on the left but the mm vector encodes
 					// mismatches w/r/t the 5' end, so we flip
-					uint32_t off = qlen - mmui32[i] - 1;
-					hit.cmms.set(off);
-					hit.crefcs[off] = refcs[i];
+					hit.cmms.set(qlen - mmui32[i] - 1, refcs[i]);
 				} else {
-					hit.cmms.set(mmui32[i]);
-					hit.crefcs[i] = refcs[i];
+					hit.cmms.set(mmui32[i], refcs[i]);
 				}
 			}
 			assert(ref != NULL);
@@ -1395,6 +1390,7 @@ public:
 			size_t refi = 0;
 			size_t reff = readf + 1;
 			bool maqRound = false;
+			RandomSource rnd(seed);
 			for(size_t i = 0; i < qlen + 1; i++) {
 				if(i < qlen) {
 					read[i] = (int)hit.patSeq[i];
@@ -1417,6 +1413,7 @@ public:
 				refi, // offset of first character within 'ref' to consider
 				reff, // offset of last char (exclusive) in 'ref' to consider
 				snpPhred, // penalty incurred by a SNP
+				rnd, // breaks ties, the same way every time for this read
 				ns,  // decoded nucleotides are appended here
 				cmm, // where the color mismatches are in the string
 				nmm, // where nucleotide mismatches are in the string
@@ -1425,7 +1422,6 @@ public:
 			size_t nqlen = qlen + (colExEnds ? -1 : 1);
 			seqan::resize(hit.patSeq, nqlen);
 			seqan::resize(hit.quals, nqlen);
-			hit.refcs.resize(nqlen);
 			size_t lo = colExEnds ? 1 : 0;
 			size_t hi = colExEnds ? qlen : qlen+1;
 			size_t destpos = 0;
@@ -1466,8 +1462,7 @@ public:
 					uint32_t off = (uint32_t)i - (colExEnds? 1:0);
 					if(!_fw) off = (uint32_t)nqlen - off - 1;
 					assert_lt(off, nqlen);
-					hit.mms.set(off);
-					hit.refcs[off] = "ACGT"[ref->getBase(h.first, h.second+i)];
+					hit.mms.set(off, "ACGT"[ref->getBase(h.first, h.second+i)]);
 				}
 			}
 			if(colExEnds) {
@@ -1484,26 +1479,24 @@ public:
 				qlen++; mlen++;
 			}
 		} else {
-			// Turn the mmui32 and refcs arrays into the mm FixedBitset and
-			// the refc vector
-			hit.refcs.resize(qlen, 0);
+			// Turn the mmui32 and refcs arrays into the edit list
 			for(size_t i = 0; i < numMms; i++) {
 				if (ebwtFw != _fw) {
 					// The 3' end is on the left but the mm vector encodes
 					// mismatches w/r/t the 5' end, so we flip
-					uint32_t off = qlen - mmui32[i] - 1;
-					hit.mms.set(off);
-					hit.refcs[off] = refcs[i];
+					hit.mms.set(qlen - mmui32[i] - 1, refcs[i]);
 				} else {
-					hit.mms.set(mmui32[i]);
-					hit.refcs[mmui32[i]] = refcs[i];
+					hit.mms.set(mmui32[i], refcs[i]);
 				}
 			}
 		}
 		// Check the hit against the original text, if it's available
 		if(_texts.size() > 0) {
 			assert_lt(h.first, _texts.size());
-			FixedBitset<1024> diffs;
+			FixedBitset<1024> diffs, mms;
+			for(size_t i = 0; i < hit.mms.size(); i++) {
+				mms.set(hit.mms[i].pos);
+			}
 			// This type of check assumes that only mismatches are
 			// possible.  If indels are possible, then we either need
 			// the caller to provide information about indel locations,
@@ -1522,10 +1515,10 @@ public:
 					else     diffs.set(qlen - qoff - 1);
 				}
 			}
-			if(diffs != hit.mms) {
+			if(diffs != mms) {
 				// Oops, mismatches were not where we expected them;
 				// print a diagnostic message before asserting
-				cerr << "Expected " << hit.mms.str() << " mismatches, got " << diffs.str() << endl;
+				cerr << "Expected " << mms.str() << " mismatches, got " << diffs.str() << endl;
 				cerr << "  Pat:  " << hit.patSeq << endl;
 				cerr << "  Tseg: ";
 				for(size_t i = 0; i < qlen; i++) {
@@ -1540,7 +1533,7 @@ public:
 				cerr << "  FW: " << _fw << endl;
 				cerr << "  Ebwt FW: " << ebwtFw << endl;
 			}
-			if(diffs != hit.mms) assert(false);
+			if(diffs != mms) assert(false);
 		}
 		hit.h = h;
 		hit.patId = ((patid == 0xffffffff) ? _patid : patid);
@@ -2830,7 +2823,7 @@ inline bool Ebwt<TStr>::report(const String<Dna5>& query,
                                const EbwtSearchParams<TStr>& params) const
 {
 	VMSG_NL("In report");
-	assert_geq(cost, (uint32_t)(stratum << 14));
+	assert_geq(cost, (uint32_t)stratumCost(stratum));
 	assert_lt(off, this->_eh._len);
 	TIndexOffU tidx;
 	TIndexOffU textoff;
@@ -61,7 +61,7 @@ static void resetOptions() {
 	dcv          = 1024;  // bwise SA difference-cover sample sz
 	noDc         = 0;     // disable difference-cover sample
 	entireSA     = 0;     // 1 = disable blockwise SA
-	seed         = 0;     // srandom seed
+	seed         = 0;     // pseudo-random number generator seed
 	showVersion  = 0;     // just print version and quit?
 	doubleEbwt   = true;  // build forward and reverse Ebwts
 	//   Ebwt parameters
@@ -137,7 +137,7 @@ static void printUsage(ostream& out) {
 	    //<< "    --big --little          endianness (default: little, this host: "
 	    //<< (currentlyBigEndian()? "big":"little") << ")" << endl
 	    << "    --seed <int>            seed for random number generator" << endl
-	    //<< "    --new-reverse           concatenate then reverse stretches, not vice versa" << endl
+	    << "    --new-reverse           concatenate then reverse stretches, not vice versa" << endl
 	    << "    -q/--quiet              verbose output (for debugging)" << endl
 	    << "    -h/--help               print detailed description of tool and its options" << endl
 	    << "    --usage                 print this usage message" << endl
@@ -627,8 +627,6 @@ extern "C" {
 				cout << "  " << infiles[i] << endl;
 			}
 		}
-		// Seed random number generator
-		srand(seed);
 		{
 			Timer timer(cout, "Total time for call to driver() for forward index: ", verbose);
 			if(!packed) {
@@ -648,7 +646,6 @@ extern "C" {
 			}
 		}
 		if(doubleEbwt) {
-			srand(seed);
 			Timer timer(cout, "Total time for backward call to driver() for mirror index: ", verbose);
 			if(!packed) {
 				try {
@@ -10,11 +10,6 @@
 #include <vector>
 #include <time.h>
 
-#ifndef _WIN32
-#include <dirent.h>
-#include <signal.h>
-#endif
-
 #include "alphabet.h"
 #include "assert_helpers.h"
 #include "endian_swap.h"
@@ -27,7 +22,13 @@
 #include "bitset.h"
 #include "threading.h"
 #include "range_cache.h"
+#include "kmer_table.h"
+#include "insert_size.h"
+#include "dup_cache.h"
 #include "aligner.h"
+#include "progress.h"
+#include "worker_pool.h"
+#include "server.h"
 #include "aligner_0mm.h"
 #include "aligner_1mm.h"
 #include "aligner_23mm.h"
@@ -39,14 +40,6 @@
 #include <CHUD/CHUD.h>
 #endif
 
-static int FNAME_SIZE;
-#ifdef WITH_TBB
-#include <tbb/compat/thread>
-static tbb::atomic<int> thread_counter;
-#else
-static int thread_counter;
-static MUTEX_T thread_counter_mutex;
-#endif
 
 using namespace std;
 using namespace seqan;
@@ -61,7 +54,7 @@ bool quiet;        // print nothing but the alignments
 static int sanityCheck;   // enable expensive sanity checks
 static int format;        // default read format is FASTQ
 static string origString; // reference text, or filename(s)
-static int seed;          // srandom() seed
+static int seed;          // mixed into each read's pseudo-random seed
 static int timing;        // whether to report basic timing data
 static bool allHits;      // for multihits, report just one
 static bool rangeMode;    // report BWT ranges instead of ref locs
@@ -83,11 +76,18 @@ static int seedMms;       // # mismatches allowed in seed (maq's -n)
 static int qualThresh;    // max qual-weighted hamming dist (maq's -e)
 static int maxBtsBetter;  // max # backtracks allowed in half-and-half mode
 static int maxBts;        // max # backtracks allowed in half-and-half mode
+static float btSens;      // fraction of hits adaptive backtrack budgets keep; 0 = off
 static int nthreads;      // number of pthreads operating concurrently
 static bool reorder;      // reorder SAM output when running multi-threaded
 static int thread_ceiling;// maximum number of threads user wants bowtie to use
-static string thread_stealing_dir; // keep track of pids in this directory
+static string thread_stealing_dir; // directory holding shared CPU ledger
 static bool thread_stealing;// true iff thread stealing is in use
+static WorkerPool *workerPool; // runs the search threads
+static string serverSock; // serve jobs on this Unix socket
+// Not reset between jobs:
+static bool keepIndex = false;     // keep indexes loaded after a job (--server)
+static string keptIndexKey;        // indexKey() of the kept indexes
+static BitPairReference *keptRefs = NULL; // kept reference, if any
 static output_types outType;  // style of output
 static bool noRefNames;       // true -> print reference indexes; not names
 static string dumpAlBase;     // basename of same-format files to dump aligned reads to
@@ -98,7 +98,19 @@ static uint32_t mhits;  // don't report any hits if there are > mhits
 static bool better;     // true -> guarantee alignments from best possible stratum
 static bool strata;     // true -> don't stop at stratum boundaries
 static int partitionSz; // output a partitioning key in first field
+static bool sortOut;      // sort output records by reference coordinate
+static int sortMemMbs;    // max MB of output records to hold in memory for --sort
+static string sortTmpDir; // directory for --sort's temporary files
+static string shardDir;   // write output to per-reference-range files in this directory
+static int shardSz;       // # reference bases per output shard; 0 -> one per reference
+static int progressIval;  // seconds between progress reports; 0 -> no reports
+static string progressFile; // write progress reports here instead of stderr
 static int readsPerBatch; // # reads to read from input file at once
+static bool adaptBatch;   // size batches from input-lock contention and what's left
+static BatchSizer *batchSizer; // sizes read batches if adaptBatch; else NULL
+static bool prefixSort;   // search each batch's reads in order of their 3' k-mers
+static bool bidir;        // find -v alignments in one pass over both indexes
+static int prefixSortChars; // # 3' chars to order reads by; 0 = don't reorder
 static size_t outBatchSz; // # alignments to write to output file at once
 static bool noMaqRound; // true -> don't round quals to nearest 10 like maq
 static bool fileParallel; // separate threads read separate input files in parallel
@@ -109,6 +121,8 @@ static bool stateful;     // use stateful aligners
 static uint32_t prefetchWidth; // number of reads to process in parallel w/ --stateful
 static uint32_t minInsert;     // minimum insert size (Maq = 0, SOAP = 400)
 static uint32_t maxInsert;     // maximum insert size (Maq = 250, SOAP = 600)
+static uint32_t learnIns;      // # concordant pairs to learn insert-size window from; 0 = don't
+static InsertSizeEstimator *insEst; // learns insert-size window, shared by all threads
 static bool mate1fw;           // -1 mate aligns in fw orientation on fw strand
 static bool mate2fw;           // -2 mate aligns in rc orientation on fw strand
 static bool mateFwSet;         // true -> user set --ff/--fr/--rf
@@ -116,7 +130,14 @@ static uint32_t mixedThresh;   // threshold for when to switch to paired-end mix
 static uint32_t mixedAttemptLim; // number of attempts to make in "mixed mode" before giving up on orientation
 static bool dontReconcileMates;  // suppress pairwise all-versus-all way of resolving mates
 static uint32_t cacheLimit;      // ranges w/ size > limit will be cached
-static uint32_t cacheSize;       // # words per range cache
+static uint32_t cacheSize;       // # bytes per range cache
+static RangeCache *cacheFw;      // range cache for the forward index, shared by all threads
+static RangeCache *cacheBw;      // range cache for the mirror index, shared by all threads
+static uint32_t dupCacheSize;    // # bytes for duplicate-read cache; 0 = don't cache
+static uint32_t kmerTabSize;     // # bytes for k-mer tables; 0 = don't use them
+static int kmerLen;              // length of k-mers in k-mer tables
+static KmerTable *kmerFw;        // k-mer table for the forward index, shared by all threads
+static KmerTable *kmerBw;        // k-mer table for the mirror index, shared by all threads
 static int offBase;              // offsets are 0-based by default, but configurable
 static bool tryHard;             // set very high maxBts, mixedAttemptLim
 static uint32_t skipReads;       // # reads/read pairs to skip
@@ -167,7 +188,7 @@ static void resetOptions() {
 	sanityCheck				= 0;  // enable expensive sanity checks
 	format					= FASTQ; // default read format is FASTQ
 	origString				= ""; // reference text, or filename(s)
-	seed					= 0; // srandom() seed
+	seed					= 0; // global pseudo-random seed
 	timing					= 0; // whether to report basic timing data
 	allHits					= false; // for multihits, report just one
 	rangeMode				= false; // report BWT ranges instead of ref locs
@@ -189,12 +210,14 @@ static void resetOptions() {
 	qualThresh				= 70;  // max qual-weighted hamming dist (maq's -e)
 	maxBtsBetter			= 125; // max # backtracks allowed in half-and-half mode
 	maxBts					= 800; // max # backtracks allowed in half-and-half mode
+	btSens					= 0.0f; // fraction of hits adaptive backtrack budgets keep; 0 = off
 	nthreads				= 1;     // number of pthreads operating concurrently
     reorder                 = false; // reorder SAM output
 	thread_ceiling			= 0;     // max # threads user asked for
-	thread_stealing_dir		= ""; // keep track of pids in this directory
+	thread_stealing_dir		= ""; // directory holding shared CPU ledger
 	thread_stealing			= false; // true iff thread stealing is in use
-	FNAME_SIZE				= 200;
+	workerPool				= NULL;  // runs the search threads
+	serverSock				= "";    // serve jobs on this Unix socket
 	outType					= OUTPUT_FULL;  // style of output
 	noRefNames				= false; // true -> print reference indexes; not names
 	dumpAlBase				= "";    // basename of same-format files to dump aligned reads to
@@ -205,7 +228,19 @@ static void resetOptions() {
 	better					= false; // true -> guarantee alignments from best possible stratum
 	strata					= false; // true -> don't stop at stratum boundaries
 	partitionSz				= 0;     // output a partitioning key in first field
+	sortOut					= false; // sort output records by reference coordinate
+	sortMemMbs				= 768;   // max MB of output records to hold in memory for --sort
+	sortTmpDir				= "";    // directory for --sort's temporary files
+	shardDir				= "";    // write output to per-reference-range files in this directory
+	shardSz					= 0;     // # reference bases per output shard; 0 -> one per reference
+	progressIval			= 0;     // seconds between progress reports; 0 -> no reports
+	progressFile			= "";    // write progress reports here instead of stderr
 	readsPerBatch			= 16;    // # reads to read from input file at once
+	adaptBatch				= false; // size batches from input-lock contention and what's left
+	batchSizer				= NULL;  // sizes read batches if adaptBatch; else NULL
+	prefixSort				= false; // search each batch's reads in order of their 3' k-mers
+	bidir					= false; // find -v alignments in one pass over both indexes
+	prefixSortChars			= 0;     // # 3' chars to order reads by; 0 = don't reorder
 	outBatchSz				= 16;    // # alignments to wrote to output file at once
 	noMaqRound				= false; // true -> don't round quals to nearest 10 like maq
 	fileParallel			= false; // separate threads read separate input files in parallel
@@ -216,6 +251,8 @@ static void resetOptions() {
 	prefetchWidth			= 1;     // number of reads to process in parallel w/ --stateful
 	minInsert				= 0;     // minimum insert size (Maq = 0, SOAP = 400)
 	maxInsert				= 250;   // maximum insert size (Maq = 250, SOAP = 600)
+	learnIns				= 0;     // # concordant pairs to learn insert-size window from; 0 = don't
+	insEst					= NULL;
 	mate1fw					= true;  // -1 mate aligns in fw orientation on fw strand
 	mate2fw					= false; // -2 mate aligns in rc orientation on fw strand
 	mateFwSet				= false; // true -> user set mate1fw/mate2fw with --ff/--fr/--rf
@@ -223,7 +260,14 @@ static void resetOptions() {
 	mixedAttemptLim			= 100;   // number of attempts to make in "mixed mode" before giving up on orientation
 	dontReconcileMates		= true;  // suppress pairwise all-versus-all way of resolving mates
 	cacheLimit				= 5;     // ranges w/ size > limit will be cached
-	cacheSize				= 0;     // # words per range cache
+	cacheSize				= 0;     // # bytes per range cache (0 = off)
+	dupCacheSize			= 0;     // # bytes for duplicate-read cache; 0 = don't cache
+	kmerTabSize				= 0;     // # bytes for k-mer tables; 0 = don't use them
+	kmerLen					= 20;    // length of k-mers in k-mer tables
+	kmerFw					= NULL;
+	kmerBw					= NULL;
+	cacheFw					= NULL;
+	cacheBw					= NULL;
 	offBase					= 0;     // offsets are 0-based by default, but configurable
 	tryHard					= false; // set very high maxBts, mixedAttemptLim
 	skipReads				= 0;     // # reads/read pairs to skip
@@ -231,7 +275,7 @@ static void resetOptions() {
 	norc					= false; // don't align rc orientation of read
 	strandFix				= true;  // attempt to fix strand bias
 	stats					= false; // print performance stats
-	chunkPoolMegabytes		= 64;    // max MB to dedicate to best-first search frames per thread
+	chunkPoolMegabytes		= 512;   // max MB to dedicate to best-first search frames per thread
 	chunkSz					= 256;   // size of single chunk disbursed by ChunkPool (in KB)
 	chunkVerbose			= false; // have chunk allocator output status messages?
 	useV1					= true;
@@ -344,6 +388,22 @@ enum {
 	ARG_THREAD_CEILING,
 	ARG_THREAD_PIDDIR,
 	ARG_REORDER_SAM,
+	ARG_SORT,
+	ARG_SORT_MEM,
+	ARG_SORT_TMP,
+	ARG_SHARD_OUT,
+	ARG_SHARD_SIZE,
+	ARG_PROGRESS,
+	ARG_PROGRESS_FILE,
+	ARG_SERVER,
+	ARG_LEARN_INS,
+	ARG_DUP_CACHE,
+	ARG_PREFIX_SORT,
+	ARG_KMER_TAB,
+	ARG_KMER_LEN,
+	ARG_BIDIR,
+	ARG_BTSENS,
+	ARG_ADAPT_BATCH,
 };
 
 static struct option long_options[] = {
@@ -390,6 +450,7 @@ static struct option long_options[] = {
 {(char*)"refidx",                            no_argument,        0,                    ARG_REFIDX},
 {(char*)"range",                             no_argument,        0,                    ARG_RANGE},
 {(char*)"maxbts",                            required_argument,  0,                    ARG_MAXBTS},
+{(char*)"btsens",                            required_argument,  0,                    ARG_BTSENS},
 {(char*)"phased",                            no_argument,        0,                    'z'},
 {(char*)"partition",                         required_argument,  0,                    ARG_PARTITION},
 {(char*)"stateful",                          no_argument,        0,                    ARG_STATEFUL},
@@ -448,6 +509,21 @@ static struct option long_options[] = {
 {(char*)"thread-ceiling",required_argument,  0,                  ARG_THREAD_CEILING},
 {(char*)"thread-piddir",                     required_argument,  0,                    ARG_THREAD_PIDDIR},
 {(char*)"reorder",                           no_argument,        0,                    ARG_REORDER_SAM},
+{(char*)"sort",                              no_argument,        0,                    ARG_SORT},
+{(char*)"sort-mem",                          required_argument,  0,                    ARG_SORT_MEM},
+{(char*)"sort-tmp",                          required_argument,  0,                    ARG_SORT_TMP},
+{(char*)"shard-out",                         required_argument,  0,                    ARG_SHARD_OUT},
+{(char*)"shard-size",                        required_argument,  0,                    ARG_SHARD_SIZE},
+{(char*)"progress",                          required_argument,  0,                    ARG_PROGRESS},
+{(char*)"progress-file",                     required_argument,  0,                    ARG_PROGRESS_FILE},
+{(char*)"server",                            required_argument,  0,                    ARG_SERVER},
+{(char*)"learnins",                          required_argument,  0,                    ARG_LEARN_INS},
+{(char*)"dupcache",                          required_argument,  0,                    ARG_DUP_CACHE},
+{(char*)"prefix-sort",                       no_argument,        0,                    ARG_PREFIX_SORT},
+{(char*)"adapt-batch",                       no_argument,        0,                    ARG_ADAPT_BATCH},
+{(char*)"kmertab",                           required_argument,  0,                    ARG_KMER_TAB},
+{(char*)"kmerlen",                           required_argument,  0,                    ARG_KMER_LEN},
+{(char*)"bidir",                             no_argument,        0,                    ARG_BIDIR},
 {(char*)0,                                   0,                  0,                    0} //  terminator
 };
 
@@ -501,7 +577,7 @@ static void printUsage(ostream& out) {
 		out << "  --large-index      force usage of a 'large' index, even if a small one is present" << endl;
 		}
 		out << "Alignment:" << endl
-	    << "  -v <int>           report end-to-end hits w/ <=v mismatches; ignore qualities" << endl
+	    << "  -v <int>           report end-to-end hits w/ <=v mismatches (0-5); ignore quals" << endl
 	    << "    or" << endl
 	    << "  -n/--seedmms <int> max mismatches in seed (can be 0-3, default: -n 2)" << endl
 	    << "  -e/--maqerr <int>  max sum of mismatch quals across alignment for -n (def: 70)" << endl
@@ -510,12 +586,17 @@ static void printUsage(ostream& out) {
 	    << "  -I/--minins <int>  minimum insert size for paired-end alignment (default: 0)" << endl
 	    << "  -X/--maxins <int>  maximum insert size for paired-end alignment (default: 250)" << endl
 	    << "  --fr/--rf/--ff     -1, -2 mates align fw/rev, rev/fw, fw/fw (default: --fr)" << endl
+	    << "  --learnins <int>   learn insert sizes from first <int> pairs, look there first" << endl
 	    << "  --nofw/--norc      do not align to forward/reverse-complement reference strand" << endl
 	    << "  --maxbts <int>     max # backtracks for -n 2/3 (default: 125, 800 for --best)" << endl
+	    << "  --btsens <frac>    adapt --best/paired backtrack limits to keep <frac> of hits" << endl
 	    << "  --pairtries <int>  max # attempts to find mate for anchor hit (default: 100)" << endl
 	    << "  -y/--tryhard       try hard to find valid alignments, at the expense of speed" << endl
-	    << "  --chunkmbs <int>   max megabytes of RAM for best-first search frames (def: 64)" << endl
+	    << "  --chunkmbs <int>   max megabytes of RAM for best-first search frames (def: 512)" << endl
 	    << " --reads-per-batch   # of reads to read from input file at once (default: 16)" << endl
+	    << "  --adapt-batch      grow batches under input contention, shrink them at the end" << endl
+	    << "  --prefix-sort      search each batch's reads in order of 3' ends, sharing work" << endl
+	    << "  --bidir            find -v hits in one pass, using both index halves together" << endl
 	    << "Reporting:" << endl
 	    << "  -k <int>           report up to <int> good alignments per read (default: 1)" << endl
 	    << "  -a/--all           report all alignments per read (much slower than low -k)" << endl
@@ -534,6 +615,11 @@ static void printUsage(ostream& out) {
 	    << "  --max <fname>      write reads/pairs over -m limit to file(s) <fname>" << endl
 	    << "  --suppress <cols>  suppresses given columns (comma-delim'ed) in default output" << endl
 	    << "  --fullref          write entire ref name (default: only up to 1st space)" << endl
+	    << "  --sort             write alignments sorted by reference and offset" << endl
+	    << "  --sort-mem <int>   max megabytes of alignments in memory for --sort (def: 768)" << endl
+	    << "  --sort-tmp <dir>   directory for --sort temporary files (default: $TMPDIR)" << endl
+	    << "  --shard-out <dir>  write hits to one file per reference (range) in <dir>" << endl
+	    << "  --shard-size <int> # ref. bases per --shard-out file (def: whole reference)" << endl
 	    << "Colorspace:" << endl
 	    << "  --snpphred <int>   Phred penalty for SNP when decoding colorspace (def: 30)" << endl
 	    << "     or" << endl
@@ -550,13 +636,23 @@ static void printUsage(ostream& out) {
 	    << "Performance:" << endl
 	    << "  -o/--offrate <int> override offrate of index; must be >= index's offrate" << endl
 	    << "  -p/--threads <int> number of alignment threads to launch (default: 1)" << endl
+	    << "  --thread-ceiling <int> use up to <int> threads when CPUs are idle" << endl
+	    << "  --thread-piddir <dir> share CPUs with other bowtie jobs using <dir>" << endl
 #ifdef BOWTIE_MM
 	    << "  --mm               use memory-mapped I/O for index; many 'bowtie's can share" << endl
 #endif
 #ifdef BOWTIE_SHARED_MEM
 	    << "  --shmem            use shared mem for index; many 'bowtie's can share" << endl
 #endif
+	    << "  --cachesz <int>    MB of memory per index for caching wide ranges (def: 0, off)" << endl
+	    << "  --dupcache <int>   MB of memory for reusing alignments of repeated reads (def: 0)" << endl
+	    << "  --kmertab <int>    MB of memory per index for remembering k-mer ranges (def: 0)" << endl
+	    << "  --kmerlen <int>    length of k-mers remembered by --kmertab (def: 20)" << endl
 	    << "Other:" << endl
+	    << "  --progress <int>   report throughput as JSON every <int> seconds" << endl
+	    << "  --progress-file <f> write --progress reports to <f> instead of stderr" << endl
+	    << "  --server <sock>    keep index loaded and run jobs sent to Unix socket <sock>" << endl
+	    << "  --client <sock>    send this job to the --server listening on <sock>" << endl
 	    << "  --seed <int>       seed for random number generator" << endl
 	    << "  --verbose          verbose output (for debugging)" << endl
 	    << "  --version          print version information and quit" << endl
@@ -776,6 +872,9 @@ static void parseOptions(int argc, const char **argv) {
 			case 'x':
 				mixedThresh = (uint32_t)parseInt(0, "-x arg must be at least 0");
 				break;
+			case ARG_LEARN_INS:
+				learnIns = (uint32_t)parseInt(0, "--learnins arg must be at least 0");
+				break;
 			case ARG_MIXED_ATTEMPTS:
 				mixedAttemptLim = (uint32_t)parseInt(1, "--pairtries arg must be at least 1");
 				break;
@@ -783,9 +882,20 @@ static void parseOptions(int argc, const char **argv) {
 				cacheLimit = (uint32_t)parseInt(1, "--cachelim arg must be at least 1");
 				break;
 			case ARG_CACHE_SZ:
-				cacheSize = (uint32_t)parseInt(1, "--cachesz arg must be at least 1");
+				cacheSize = (uint32_t)parseInt(0, 4095, "--cachesz arg must be between 0 and 4095");
 				cacheSize *= (1024 * 1024); // convert from MB to B
 				break;
+			case ARG_DUP_CACHE:
+				dupCacheSize = (uint32_t)parseInt(0, 4095, "--dupcache arg must be between 0 and 4095");
+				dupCacheSize *= (1024 * 1024); // convert from MB to B
+				break;
+			case ARG_KMER_TAB:
+				kmerTabSize = (uint32_t)parseInt(0, 4095, "--kmertab arg must be between 0 and 4095");
+				kmerTabSize *= (1024 * 1024); // convert from MB to B
+				break;
+			case ARG_KMER_LEN:
+				kmerLen = parseInt(1, KMER_TABLE_MAX_LEN, "--kmerlen arg must be between 1 and 32");
+				break;
 			case ARG_NO_RECONCILE:
 				dontReconcileMates = true;
 				break;
@@ -801,12 +911,26 @@ static void parseOptions(int argc, const char **argv) {
 			case ARG_REORDER_SAM:
 				reorder = true;
 				break;
+			case ARG_SORT: sortOut = true; break;
+			case ARG_SORT_MEM:
+				sortMemMbs = parseInt(1, "--sort-mem arg must be at least 1");
+				break;
+			case ARG_SORT_TMP: sortTmpDir = optarg; break;
+			case ARG_SHARD_OUT: shardDir = optarg; break;
+			case ARG_PROGRESS:
+				progressIval = parseInt(1, "--progress arg must be at least 1");
+				break;
+			case ARG_PROGRESS_FILE: progressFile = optarg; break;
+			case ARG_SERVER: serverSock = optarg; break;
+			case ARG_SHARD_SIZE:
+				shardSz = parseInt(1, "--shard-size arg must be at least 1");
+				break;
 			case ARG_FILEPAR:
 				fileParallel = true;
 				break;
 			case 'v':
 				maqLike = 0;
-				mismatches = parseInt(0, 3, "-v arg must be at least 0 and at most 3");
+				mismatches = parseInt(0, SEARCH_SCHEME_MAX_MMS, "-v arg must be at least 0 and at most 5");
 				break;
 			case '3': trim3 = parseInt(0, "-3/--trim3 arg must be at least 0"); break;
 			case '5': trim5 = parseInt(0, "-5/--trim5 arg must be at least 0"); break;
@@ -852,6 +976,14 @@ static void parseOptions(int argc, const char **argv) {
 				maxBtsBetter = maxBts;
 				break;
 			}
+			case ARG_BTSENS: {
+				btSens = parse<float>(optarg);
+				if(btSens <= 0.0f || btSens > 1.0f) {
+					cerr << "Error: --btsens parameter must be > 0.0 and <= 1.0" << endl;
+					throw 1;
+				}
+				break;
+			}
 			case ARG_STRAND_FIX: strandFix = true; break;
 			case ARG_PARTITION: partitionSz = parse<int>(optarg); break;
 			case ARG_READS_PER_BATCH: {
@@ -864,6 +996,9 @@ static void parseOptions(int argc, const char **argv) {
 				readsPerBatch = outBatchSz = parse<int>(optarg);
 				break;
 			}
+			case ARG_PREFIX_SORT: prefixSort = true; break;
+			case ARG_ADAPT_BATCH: adaptBatch = true; break;
+			case ARG_BIDIR: bidir = true; break;
 			case ARG_ORIG:
 				if(optarg == NULL || strlen(optarg) == 0) {
 					cerr << "--orig arg must be followed by a string" << endl;
@@ -885,6 +1020,21 @@ static void parseOptions(int argc, const char **argv) {
 	if (nthreads == 1 && !thread_stealing) {
 		reorder = false;
 	}
+	if (sortOut) {
+		// Sorted output imposes its own order
+		reorder = false;
+	}
+	if (!shardDir.empty()) {
+		if (sortOut) {
+			cerr << "Error: --sort and --shard-out cannot be combined" << endl;
+			throw 1;
+		}
+		reorder = false;
+		if (shardSz == 0 && partitionSz != 0) {
+			// Shard along the same boundaries as the partition key
+			shardSz = abs(partitionSz);
+		}
+	}
 	if (reorder == true && outType != OUTPUT_SAM) {
 		cerr << "Bowtie will attempt to reorder its output only when outputting SAM." << endl
 			<< "Please specify the `-S` parameter if you intend on using this option." << endl;
@@ -902,6 +1052,22 @@ static void parseOptions(int argc, const char **argv) {
 		// Much faster than normal 3-mismatch mode
 		stateful = true;
 	}
+	if(!maqLike && mismatches > 3) {
+		// Only the search-scheme engine goes past 3 mismatches
+		bidir = true;
+	}
+	if(bidir && (maqLike || mismatches == 0)) {
+		if(!quiet) {
+			cerr << "Warning: --bidir only applies to -v 1 and up; ignoring" << endl;
+		}
+		bidir = false;
+	}
+	if(btSens > 0.0f && !maqLike) {
+		if(!quiet) {
+			cerr << "Warning: --btsens only applies to -n mode; ignoring" << endl;
+		}
+		btSens = 0.0f;
+	}
 	if(mates1.size() != mates2.size()) {
 		cerr << "Error: " << mates1.size() << " mate files/sequences were specified with -1, but " << mates2.size() << endl
 		     << "mate files/sequences were specified with -2.  The same number of mate files/" << endl
@@ -980,6 +1146,13 @@ static void parseOptions(int argc, const char **argv) {
 		cerr << "--strata has no effect unless combined with -m, -a, or -k N where N > 1" << endl;
 		throw 1;
 	}
+	if(learnIns > 0 && (allHits || khits > 1 || mhits != 0xffffffff)) {
+		// Narrowing the mate search could miss pairs these modes count
+		if(!quiet) {
+			cerr << "Warning: --learnins does not apply with -a, -k N where N > 1, -m or -M; ignoring" << endl;
+		}
+		learnIns = 0;
+	}
 	// If both -s and -u are used, we need to adjust qUpto accordingly
 	// since it uses patid to know if we've reached the -u limit (and
 	// patids are all shifted up by skipReads characters)
@@ -1013,16 +1186,12 @@ static void parseOptions(int argc, const char **argv) {
 #ifdef _WIN32
 	thread_stealing = false;
 #endif
-	if(thread_stealing && thread_stealing_dir.empty()) {
-		cerr << "When --thread-ceiling is specified, must also specify --thread-piddir" << endl;
-		throw 1;
-	}
 }
 
 static const char *argv0 = NULL;
 
 #define FINISH_READ(p) \
-	/* Don't do finishRead if the read isn't legit or if the read was skipped by the doneMask */ \
+	/* Don't do finishRead if the read isn't legit or if phase 1 already finished it */ \
 	if(get_read_ret.first) { \
 		sink->finishRead(*p, true, !skipped); \
 		get_read_ret.first = false; \
@@ -1037,6 +1206,7 @@ static const char *argv0 = NULL;
 	get_read_ret = p->nextReadPair(); \
 	if(p->rdid() >= qUpto) { \
 		get_read_ret = make_pair(false, true); \
+		p->stop(); \
 	} \
 	if(!get_read_ret.first) { \
 		if(get_read_ret.second) { \
@@ -1044,6 +1214,11 @@ static const char *argv0 = NULL;
 		} \
 		continue; \
 	} \
+	if(sink->replayDuplicate(*p)) { \
+		/* Reported as a copy of an earlier read */ \
+		get_read_ret.first = false; \
+		continue; \
+	} \
 	String<Dna5>& patFw  = p->bufa().patFw;  \
 	patFw.data_begin += 0; /* suppress "unused" compiler warning */ \
 	String<Dna5>& patRc  = p->bufa().patRc;  \
@@ -1081,7 +1256,7 @@ static const char *argv0 = NULL;
 static PatternSourcePerThreadFactory*
 createPatsrcFactory(PatternComposer& _patsrc, int tid, uint32_t max_buf) {
 	PatternSourcePerThreadFactory *patsrcFact;
-	patsrcFact = new PatternSourcePerThreadFactory(_patsrc, max_buf, skipReads, seed);
+	patsrcFact = new PatternSourcePerThreadFactory(_patsrc, max_buf, skipReads, seed, workerPool, tid, prefixSortChars, batchSizer);
 	assert(patsrcFact != NULL);
 	return patsrcFact;
 }
@@ -1121,101 +1296,108 @@ createSinkFactory(HitSink& _sink, size_t threadId) {
 	return sink;
 }
 
-void increment_thread_counter() {
-#ifdef WITH_TBB
-	thread_counter.fetch_and_increment();
-#else
-	ThreadSafe ts(&thread_counter_mutex);
-	thread_counter++;
-#endif
+/**
+ * Return a string that changes whenever an option that affects how the
+ * index or reference is loaded changes.  In --server mode, loaded
+ * indexes are reused only by jobs with the same key.
+ */
+static string indexKey() {
+	ostringstream ss;
+	ss << adjustedEbwtFileBase << '|' << color << '|' << offRate << '|'
+	   << isaRate << '|' << useMm << '|' << useShmem << '|' << mmSweep << '|'
+	   << noRefNames << '|' << sanityCheck;
+	return ss.str();
 }
 
-void decrement_thread_counter() {
-#ifdef WITH_TBB
-	thread_counter.fetch_and_decrement();
-#else
-	ThreadSafe ts(&thread_counter_mutex);
-	thread_counter--;
-#endif
+/**
+ * Load the reference sequence needed for colorspace decoding and
+ * mixed-mode pairing, or reuse the one kept from an earlier job.
+ */
+static BitPairReference* openRefs(vector<String<Dna5> >& os) {
+	if(keptRefs != NULL && keptIndexKey == indexKey()) {
+		return keptRefs;
+	}
+	Timer _t(cerr, "Time loading reference: ", timing);
+	BitPairReference *refs = new BitPairReference(adjustedEbwtFileBase, color, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
+	if(!refs->loaded()) throw 1;
+	if(keepIndex && os.empty()) {
+		if(keptRefs != NULL) delete keptRefs;
+		keptRefs = refs;
+	}
+	return refs;
 }
 
-#ifndef _WIN32
-void del_pid(const char* dirname,int pid) {
-	struct stat finfo;
-	char* fname = (char*) calloc(FNAME_SIZE,sizeof(char));
-	sprintf(fname,"%s/%d",dirname,pid);
-	if(stat( fname, &finfo) != 0) {
-		free(fname);
-		return;
-	}
-	unlink(fname);
-	free(fname);
-} 
-
-//from http://stackoverflow.com/questions/18100097/portable-way-to-check-if-directory-exists-windows-linux-c
-static void write_pid(const char* dirname,int pid) {
-	struct stat dinfo;
-	if(stat(dirname, &dinfo) != 0) {
-		mkdir(dirname,0755);
-	}
-	char* fname = (char*) calloc(FNAME_SIZE,sizeof(char));
-	sprintf(fname,"%s/%d",dirname,pid);
-	FILE* f = fopen(fname,"w");
-	fclose(f);
-	free(fname);
+/**
+ * Free a reference obtained from openRefs() unless it's being kept.
+ */
+static void closeRefs(BitPairReference *refs) {
+	if(refs != NULL && refs != keptRefs) delete refs;
 }
 
-//from  http://stackoverflow.com/questions/612097/how-can-i-get-the-list-of-files-in-a-directory-using-c-or-c
-static int read_dir(const char* dirname,int* num_pids) {
-	DIR *dir;
-	struct dirent *ent;
-	char* fname = (char*) calloc(FNAME_SIZE,sizeof(char));
-	int lowest_pid = -1;
-	if ((dir = opendir (dirname)) != NULL) {
-		while ((ent = readdir (dir)) != NULL) {
-			if(ent->d_name[0] == '.')
-				continue;
-			int pid = atoi(ent->d_name);
-			sprintf(fname,"/proc/%s", ent->d_name);
-			if(kill(pid, 0) != 0) {
-				//deleting pids can lead to race conditions if
-				//2 or more BT2 processes both try to delete
-				//so just skip instead
-				//del_pid(dirname,pid);
-				continue;
-			}
-			(*num_pids)++;
-			if(pid < lowest_pid || lowest_pid == -1)
-				lowest_pid = pid;
-		}
-		closedir (dir);
-	} else {
-		perror (""); // could not open directory
-	}
-	free(fname);
-	return lowest_pid;
+/**
+ * Report how well a range cache did, if it was in use and timing
+ * output was requested.
+ */
+static void printCacheStats(const RangeCache& cache, const char *which) {
+	if(!timing || !cache.enabled()) return;
+	cerr << "Range cache (" << which << " index): " << cache.hits() << " hits, "
+	     << cache.misses() << " misses, " << cache.evictions() << " evictions" << endl;
 }
 
-static bool steal_thread(int pid, int orig_nthreads) {
-	int ncpu = thread_ceiling;
-	if(thread_ceiling <= nthreads) {
-		return false;
+static void printKmerStats(const KmerTable& kmers, const char *which) {
+	if(!timing || !kmers.enabled()) return;
+	cerr << "K-mer table (" << which << " index): " << kmers.hits() << " hits, "
+	     << kmers.misses() << " misses" << endl;
+}
+
+/// Most best-first chunk memory any one read has needed in this search
+static uint64_t chunkPeakBytes = 0;
+
+/**
+ * Note how much chunk memory a search thread's busiest read needed,
+ * then delete the thread's ChunkPool.
+ */
+static void retireChunkPool(ChunkPool *pool) {
+	{
+		ThreadSafe _ts(&gLock);
+		chunkPeakBytes = max(chunkPeakBytes, pool->peakBytes());
 	}
-	int num_pids = 0;
-	int lowest_pid = read_dir(thread_stealing_dir.c_str(), &num_pids);
-	if(lowest_pid != pid) {
-		return false;
+	delete pool;
+}
+
+/**
+ * Report the most chunk memory any one read needed, if best-first
+ * search was used and timing output was requested.
+ */
+static void printChunkStats() {
+	if(timing && chunkPeakBytes > 0) {
+		cerr << "Peak best-first chunk memory for one read: "
+		     << (chunkPeakBytes + 1023) / 1024 << " KB" << endl;
 	}
-	int in_use = ((num_pids-1) * orig_nthreads) + nthreads; //in_use is now baseline + ours
-	float spare = ncpu - in_use;
-	int spare_r = floor(spare);
-	float r = rand() % 100/100.0;
-	if(r <= (spare - spare_r)) {
-		spare_r = ceil(spare);
+	chunkPeakBytes = 0;
+}
+
+/**
+ * If this is a paired-end search and --learnins is set, start learning
+ * the insert-size window.
+ */
+static void startInsertEstimate(bool pair) {
+	assert(insEst == NULL);
+	if(pair && learnIns > 0 && minInsert <= maxInsert) {
+		insEst = new InsertSizeEstimator(learnIns, minInsert, maxInsert);
 	}
-	return spare_r > 0;
 }
-#endif
+
+/**
+ * Report the learned insert-size distribution, unless --quiet, and
+ * stop learning.
+ */
+static void finishInsertEstimate() {
+	if(insEst == NULL) return;
+	if(!quiet) insEst->printStats(cerr);
+	delete insEst;
+	insEst = NULL;
+}
 
 /**
  * Search through a single (forward) Ebwt index for exact end-to-end
@@ -1226,18 +1408,8 @@ static HitSink*               exactSearch_sink;
 static Ebwt<String<Dna> >*    exactSearch_ebwt;
 static vector<String<Dna5> >* exactSearch_os;
 static BitPairReference*      exactSearch_refs;
-#ifdef WITH_TBB
-//void exactSearchWorker::operator()() const {
-static void exactSearchWorker(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void exactSearchWorker(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer& _patsrc = *exactSearch_patsrc;
 	HitSink& _sink               = *exactSearch_sink;
 	Ebwt<String<Dna> >& ebwt     = *exactSearch_ebwt;
@@ -1267,6 +1439,9 @@ static void exactSearchWorker(void *vp) {
 	        verbose,        // verbose
 	        &os,
 	        false);         // considerQuals
+	bt.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bt.setSharePaths(prefixSortChars > 0);
+	bt.setKmerTables(kmerFw, kmerBw);
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 	bool skipped = false;
 #ifdef PER_THREAD_TIMING
@@ -1301,9 +1476,6 @@ static void exactSearchWorker(void *vp) {
 			#include "search_exact.c"
 		}
 		FINISH_READ(patsrc);
-		if(thread_stealing) {
-			decrement_thread_counter();
-		}
 #ifdef PER_THREAD_TIMING
 		ss.str("");
 		ss.clear();
@@ -1311,9 +1483,6 @@ static void exactSearchWorker(void *vp) {
 		   << "thread: " << tid << " node_changeovers: " << nnuma_changeovers << std::endl;
 		std::cout << ss.str();
 	}
-#endif
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
 #endif
 	WORKER_EXIT();
 }
@@ -1321,18 +1490,8 @@ static void exactSearchWorker(void *vp) {
 /**
  * A statefulness-aware worker driver.  Uses UnpairedExactAlignerV1.
  */
-#ifdef WITH_TBB
-//void exactSearchWorkerStateful::operator()() const {
-static void exactSearchWorkerStateful(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void exactSearchWorkerStateful(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer& _patsrc = *exactSearch_patsrc;
 	HitSink& _sink               = *exactSearch_sink;
 	Ebwt<String<Dna> >& ebwt     = *exactSearch_ebwt;
@@ -1351,8 +1510,8 @@ static void exactSearchWorkerStateful(void *vp) {
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -1377,12 +1536,13 @@ static void exactSearchWorkerStateful(void *vp) {
 			mate2fw,
 			minInsert,
 			maxInsert,
+			insEst,
 			dontReconcileMates,
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -1406,16 +1566,10 @@ static void exactSearchWorkerStateful(void *vp) {
 		// MultiAligner must be destroyed before patsrcFact
 	}
 
-	if(thread_stealing) {
-		decrement_thread_counter();
-	}
 
 	delete patsrcFact;
 	delete sinkFact;
-	delete pool;
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
-#endif
+	retireChunkPool(pool);
 	return;
 }
 
@@ -1446,147 +1600,39 @@ static void exactSearch(PatternComposer& _patsrc,
 	exactSearch_ebwt   = &ebwt;
 	exactSearch_os     = &os;
 
-	assert(!ebwt.isInMemory());
-	{
+	if(!ebwt.isInMemory()) {
 		// Load the rest of (vast majority of) the backward Ebwt into
 		// memory
 		Timer _t(cerr, "Time loading forward index: ", timing);
 		ebwt.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
 
+	// Create range cache, which is shared among all aligners
+	RangeCache rcFw(cacheSize, &ebwt);
+	cacheFw = &rcFw;
+	cacheBw = NULL;
+	KmerTable ktFw(kmerTabSize, kmerLen);
+	kmerFw = &ktFw;
+	kmerBw = NULL;
 	BitPairReference *refs = NULL;
 	bool pair = mates1.size() > 0 || mates12.size() > 0;
 	if(color || (pair && mixedThresh < 0xffffffff)) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, color, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
+		refs = openRefs(os);
 	}
+	startInsertEstimate(pair);
 	exactSearch_refs   = refs;
-	int tids[max(nthreads, thread_ceiling)];
-#ifdef WITH_TBB
-	vector<std::thread*> threads;
-	vector<thread_tracking_pair> tps;
-	tps.reserve(max(nthreads, thread_ceiling));
-#else
-	vector<tthread::thread*> threads;
-#endif
-
-#ifdef WITH_TBB
-	tbb::atomic<int> all_threads_done;
-	all_threads_done = 0;
-#endif
 	CHUD_START();
 	{
 		Timer _t(cerr, "Time for 0-mismatch search: ", timing);
-
-#ifndef _WIN32
-		int pid = 0;
-		if(thread_stealing) {
-			pid = getpid();
-			write_pid(thread_stealing_dir.c_str(), pid);
-			thread_counter = 0;
-		}
-#endif
-		
-		for(int i = 0; i < nthreads; i++) {
-			tids[i] = i;
-#ifdef WITH_TBB
-			tps[i].tid = i;
-			tps[i].done = &all_threads_done;
-			if (i == nthreads - 1) {
-				if(stateful) {
-					exactSearchWorkerStateful((void*)&tps[i]);
-				} else {
-					exactSearchWorker((void*)&tps[i]);
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new std::thread(exactSearchWorkerStateful, (void*)&tps[i]));
-				} else {
-					threads.push_back(new std::thread(exactSearchWorker, (void*)&tps[i]));
-				}
-				threads[i]->detach();
-				SLEEP(10);
-			}
-#else
-			if (i == nthreads - 1) {
-				if(stateful) {
-					exactSearchWorkerStateful((void*)(tids + i));
-				} else {
-					exactSearchWorker((void*)(tids + i));
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new tthread::thread(exactSearchWorkerStateful, (void *)(tids + i)));
-				} else {
-					threads.push_back(new tthread::thread(exactSearchWorker, (void *)(tids + i)));
-				}
-			}
-#endif
-		}
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			int orig_threads = nthreads, steal_ctr = 1;
-			for(int j = 0; j < 10; j++) {
-				sleep(1);
-			}
-			while(thread_counter > 0) {
-				if(steal_thread(pid, orig_threads)) { 
-					nthreads++;
-					tids[nthreads-1] = nthreads;
-#ifdef WITH_TBB
-					tps[nthreads-1].tid = nthreads - 1;
-					tps[nthreads-1].done = &all_threads_done;
-					if(stateful) {
-						threads.push_back(new std::thread(exactSearchWorkerStateful, (void*)&tps[nthreads-1]));
-					} else {
-						threads.push_back(new std::thread(exactSearchWorker, (void*)&tps[nthreads-1]));
-					}
-					threads[nthreads-1]->detach();
-					SLEEP(10);
-#else
-					if(stateful) {
-						threads.push_back(new tthread::thread(exactSearchWorkerStateful, (void *)(tids + nthreads - 1)));
-					} else {
-						threads.push_back(new tthread::thread(exactSearchWorker, (void *)(tids + nthreads - 1)));
-					}
-#endif
-					cerr << "pid " << pid << " started new worker # " << nthreads << endl;
-				}
-				steal_ctr++;
-				for(int j = 0; j < 10; j++) {
-					sleep(1);
-				}
-			}
-		}
-#endif
-		
-#ifdef WITH_TBB
-		while(all_threads_done < nthreads) {
-			SLEEP(10);
-		}
-#else
-		for (int i = 0; i < nthreads - 1; i++) {
-			threads[i]->join();
-		}
-#endif
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			del_pid(thread_stealing_dir.c_str(), pid);
-		}
-#endif
-	}
-	if(refs != NULL) delete refs;
-
-	for (int i = 0; i < nthreads - 1; i++) {
-		if (threads[i] != NULL) {
-			delete threads[i];
-		}
-	}
+		workerPool->run(stateful ? exactSearchWorkerStateful : exactSearchWorker);
+	}
+	printCacheStats(rcFw, "forward");
+	printKmerStats(ktFw, "forward");
+	printChunkStats();
+	finishInsertEstimate();
+	cacheFw = NULL;
+	kmerFw = NULL;
+	closeRefs(refs);
 }
 
 /**
@@ -1603,25 +1649,13 @@ static HitSink*                       mismatchSearch_sink;
 static Ebwt<String<Dna> >*            mismatchSearch_ebwtFw;
 static Ebwt<String<Dna> >*            mismatchSearch_ebwtBw;
 static vector<String<Dna5> >*         mismatchSearch_os;
-static SyncBitset*                    mismatchSearch_doneMask;
-static SyncBitset*                    mismatchSearch_hitMask;
 static BitPairReference*              mismatchSearch_refs;
 
 /**
  * A statefulness-aware worker driver.  Uses Unpaired/Paired1mmAlignerV1.
  */
-#ifdef WITH_TBB
-//void mismatchSearchWorkerFullStateful::operator()() const {
-static void mismatchSearchWorkerFullStateful(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void mismatchSearchWorkerFullStateful(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&   _patsrc = *mismatchSearch_patsrc;
 	HitSink&               _sink   = *mismatchSearch_sink;
 	Ebwt<String<Dna> >&    ebwtFw  = *mismatchSearch_ebwtFw;
@@ -1641,8 +1675,8 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -1667,12 +1701,13 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 			mate2fw,
 			minInsert,
 			maxInsert,
+			insEst,
 			dontReconcileMates,
 			mhits,     // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -1696,30 +1731,14 @@ static void mismatchSearchWorkerFullStateful(void *vp) {
 		// MultiAligner must be destroyed before patsrcFact
 	}
 
-	if(thread_stealing) {
-		decrement_thread_counter();
-	}
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
-#endif
 
 	delete patsrcFact;
 	delete sinkFact;
-	delete pool;
+	retireChunkPool(pool);
 	return;
 }
-#ifdef WITH_TBB
-//void mismatchSearchWorkerFull::operator()() const {
-static void mismatchSearchWorkerFull(void *vp){
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
-static void mismatchSearchWorkerFull(void *vp){
+static void mismatchSearchWorkerFull(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&   _patsrc   = *mismatchSearch_patsrc;
 	HitSink&               _sink     = *mismatchSearch_sink;
 	Ebwt<String<Dna> >&    ebwtFw    = *mismatchSearch_ebwtFw;
@@ -1750,6 +1769,9 @@ static void mismatchSearchWorkerFull(void *vp){
 	        verbose,        // verbose
 	        &os,
 	        false);         // considerQuals
+	bt.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bt.setSharePaths(prefixSortChars > 0);
+	bt.setKmerTables(kmerFw, kmerBw);
 	bool skipped = false;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 #ifdef PER_THREAD_TIMING
@@ -1785,10 +1807,8 @@ static void mismatchSearchWorkerFull(void *vp){
 			uint32_t s = plen;
 			uint32_t s3 = s >> 1; // length of 3' half of seed
 			uint32_t s5 = (s >> 1) + (s & 1); // length of 5' half of seed
-			#define DONEMASK_SET(p)
 			#include "search_1mm_phase1.c"
 			#include "search_1mm_phase2.c"
-			#undef DONEMASK_SET
 		} // End read loop
 		FINISH_READ(patsrc);
 #ifdef PER_THREAD_TIMING
@@ -1798,9 +1818,6 @@ static void mismatchSearchWorkerFull(void *vp){
 		   << "thread: " << tid << " node_changeovers: " << nnuma_changeovers << std::endl;
 		std::cout << ss.str();
 	}
-#endif
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
 #endif
     	WORKER_EXIT();
 }
@@ -1819,184 +1836,47 @@ static void mismatchSearchFull(PatternComposer& _patsrc,
 	mismatchSearch_sink         = &_sink;
 	mismatchSearch_ebwtFw       = &ebwtFw;
 	mismatchSearch_ebwtBw       = &ebwtBw;
-	mismatchSearch_doneMask     = NULL;
-	mismatchSearch_hitMask      = NULL;
 	mismatchSearch_os           = &os;
 
-	assert(!ebwtFw.isInMemory());
-	assert(!ebwtBw.isInMemory());
-	{
+	if(!ebwtFw.isInMemory()) {
 		// Load the other half of the index into memory
 		Timer _t(cerr, "Time loading forward index: ", timing);
 		ebwtFw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
-	{
+	if(!ebwtBw.isInMemory()) {
 		// Load the other half of the index into memory
 		Timer _t(cerr, "Time loading mirror index: ", timing);
 		ebwtBw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
 	// Create range caches, which are shared among all aligners
+	RangeCache rcFw(cacheSize, &ebwtFw), rcBw(cacheSize, &ebwtBw);
+	cacheFw = &rcFw;
+	cacheBw = &rcBw;
+	KmerTable ktFw(kmerTabSize, kmerLen), ktBw(kmerTabSize, kmerLen);
+	kmerFw = &ktFw;
+	kmerBw = &ktBw;
 	BitPairReference *refs = NULL;
 	bool pair = mates1.size() > 0 || mates12.size() > 0;
 	if(color || (pair && mixedThresh < 0xffffffff)) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, color, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
+		refs = openRefs(os);
 	}
+	startInsertEstimate(pair);
 	mismatchSearch_refs = refs;
 
-	int tids[max(nthreads, thread_ceiling)];
-#ifdef WITH_TBB
-	vector<std::thread*> threads;
-	vector<thread_tracking_pair> tps;
-	tps.reserve(max(nthreads, thread_ceiling));
-#else
-	vector<tthread::thread*> threads;
-#endif
-
-#ifdef WITH_TBB
-	tbb::atomic<int> all_threads_done;
-	all_threads_done = 0;
-#endif
-
 	CHUD_START();
 	{
 		Timer _t(cerr, "Time for 1-mismatch full-index search: ", timing);
-
-#ifndef _WIN32
-		int pid = 0;
-		if(thread_stealing) {
-			pid = getpid();
-			write_pid(thread_stealing_dir.c_str(), pid);
-			thread_counter = 0;
-		}
-#endif
-
-		for(int i = 0; i < nthreads; i++) {
-			tids[i] = i;
-#ifdef WITH_TBB
-			tps[i].tid = i;
-			tps[i].done = &all_threads_done;
-			if (i == nthreads - 1) {
-				if(stateful) {
-					mismatchSearchWorkerFullStateful((void*)&tps[i]);
-				} else {
-					mismatchSearchWorkerFull((void*)&tps[i]);
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new std::thread(mismatchSearchWorkerFullStateful, (void*)&tps[i]));
-				} else {
-					threads.push_back(new std::thread(mismatchSearchWorkerFull, (void*)&tps[i]));
-				}
-				threads[i]->detach();
-				SLEEP(10);
-			}
-#else
-			if (i == nthreads - 1) {
-				if(stateful) {
-					mismatchSearchWorkerFullStateful((void*)(tids + i));
-				} else {
-					mismatchSearchWorkerFull((void*)(tids + i));
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new tthread::thread(mismatchSearchWorkerFullStateful, (void *)(tids + i)));
-				} else {
-					threads.push_back(new tthread::thread(mismatchSearchWorkerFull, (void *)(tids + i)));
-				}
-			}
-#endif
-		}
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			int orig_threads = nthreads, steal_ctr = 1;
-			for(int j = 0; j < 10; j++) {
-				sleep(1);
-			}
-			while(thread_counter > 0) {
-				if(steal_thread(pid, orig_threads)) {
-					nthreads++;
-					tids[nthreads-1] = nthreads;
-#ifdef WITH_TBB
-					tps[nthreads-1].tid = nthreads - 1;
-					tps[nthreads-1].done = &all_threads_done;
-					if(stateful) {
-						threads.push_back(new std::thread(mismatchSearchWorkerFullStateful, (void*)&tps[nthreads-1]));
-					} else {
-						threads.push_back(new std::thread(mismatchSearchWorkerFull, (void*)&tps[nthreads-1]));
-					}
-					threads[nthreads - 1]->detach();
-					SLEEP(10);
-#else
-					if(stateful) {
-						threads.push_back(new tthread::thread(mismatchSearchWorkerFullStateful, (void *)(tids + nthreads - 1)));
-					} else {
-						threads.push_back(new tthread::thread(mismatchSearchWorkerFull, (void *)(tids + nthreads - 1)));
-					}
-#endif
-					cerr << "pid " << pid << " started new worker # " << nthreads << endl;
-				}
-				steal_ctr++;
-				for(int j = 0; j < 10; j++) {
-					sleep(1);
-				}
-			}
-		}
-#endif
-		
-#ifdef WITH_TBB
-		while(all_threads_done < nthreads) {
-			SLEEP(10);
-		}
-#else
-		for (int i = 0; i < nthreads - 1; i++) {
-			threads[i]->join();
-		}
-#endif
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			del_pid(thread_stealing_dir.c_str(), pid);
-		}
-#endif
-	}
-	if(refs != NULL) delete refs;
-
-	for (int i = 0; i < nthreads - 1; i++) {
-		if (threads[i] != NULL) {
-			delete threads[i];
-		}
-	}
-}
-
-#define SWITCH_TO_FW_INDEX() { \
-	/* Evict the mirror index from memory if necessary */ \
-	if(ebwtBw.isInMemory()) ebwtBw.evictFromMemory(); \
-	assert(!ebwtBw.isInMemory()); \
-	/* Load the forward index into memory if necessary */ \
-	if(!ebwtFw.isInMemory()) { \
-		Timer _t(cerr, "Time loading forward index: ", timing); \
-		ebwtFw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose); \
-	} \
-	assert(ebwtFw.isInMemory()); \
-	_patsrc.reset(); /* rewind pattern source to first pattern */ \
-}
-
-#define SWITCH_TO_BW_INDEX() { \
-	/* Evict the forward index from memory if necessary */ \
-	if(ebwtFw.isInMemory()) ebwtFw.evictFromMemory(); \
-	assert(!ebwtFw.isInMemory()); \
-	/* Load the forward index into memory if necessary */ \
-	if(!ebwtBw.isInMemory()) { \
-		Timer _t(cerr, "Time loading mirror index: ", timing); \
-		ebwtBw.loadIntoMemory(color ? 1 : 0, !noRefNames, startVerbose); \
-	} \
-	assert(ebwtBw.isInMemory()); \
-	_patsrc.reset(); /* rewind pattern source to first pattern */ \
+		workerPool->run(stateful ? mismatchSearchWorkerFullStateful : mismatchSearchWorkerFull);
+	}
+	printCacheStats(rcFw, "forward");
+	printCacheStats(rcBw, "mirror");
+	printKmerStats(ktFw, "forward");
+	printKmerStats(ktBw, "mirror");
+	printChunkStats();
+	finishInsertEstimate();
+	cacheFw = cacheBw = NULL;
+	kmerFw = kmerBw = NULL;
+	closeRefs(refs);
 }
 
 #define ASSERT_NO_HITS_FW(ebwtfw) \
@@ -2050,8 +1930,6 @@ static HitSink*                       twoOrThreeMismatchSearch_sink;
 static Ebwt<String<Dna> >*            twoOrThreeMismatchSearch_ebwtFw;
 static Ebwt<String<Dna> >*            twoOrThreeMismatchSearch_ebwtBw;
 static vector<String<Dna5> >*         twoOrThreeMismatchSearch_os;
-static SyncBitset*                    twoOrThreeMismatchSearch_doneMask;
-static SyncBitset*                    twoOrThreeMismatchSearch_hitMask;
 static bool                           twoOrThreeMismatchSearch_two;
 static BitPairReference*              twoOrThreeMismatchSearch_refs;
 
@@ -2059,18 +1937,8 @@ static BitPairReference*              twoOrThreeMismatchSearch_refs;
 /**
  * A statefulness-aware worker driver.  Uses UnpairedExactAlignerV1.
  */
-#ifdef WITH_TBB
-//void twoOrThreeMismatchSearchWorkerStateful::operator()() const {
-static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&   _patsrc = *twoOrThreeMismatchSearch_patsrc;
 	HitSink&               _sink   = *twoOrThreeMismatchSearch_sink;
 	Ebwt<String<Dna> >&    ebwtFw  = *twoOrThreeMismatchSearch_ebwtFw;
@@ -2092,8 +1960,8 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 			!norc,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -2119,12 +1987,13 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 			mate2fw,
 			minInsert,
 			maxInsert,
+			insEst,
 			dontReconcileMates,
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs, os,
@@ -2148,31 +2017,15 @@ static void twoOrThreeMismatchSearchWorkerStateful(void *vp) {
 		// MultiAligner must be destroyed before patsrcFact
 	}
 
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
-#endif
-	if(thread_stealing) {
-		decrement_thread_counter();
-	}
 
 	delete patsrcFact;
 	delete sinkFact;
-	delete pool;
+	retireChunkPool(pool);
 	return;
 }
 
-#ifdef WITH_TBB
-//void twoOrThreeMismatchSearchWorkerFull::operator()() const {
-static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&           _patsrc  = *twoOrThreeMismatchSearch_patsrc;
 	HitSink&                       _sink    = *twoOrThreeMismatchSearch_sink;
 	vector<String<Dna5> >&         os       = *twoOrThreeMismatchSearch_os;
@@ -2247,6 +2100,18 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 	        &os,
 	        false,          // considerQuals
 	        true);          // halfAndHalf
+	btr1.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btr1.setSharePaths(prefixSortChars > 0);
+	btr1.setKmerTables(kmerFw, kmerBw);
+	bt2.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bt2.setSharePaths(prefixSortChars > 0);
+	bt2.setKmerTables(kmerFw, kmerBw);
+	bt3.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bt3.setSharePaths(prefixSortChars > 0);
+	bt3.setKmerTables(kmerFw, kmerBw);
+	bthh3.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bthh3.setSharePaths(prefixSortChars > 0);
+	bthh3.setKmerTables(kmerFw, kmerBw);
 	bool skipped = false;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
 #ifdef PER_THREAD_TIMING
@@ -2283,16 +2148,11 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 			uint32_t s = plen;
 			uint32_t s3 = s >> 1; // length of 3' half of seed
 			uint32_t s5 = (s >> 1) + (s & 1); // length of 5' half of seed
-			#define DONEMASK_SET(p)
 			#include "search_23mm_phase1.c"
 			#include "search_23mm_phase2.c"
 			#include "search_23mm_phase3.c"
-			#undef DONEMASK_SET
 		}
 		FINISH_READ(patsrc);
-		if(thread_stealing) {
-			decrement_thread_counter();
-		}
 #ifdef PER_THREAD_TIMING
 		ss.str("");
 		ss.clear();
@@ -2300,9 +2160,6 @@ static void twoOrThreeMismatchSearchWorkerFull(void *vp) {
 		   << "thread: " << tid << " node_changeovers: " << nnuma_changeovers << std::endl;
 		std::cout << ss.str();
 	}
-#endif
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
 #endif
 	// Threads join at end of Phase 1
 	WORKER_EXIT();
@@ -2318,163 +2175,180 @@ static void twoOrThreeMismatchSearchFull(
 		bool two = true)                /// true -> 2, false -> 3
 {
 	// Global initialization
-	assert(!ebwtFw.isInMemory());
-	assert(!ebwtBw.isInMemory());
-	{
+	if(!ebwtFw.isInMemory()) {
 		// Load the other half of the index into memory
 		Timer _t(cerr, "Time loading forward index: ", timing);
 		ebwtFw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
-	{
+	if(!ebwtBw.isInMemory()) {
 		// Load the other half of the index into memory
 		Timer _t(cerr, "Time loading mirror index: ", timing);
 		ebwtBw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
 	// Create range caches, which are shared among all aligners
+	RangeCache rcFw(cacheSize, &ebwtFw), rcBw(cacheSize, &ebwtBw);
+	cacheFw = &rcFw;
+	cacheBw = &rcBw;
+	KmerTable ktFw(kmerTabSize, kmerLen), ktBw(kmerTabSize, kmerLen);
+	kmerFw = &ktFw;
+	kmerBw = &ktBw;
 	BitPairReference *refs = NULL;
 	bool pair = mates1.size() > 0 || mates12.size() > 0;
 	if(color || (pair && mixedThresh < 0xffffffff)) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, color, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
+		refs = openRefs(os);
 	}
+	startInsertEstimate(pair);
 	twoOrThreeMismatchSearch_refs     = refs;
 	twoOrThreeMismatchSearch_patsrc   = &_patsrc;
 	twoOrThreeMismatchSearch_sink     = &_sink;
 	twoOrThreeMismatchSearch_ebwtFw   = &ebwtFw;
 	twoOrThreeMismatchSearch_ebwtBw   = &ebwtBw;
 	twoOrThreeMismatchSearch_os       = &os;
-	twoOrThreeMismatchSearch_doneMask = NULL;
-	twoOrThreeMismatchSearch_hitMask  = NULL;
 	twoOrThreeMismatchSearch_two      = two;
 
-	int tids[max(nthreads, thread_ceiling)];
-#ifdef WITH_TBB
-	vector<std::thread*> threads;
-	vector<thread_tracking_pair> tps;
-	tps.reserve(max(nthreads, thread_ceiling));
-#else
-	vector<tthread::thread*> threads;
-#endif
-
-#ifdef WITH_TBB
-	tbb::atomic<int> all_threads_done;
-	all_threads_done = 0;
-#endif
-
 	CHUD_START();
 	{
 		Timer _t(cerr, "End-to-end 2/3-mismatch full-index search: ", timing);
+		workerPool->run(stateful ? twoOrThreeMismatchSearchWorkerStateful : twoOrThreeMismatchSearchWorkerFull);
+	}
+	printCacheStats(rcFw, "forward");
+	printCacheStats(rcBw, "mirror");
+	printKmerStats(ktFw, "forward");
+	printKmerStats(ktBw, "mirror");
+	printChunkStats();
+	finishInsertEstimate();
+	cacheFw = cacheBw = NULL;
+	kmerFw = kmerBw = NULL;
+	closeRefs(refs);
 
-#ifndef _WIN32
-		int pid = 0;
-		if(thread_stealing) {
-			pid = getpid();
-			write_pid(thread_stealing_dir.c_str(), pid);
-			thread_counter = 0;
-		}
-#endif
+	return;
+}
 
-		for(int i = 0; i < nthreads; i++) {
-			tids[i] = i;
-#ifdef WITH_TBB
-			tps[i].tid = i;
-			tps[i].done = &all_threads_done;
-			if (i == nthreads - 1) {
-				if(stateful) {
-					twoOrThreeMismatchSearchWorkerStateful((void*)&tps[i]);
-				} else {
-					twoOrThreeMismatchSearchWorkerFull((void*)&tps[i]);
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new std::thread(twoOrThreeMismatchSearchWorkerStateful, (void*)&tps[i]));
-				} else {
-					threads.push_back(new std::thread(twoOrThreeMismatchSearchWorkerFull, (void*)&tps[i]));
-				}
-				threads[i]->detach();
-				SLEEP(10);
-			}
-#else
-			if (i == nthreads - 1) {
-				if(stateful) {
-					twoOrThreeMismatchSearchWorkerStateful((void*)(tids + i));
-				} else {
-					twoOrThreeMismatchSearchWorkerFull((void*)(tids + i));
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new tthread::thread(twoOrThreeMismatchSearchWorkerStateful, (void *)(tids + i)));
-				} else {
-					threads.push_back(new tthread::thread(twoOrThreeMismatchSearchWorkerFull, (void *)(tids + i)));
-				}
-			}
-#endif
-		}
+static PatternComposer*       bidirSearch_patsrc;
+static HitSink*                   bidirSearch_sink;
+static Ebwt<String<Dna> >*        bidirSearch_ebwtFw;
+static Ebwt<String<Dna> >*        bidirSearch_ebwtBw;
+static vector<String<Dna5> >*     bidirSearch_os;
+static BitPairReference*          bidirSearch_refs;
+static vector<SearchSchemes>     bidirSearch_schemes; // by # mismatches
 
-#ifndef _WIN32
-		if(thread_stealing) {
-			int orig_threads = nthreads, steal_ctr = 1;
-			for(int j = 0; j < 10; j++) {
-				sleep(1);
+static void bidirSearchWorkerFull(void *vp) {
+	int tid = *((int*)vp);
+	PatternComposer&   _patsrc  = *bidirSearch_patsrc;
+	HitSink&               _sink    = *bidirSearch_sink;
+	Ebwt<String<Dna> >&    ebwtFw   = *bidirSearch_ebwtFw;
+	Ebwt<String<Dna> >&    ebwtBw   = *bidirSearch_ebwtBw;
+	vector<String<Dna5> >& os       = *bidirSearch_os;
+	const BitPairReference* refs    =  bidirSearch_refs;
+	const vector<SearchSchemes>& schemes = bidirSearch_schemes;
+
+	// Per-thread initialization
+	PatternSourcePerThreadFactory* patsrcFact = createPatsrcFactory(_patsrc, tid, readsPerBatch);
+	PatternSourcePerThread* patsrc = patsrcFact->create();
+	HitSinkPerThreadFactory* sinkFact = createSinkFactory(_sink, tid);
+	HitSinkPerThread* sink = sinkFact->create();
+	EbwtSearchParams<String<Dna> > params(
+	        *sink,      // HitSinkPerThread
+	        os,         // reference sequences
+	        true,       // read is forward
+	        true);      // index is forward
+	GreedyDFSRangeSource bt(
+	        &ebwtFw, params,
+	        refs,           // reference sequence (for colorspace)
+	        0xffffffff,     // qualThresh
+	        0xffffffff,     // max backtracks (no max)
+	        0,              // reportPartials (don't)
+	        true,           // reportExacts
+	        rangeMode,      // reportRanges
+	        NULL,           // seedlings
+	        NULL,           // mutations
+	        verbose,        // verbose
+	        &os,
+	        false);         // considerQuals
+	bt.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bool skipped = false;
+	pair<bool, bool> get_read_ret = make_pair(false, false);
+	while(true) {
+		FINISH_READ(patsrc);
+		GET_READ(patsrc);
+		uint32_t plen = (uint32_t)length(patFw);
+		// Every mismatch counts toward the stratum
+		bt.setOffs(0, 0, plen, plen, plen, plen);
+		// One stratum at a time, so that hits arrive best-first as
+		// --best and --strata expect
+		for(int mms = 0; mms <= mismatches; mms++) {
+			if(!nofw) {
+				params.setFw(true);
+				bt.setQuery(patsrc->bufa());
+				if(bt.bidirSearch(ebwtBw, schemes[mms].get(plen))) break;
 			}
-			while(thread_counter > 0) {
-				if(steal_thread(pid, orig_threads)) {
-					nthreads++;
-					tids[nthreads-1] = nthreads;
-#ifdef WITH_TBB
-					tps[nthreads-1].tid = nthreads - 1;
-					tps[nthreads-1].done = &all_threads_done;
-					if(stateful) {
-						threads.push_back(new std::thread(twoOrThreeMismatchSearchWorkerStateful, (void*)&tps[nthreads-1]));
-					} else {
-						threads.push_back(new std::thread(twoOrThreeMismatchSearchWorkerFull, (void*)&tps[nthreads-1]));
-					}
-					threads[nthreads-1]->detach();
-					SLEEP(10);
-#else
-					if(stateful) {
-						threads.push_back(new tthread::thread(twoOrThreeMismatchSearchWorkerStateful, (void *)(tids + nthreads - 1)));
-					} else {
-						threads.push_back(new tthread::thread(twoOrThreeMismatchSearchWorkerFull, (void *)(tids + nthreads - 1)));
-					}
-#endif
-					cerr << "pid " << pid << " started new worker # " << nthreads << endl;
-				}
-				steal_ctr++;
-				for(int j = 0; j < 10; j++) {
-					sleep(1);
-				}
+			if(!norc) {
+				params.setFw(false);
+				bt.setQuery(patsrc->bufa());
+				if(bt.bidirSearch(ebwtBw, schemes[mms].get(plen))) break;
 			}
+			if(sink->finishedWithStratum(mms)) break;
 		}
-#endif
-		
-#ifdef WITH_TBB
-		while(all_threads_done < nthreads) {
-			SLEEP(10);
-		}
-#else
-		for (int i = 0; i < nthreads - 1; i++) {
-			threads[i]->join();
-		}
-#endif
+	} // End read loop
+	FINISH_READ(patsrc);
+	WORKER_EXIT();
+}
 
-#ifndef _WIN32
-		if(thread_stealing) {
-			del_pid(thread_stealing_dir.c_str(), pid);
-		}
-#endif
+/**
+ * Search for end-to-end alignments with up to -v mismatches in a
+ * single pass per read, treating the forward and mirror indexes as one
+ * bidirectional index.  The mirror text has to be the exact reverse of
+ * the forward text, which bowtie-build only guarantees with
+ * --new-reverse or when the reference has no gaps.
+ */
+template<typename TStr>
+static void bidirSearchFull(
+		PatternComposer& _patsrc,   /// pattern source
+		HitSink& _sink,                 /// hit sink
+		Ebwt<TStr>& ebwtFw,             /// index of original text
+		Ebwt<TStr>& ebwtBw,             /// index of mirror text
+		vector<String<Dna5> >& os)      /// text strings, if available (empty otherwise)
+{
+	// Global initialization
+	if(!ebwtFw.isInMemory()) {
+		Timer _t(cerr, "Time loading forward index: ", timing);
+		ebwtFw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
+	}
+	if(!ebwtBw.isInMemory()) {
+		Timer _t(cerr, "Time loading mirror index: ", timing);
+		ebwtBw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
+	}
+	if(!ebwtBw.eh().entireReverse() && ebwtFw.nFrag() > 1) {
+		cerr << "Error: --bidir and -v 4 and up need a mirror index that is the exact reverse" << endl
+		     << "of the forward index; rebuild the index with bowtie-build --new-reverse" << endl;
+		throw 1;
+	}
+	bidirSearch_schemes.clear();
+	for(int i = 0; i <= mismatches; i++) {
+		bidirSearch_schemes.push_back(SearchSchemes(i));
+	}
+	// Create range caches, which are shared among all aligners
+	RangeCache rcFw(cacheSize, &ebwtFw);
+	cacheFw = &rcFw;
+	BitPairReference *refs = NULL;
+	if(color) {
+		refs = openRefs(os);
 	}
-	if(refs != NULL) delete refs;
+	bidirSearch_refs   = refs;
+	bidirSearch_patsrc = &_patsrc;
+	bidirSearch_sink   = &_sink;
+	bidirSearch_ebwtFw = &ebwtFw;
+	bidirSearch_ebwtBw = &ebwtBw;
+	bidirSearch_os     = &os;
 
-	for (int i = 0; i < nthreads - 1; i++) {
-		if (threads[i] != NULL) {
-			delete threads[i];
-		}
+	CHUD_START();
+	{
+		Timer _t(cerr, "End-to-end bidirectional full-index search: ", timing);
+		workerPool->run(bidirSearchWorkerFull);
 	}
-	return;
+	printCacheStats(rcFw, "forward");
+	cacheFw = NULL;
+	closeRefs(refs);
 }
 
 static PatternComposer*     seededQualSearch_patsrc;
@@ -2482,25 +2356,13 @@ static HitSink*                 seededQualSearch_sink;
 static Ebwt<String<Dna> >*      seededQualSearch_ebwtFw;
 static Ebwt<String<Dna> >*      seededQualSearch_ebwtBw;
 static vector<String<Dna5> >*   seededQualSearch_os;
-static SyncBitset*              seededQualSearch_doneMask;
-static SyncBitset*              seededQualSearch_hitMask;
 static PartialAlignmentManager* seededQualSearch_pamFw;
 static PartialAlignmentManager* seededQualSearch_pamRc;
 static int                      seededQualSearch_qualCutoff;
 static BitPairReference*        seededQualSearch_refs;
 
-#ifdef WITH_TBB
-//void seededQualSearchWorkerFull::operator()() const {
-static void seededQualSearchWorkerFull(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void seededQualSearchWorkerFull(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&     _patsrc    = *seededQualSearch_patsrc;
 	HitSink&                 _sink      = *seededQualSearch_sink;
 	vector<String<Dna5> >&   os         = *seededQualSearch_os;
@@ -2663,6 +2525,33 @@ static void seededQualSearchWorkerFull(void *vp) {
 	        true,    // considerQuals
 	        true,    // halfAndHalf
 	        !noMaqRound);
+	btf1.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btf1.setSharePaths(prefixSortChars > 0);
+	btf1.setKmerTables(kmerFw, kmerBw);
+	bt1.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	bt1.setSharePaths(prefixSortChars > 0);
+	bt1.setKmerTables(kmerFw, kmerBw);
+	btf2.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btf2.setSharePaths(prefixSortChars > 0);
+	btf2.setKmerTables(kmerFw, kmerBw);
+	btr2.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btr2.setSharePaths(prefixSortChars > 0);
+	btr2.setKmerTables(kmerFw, kmerBw);
+	btf3.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btf3.setSharePaths(prefixSortChars > 0);
+	btf3.setKmerTables(kmerFw, kmerBw);
+	btr3.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btr3.setSharePaths(prefixSortChars > 0);
+	btr3.setKmerTables(kmerFw, kmerBw);
+	btr23.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btr23.setSharePaths(prefixSortChars > 0);
+	btr23.setKmerTables(kmerFw, kmerBw);
+	btf4.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btf4.setSharePaths(prefixSortChars > 0);
+	btf4.setKmerTables(kmerFw, kmerBw);
+	btf24.setRangeCaches(cacheFw, cacheBw, cacheLimit);
+	btf24.setSharePaths(prefixSortChars > 0);
+	btf24.setKmerTables(kmerFw, kmerBw);
 	String<QueryMutation> muts;
 	bool skipped = false;
 	pair<bool, bool> get_read_ret = make_pair(false, false);
@@ -2702,17 +2591,12 @@ static void seededQualSearchWorkerFull(void *vp) {
 			uint32_t qs = min<uint32_t>(plen, s);
 			uint32_t qs3 = qs >> 1;
 			uint32_t qs5 = (qs >> 1) + (qs & 1);
-			#define DONEMASK_SET(p)
 			#include "search_seeded_phase1.c"
 			#include "search_seeded_phase2.c"
 			#include "search_seeded_phase3.c"
 			#include "search_seeded_phase4.c"
-			#undef DONEMASK_SET
 		}
 		FINISH_READ(patsrc);
-		if(thread_stealing) {
-			decrement_thread_counter();
-		}
 		if(seedMms > 0) {
 			delete pamRc;
 			delete pamFw;
@@ -2724,24 +2608,11 @@ static void seededQualSearchWorkerFull(void *vp) {
 		   << "thread: " << tid << " node_changeovers: " << nnuma_changeovers << std::endl;
 		std::cout << ss.str();
 	}
-#endif
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
 #endif
 	WORKER_EXIT();
 }
-#ifdef WITH_TBB
-//void seededQualSearchWorkerFullStateful::operator()() const {
-static void seededQualSearchWorkerFullStateful(void *vp) {
-	thread_tracking_pair *p = (thread_tracking_pair*) vp;
-	int tid = p->tid;
-#else
 static void seededQualSearchWorkerFullStateful(void *vp) {
 	int tid = *((int*)vp);
-#endif
-	if(thread_stealing) {
-		increment_thread_counter();
-	}
 	PatternComposer&     _patsrc    = *seededQualSearch_patsrc;
 	HitSink&                 _sink      = *seededQualSearch_sink;
 	Ebwt<String<Dna> >&      ebwtFw     = *seededQualSearch_ebwtFw;
@@ -2759,6 +2630,10 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 	if(stats) {
 		metrics = new AlignerMetrics();
 	}
+	BacktrackBudget *budget = NULL;
+	if(btSens > 0.0f) {
+		budget = new BacktrackBudget(maxBts, btSens);
+	}
 	UnpairedSeedAlignerFactory alSEfact(
 			ebwtFw,
 			&ebwtBw,
@@ -2770,8 +2645,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			maxBts,
 			_sink,
 			*sinkFact,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -2783,7 +2658,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			verbose,
 			quiet,
 			seed,
-			metrics);
+			metrics,
+			budget);
 	PairedSeedAlignerFactory alPEfact(
 			ebwtFw,
 			&ebwtBw,
@@ -2801,12 +2677,13 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			mate2fw,
 			minInsert,
 			maxInsert,
+			insEst,
 			dontReconcileMates,
 			mhits,       // for symCeiling
 			mixedThresh,
 			mixedAttemptLim,
-			NULL, //&cacheFw,
-			NULL, //&cacheBw,
+			cacheFw,
+			cacheBw,
 			cacheLimit,
 			pool,
 			refs,
@@ -2818,7 +2695,8 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 			rangeMode,
 			verbose,
 			quiet,
-			seed);
+			seed,
+			budget);
 	{
 		MixedMultiAligner multi(
 				prefetchWidth,
@@ -2834,17 +2712,12 @@ static void seededQualSearchWorkerFullStateful(void *vp) {
 		metrics->printSummary();
 		delete metrics;
 	}
+	delete budget;
 
-#ifdef WITH_TBB
-	p->done->fetch_and_add(1);
-#endif
-	if(thread_stealing) {
-		decrement_thread_counter();
-	}
 
 	delete patsrcFact;
 	delete sinkFact;
-	delete pool;
+	retireChunkPool(pool);
 	return;
 }
 
@@ -2882,161 +2755,56 @@ static void seededQualCutoffSearchFull(
 	seededQualSearch_ebwtFw   = &ebwtFw;
 	seededQualSearch_ebwtBw   = &ebwtBw;
 	seededQualSearch_os       = &os;
-	seededQualSearch_doneMask = NULL;
-	seededQualSearch_hitMask  = NULL;
 	seededQualSearch_pamFw    = NULL;
 	seededQualSearch_pamRc    = NULL;
 	seededQualSearch_qualCutoff = qualCutoff;
 
 	// Create range caches, which are shared among all aligners
+	RangeCache rcFw(cacheSize, &ebwtFw), rcBw(cacheSize, &ebwtBw);
+	cacheFw = &rcFw;
+	cacheBw = &rcBw;
+	KmerTable ktFw(kmerTabSize, kmerLen), ktBw(kmerTabSize, kmerLen);
+	kmerFw = &ktFw;
+	kmerBw = &ktBw;
 	BitPairReference *refs = NULL;
 	bool pair = mates1.size() > 0 || mates12.size() > 0;
 	if(color || (pair && mixedThresh < 0xffffffff)) {
-		Timer _t(cerr, "Time loading reference: ", timing);
-		refs = new BitPairReference(adjustedEbwtFileBase, color, sanityCheck, NULL, &os, false, true, useMm, useShmem, mmSweep, verbose, startVerbose);
-		if(!refs->loaded()) throw 1;
+		refs = openRefs(os);
 	}
+	startInsertEstimate(pair);
 	seededQualSearch_refs = refs;
 
-	int tids[max(nthreads, thread_ceiling)];
-#ifdef WITH_TBB
-	vector<std::thread*> threads;
-	vector<thread_tracking_pair> tps;
-	tps.reserve(max(nthreads, thread_ceiling));
-#else
-	vector<tthread::thread*> threads;
-#endif
-
-#ifdef WITH_TBB
-	tbb::atomic<int> all_threads_done;
-	all_threads_done = 0;
-#endif
-
-	SWITCH_TO_FW_INDEX();
-	assert(!ebwtBw.isInMemory());
-	{
+	// Both indexes stay resident; each search thread takes every read
+	// it fetches through all of the phases before fetching another
+	if(!ebwtFw.isInMemory()) {
+		Timer _t(cerr, "Time loading forward index: ", timing);
+		ebwtFw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
+	}
+	if(!ebwtBw.isInMemory()) {
 		// Load the other half of the index into memory
 		Timer _t(cerr, "Time loading mirror index: ", timing);
 		ebwtBw.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 	}
+	if(btSens > 0.0f && !stateful && !quiet) {
+		cerr << "Warning: --btsens only applies with --best, --strata or paired-end reads; ignoring" << endl;
+	}
 	CHUD_START();
 	{
-		// Phase 1: Consider cases 1R and 2R
 		Timer _t(cerr, "Seeded quality full-index search: ", timing);
-
-#ifndef _WIN32
-		int pid = 0;
-		if(thread_stealing) {
-			pid = getpid();
-			write_pid(thread_stealing_dir.c_str(), pid);
-			thread_counter = 0;
-		}
-#endif
-
-		for(int i = 0; i < nthreads; i++) {
-			tids[i] = i;
-#ifdef WITH_TBB
-			tps[i].tid = i;
-			tps[i].done = &all_threads_done;
-			if (i == nthreads - 1) {
-				if(stateful) {
-					seededQualSearchWorkerFullStateful((void*)&tps[i]);
-				} else {
-					seededQualSearchWorkerFull((void*)&tps[i]);
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new std::thread(seededQualSearchWorkerFullStateful, (void*)&tps[i]));
-				} else {
-					threads.push_back(new std::thread(seededQualSearchWorkerFull, (void*)&tps[i]));
-				}
-				threads[i]->detach();
-				SLEEP(10);
-		    }
-#else
-			if (i == nthreads - 1) {
-				if(stateful) {
-					seededQualSearchWorkerFullStateful((void*)(tids + i));
-				} else {
-					seededQualSearchWorkerFull((void*)(tids + i));
-				}
-			}
-			else {
-				if(stateful) {
-					threads.push_back(new tthread::thread(seededQualSearchWorkerFullStateful, (void *)(tids + i)));
-				} else {
-					threads.push_back(new tthread::thread(seededQualSearchWorkerFull, (void *)(tids + i)));
-				}
-			}
-#endif
-		}
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			int orig_threads = nthreads, steal_ctr = 1;
-			for(int j = 0; j < 10; j++) {
-				sleep(1);
-			}
-			while(thread_counter > 0) {
-				if(steal_thread(pid, orig_threads)) {
-					nthreads++;
-					tids[nthreads-1] = nthreads - 1;
-#ifdef WITH_TBB
-					tps[nthreads-1].tid = nthreads - 1;
-					tps[nthreads-1].done = &all_threads_done;
-					if(stateful) {
-						threads.push_back(new std::thread(seededQualSearchWorkerFullStateful, (void*)&tps[nthreads-1]));
-					} else {
-						threads.push_back(new std::thread(seededQualSearchWorkerFull, (void*)&tps[nthreads-1]));
-					}
-					threads[nthreads-1]->detach();
-					SLEEP(10);
-#else
-					if(stateful) {
-						threads.push_back(new tthread::thread(seededQualSearchWorkerFullStateful, (void *)(tids + nthreads - 1)));
-					} else {
-						threads.push_back(new tthread::thread(seededQualSearchWorkerFull, (void *)(tids + nthreads - 1)));
-					}
-#endif
-					cerr << "pid " << pid << " started new worker # " << nthreads << endl;
-				}
-				steal_ctr++;
-				for(int j = 0; j < 10; j++) {
-					sleep(1);
-				}
-			}
-		}
-#endif
-		
-#ifdef WITH_TBB
-		while(all_threads_done < nthreads) {
-			SLEEP(10);
-		}
-#else
-		for (int i = 0; i < nthreads - 1; i++) {
-			threads[i]->join();
-		}
-#endif
-
-#ifndef _WIN32
-		if(thread_stealing) {
-			del_pid(thread_stealing_dir.c_str(), pid);
-		}
-#endif
-	}
-
-	if(refs != NULL) {
-		delete refs;
+		workerPool->run(stateful ? seededQualSearchWorkerFullStateful : seededQualSearchWorkerFull);
 	}
+	printCacheStats(rcFw, "forward");
+	printCacheStats(rcBw, "mirror");
+	printKmerStats(ktFw, "forward");
+	printKmerStats(ktBw, "mirror");
+	printChunkStats();
+	finishInsertEstimate();
+	cacheFw = cacheBw = NULL;
+	kmerFw = kmerBw = NULL;
 
-	for (int i = 0; i < nthreads - 1; i++) {
-		if (threads[i] != NULL) {
-			delete threads[i];
-		}
-	}
+	closeRefs(refs);
 
-	ebwtBw.evictFromMemory();
+	if(!keepIndex) ebwtBw.evictFromMemory();
 }
 
 /**
@@ -3087,6 +2855,112 @@ patsrcFromStrings(int format,
 
 static string argstr;
 
+/**
+ * Return the slot holding the kept forward or mirror index.
+ */
+template<typename TStr>
+static Ebwt<TStr>*& keptEbwt(bool fw) {
+	static Ebwt<TStr>* kept[2] = { NULL, NULL };
+	return kept[fw ? 0 : 1];
+}
+
+/**
+ * Free the kept indexes and reference.
+ */
+template<typename TStr>
+static void dropKeptIndexes() {
+	for(int i = 0; i < 2; i++) {
+		Ebwt<TStr>*& e = keptEbwt<TStr>(i == 0);
+		if(e != NULL) {
+			if(e->isInMemory()) e->evictFromMemory();
+			delete e;
+			e = NULL;
+		}
+	}
+	if(keptRefs != NULL) {
+		delete keptRefs;
+		keptRefs = NULL;
+	}
+	keptIndexKey.clear();
+}
+
+/**
+ * Initialize the forward (fw = true) or mirror index and read in its
+ * header.  In --server mode, reuse the index kept from an earlier job
+ * if it was loaded the same way.
+ */
+template<typename TStr>
+static Ebwt<TStr>* openEbwt(bool fw, bool isBt2Index) {
+	if(keepIndex) {
+		if(keptIndexKey != indexKey()) {
+			dropKeptIndexes<TStr>();
+			keptIndexKey = indexKey();
+		}
+		if(keptEbwt<TStr>(fw) != NULL) {
+			return keptEbwt<TStr>(fw);
+		}
+	}
+	Ebwt<TStr>* ebwt = new Ebwt<TStr>(
+		fw ? adjustedEbwtFileBase : adjustedEbwtFileBase + ".rev",
+		color,  // index is colorspace
+		-1,     // don't care about entireReverse
+		fw,     // index is for the forward direction?
+		/* overriding: */ offRate,
+		/* overriding: */ isaRate,
+		useMm,    // whether to use memory-mapped files
+		useShmem, // whether to use shared memory
+		mmSweep,  // sweep memory-mapped files
+		!noRefNames, // load names?
+		verbose, // whether to be talkative
+		startVerbose, // talkative during initialization
+		false /*passMemExc*/,
+		sanityCheck,
+		isBt2Index);
+	if(keepIndex) {
+		keptEbwt<TStr>(fw) = ebwt;
+	}
+	return ebwt;
+}
+
+/**
+ * Free an index obtained from openEbwt() unless it's being kept.
+ */
+template<typename TStr>
+static void closeEbwt(Ebwt<TStr>* ebwt) {
+	if(ebwt == NULL || keepIndex) return;
+	if(ebwt->isInMemory()) ebwt->evictFromMemory();
+	delete ebwt;
+}
+
+/**
+ * Return true iff every alignment found for a read is reported (or the
+ * read is suppressed by -m), so that no pseudo-random choice picks which
+ * ones are.
+ */
+static bool reportsAllHits() {
+	return allHits || (!sampleMax && mhits != 0xffffffff && khits >= mhits);
+}
+
+/**
+ * Return true iff the search isn't cut short by a backtracking limit,
+ * i.e. it finds the same alignments whatever its pseudo-random seed.
+ * That holds for -v other than 3 (which searches statefully), and for
+ * -n 0 or 1, without --best, and for any --tryhard search.
+ */
+static bool exhaustiveSearch() {
+	return tryHard || (!stateful && (!maqLike || seedMms < 2));
+}
+
+/**
+ * Return true iff the alignments reported for a read can't depend on
+ * its pseudo-random seed, which comes from its name as well as its
+ * sequence.  Only then can --dupcache report one copy's alignments for
+ * another.
+ */
+static bool seedFreeResults() {
+	return reportsAllHits() && exhaustiveSearch();
+}
+
 template<typename TStr>
 static void driver(const char * type,
                    const string& ebwtFileBase,
@@ -3136,6 +3010,13 @@ static void driver(const char * type,
 	// stateful mode
 	bool paired = mates1.size() > 0 || mates12.size() > 0;
 	if(paired) stateful = true;
+	if(paired && !maqLike && mismatches > 3) {
+		cerr << "Error: -v " << mismatches << " is not supported for paired-end reads; use -v 3 or less" << endl;
+		throw 1;
+	}
+	if(paired && bidir && !quiet) {
+		cerr << "Warning: --bidir does not apply to paired-end reads; ignoring" << endl;
+	}
 
 	// Create list of pattern sources for paired reads appearing
 	// interleaved in a single file
@@ -3244,52 +3125,30 @@ static void driver(const char * type,
 		cerr << "Opening hit output file: "; logTime(cerr, true);
 	}
 	OutFileBuf *fout;
-	if(!outfile.empty()) {
+	if(!outfile.empty() && shardDir.empty()) {
 		fout = new OutFileBuf(outfile.c_str(), false);
 	} else {
+		// With --shard-out, records all go to the shard files and
+		// nothing is written here
+		if(!outfile.empty() && !quiet) {
+			cerr << "Warning: with --shard-out, output file " << outfile
+			     << " is not written" << endl;
+		}
 		fout = new OutFileBuf();
 	}
 	// Initialize Ebwt object and read in header
 	if(verbose || startVerbose) {
 		cerr << "About to initialize fw Ebwt: "; logTime(cerr, true);
 	}
-	Ebwt<TStr> ebwt(adjustedEbwtFileBase,
-	                color,  // index is colorspace
-	                -1,     // don't care about entireReverse
-	                true,     // index is for the forward direction
-	                /* overriding: */ offRate,
-	                /* overriding: */ isaRate,
-	                useMm,    // whether to use memory-mapped files
-	                useShmem, // whether to use shared memory
-	                mmSweep,  // sweep memory-mapped files
-	                !noRefNames, // load names?
-	                verbose, // whether to be talkative
-	                startVerbose, // talkative during initialization
-	                false /*passMemExc*/,
-	                sanityCheck,
-	                isBt2Index);
+	Ebwt<TStr>* ebwtFw = openEbwt<TStr>(true, isBt2Index);
+	Ebwt<TStr>& ebwt = *ebwtFw;
 	Ebwt<TStr>* ebwtBw = NULL;
 	// We need the mirror index if mismatches are allowed
 	if(mismatches > 0 || maqLike) {
 		if(verbose || startVerbose) {
 			cerr << "About to initialize rev Ebwt: "; logTime(cerr, true);
 		}
-		ebwtBw = new Ebwt<TStr>(
-			adjustedEbwtFileBase + ".rev",
-			color,  // index is colorspace
-			-1,     // don't care about entireReverse
-			false, // index is for the reverse direction
-			/* overriding: */ offRate,
-			/* overriding: */ isaRate,
-			useMm,    // whether to use memory-mapped files
-			useShmem, // whether to use shared memory
-			mmSweep,  // sweep memory-mapped files
-			!noRefNames, // load names?
-			verbose,  // whether to be talkative
-			startVerbose, // talkative during initialization
-			false /*passMemExc*/,
-			sanityCheck,
-	        isBt2Index);
+		ebwtBw = openEbwt<TStr>(false, isBt2Index);
 	}
 	if(!os.empty()) {
 		for(size_t i = 0; i < os.size(); i++) {
@@ -3319,10 +3178,15 @@ static void driver(const char * type,
 		}
 		ebwt.loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
 		ebwt.checkOrigs(os, color, false);
-		ebwt.evictFromMemory();
+		if(!keepIndex) ebwt.evictFromMemory();
 	}
 	{
 		Timer _t(cerr, "Time searching: ", timing);
+		// Search threads; per-thread state in the sink is sized for
+		// the most threads the pool might run
+		WorkerPool pool(nthreads, thread_stealing ? thread_ceiling : nthreads,
+		                thread_stealing_dir, verbose);
+		workerPool = &pool;
 		if(verbose || startVerbose) {
 			cerr << "Creating HitSink: "; logTime(cerr, true);
 		}
@@ -3342,8 +3206,15 @@ static void driver(const char * type,
 					dumpUnalBase,
 					dumpMaxBase,
 					format == TAB_MATE, sampleMax,
-					refnames, nthreads,
+					refnames, pool.maxThreads(),
 					outBatchSz, partitionSz);
+			if(sortOut) {
+				sink->setSort((size_t)sortMemMbs * 1024 * 1024, sortTmpDir);
+			}
+			if(!shardDir.empty()) {
+				sink->setShards(shardDir, shardSz, ".txt", offBase,
+				                partitionSz > 0 ? partitionSz : 0);
+			}
 		} else if(outType == OUTPUT_SAM) {
 			SAMHitSink *sam = new SAMHitSink(
 				*fout, 1,
@@ -3354,9 +3225,15 @@ static void driver(const char * type,
 				format == TAB_MATE,
 				sampleMax,
 				refnames,
-				nthreads,
+				pool.maxThreads(),
 				outBatchSz,
 				reorder);
+			if(sortOut) {
+				sam->setSort((size_t)sortMemMbs * 1024 * 1024, sortTmpDir);
+			}
+			if(!shardDir.empty()) {
+				sam->setShards(shardDir, shardSz, ".sam");
+			}
 			if(!samNoHead) {
 				vector<string> refnames;
 				if(!samNoSQ) {
@@ -3376,9 +3253,47 @@ static void driver(const char * type,
 			cerr << "Invalid output type: " << outType << endl;
 			throw 1;
 		}
+		prefixSortChars = 0;
+		if(prefixSort) {
+			// Order reads by the k-mer their search starts with, and
+			// put the output back in input order unless something else
+			// decides its order
+			prefixSortChars = min(ebwt.eh().ftabChars(), 16);
+			if(!sortOut && shardDir.empty()) sink->setBatchOrder();
+		}
+		if(kmerTabSize > 0 && kmerLen <= ebwt.eh().ftabChars()) {
+			cerr << "--kmerlen arg must be greater than the index's ftab length ("
+			     << ebwt.eh().ftabChars() << ")" << endl;
+			throw 1;
+		}
+		DupReadCache *dupCache = NULL;
+		if(dupCacheSize > 0 && !color && !seedFreeResults()) {
+			if(!quiet && !reportsAllHits()) {
+				cerr << "Warning: --dupcache needs -a, or -k at least -m (-k 1 is the default and" << endl
+				     << "reports one alignment picked per read); not caching duplicate reads" << endl;
+			} else if(!quiet) {
+				cerr << "Warning: --dupcache needs -v 0, 1, 2, 4 or 5, or -n 0 or 1, without --best" << endl
+				     << "(or with --tryhard); not caching duplicate reads" << endl;
+			}
+		} else if(dupCacheSize > 0 && !color) {
+			// Qualities only matter to -n and stateful searches
+			dupCache = new DupReadCache(dupCacheSize, maqLike || stateful, !noMaqRound);
+			sink->setDupCache(dupCache);
+		}
 		if(verbose || startVerbose) {
 			cerr << "Dispatching to search driver: "; logTime(cerr, true);
 		}
+		vector<PatternSource*> srcs = patsrcs_a;
+		srcs.insert(srcs.end(), patsrcs_b.begin(), patsrcs_b.end());
+		srcs.insert(srcs.end(), patsrcs_ab.begin(), patsrcs_ab.end());
+		if(adaptBatch) {
+			batchSizer = new BatchSizer(readsPerBatch, pool.maxThreads(), srcs);
+		}
+		ProgressReporter *progress = NULL;
+		if(progressIval > 0) {
+			progress = new ProgressReporter(*sink, srcs, progressIval, progressFile, batchSizer);
+			progress->start();
+		}
 		if(maqLike) {
 			seededQualCutoffSearchFull(seedLen,
 									   qualThresh,
@@ -3390,7 +3305,10 @@ static void driver(const char * type,
 									   os);     // references, if available
 		}
 		else if(mismatches > 0) {
-			if(mismatches == 1) {
+			if(bidir && !paired) {
+				assert(ebwtBw != NULL);
+				bidirSearchFull(*patsrc, *sink, ebwt, *ebwtBw, os);
+			} else if(mismatches == 1) {
 				assert(ebwtBw != NULL);
 				mismatchSearchFull(*patsrc, *sink, ebwt, *ebwtBw, os);
 			} else if(mismatches == 2 || mismatches == 3) {
@@ -3405,14 +3323,23 @@ static void driver(const char * type,
 			// we're only loading half of the index anyway
 			exactSearch(*patsrc, *sink, ebwt, os);
 		}
+		workerPool = NULL;
 		// Evict any loaded indexes from memory
-		if(ebwt.isInMemory()) {
+		if(ebwt.isInMemory() && !keepIndex) {
 			ebwt.evictFromMemory();
 		}
-		if(ebwtBw != NULL) {
-			delete ebwtBw;
+		closeEbwt(ebwtBw);
+		if(progress != NULL) {
+			progress->stop();
+			delete progress;
 		}
+		delete batchSizer;
+		batchSizer = NULL;
 		sink->finish(hadoopOut); // end the hits section of the hit file
+		if(dupCache != NULL) {
+			if(!quiet) dupCache->printStats(cerr);
+			delete dupCache;
+		}
 		for(size_t i = 0; i < patsrcs_a.size(); i++) {
 			assert(patsrcs_a[i] != NULL);
 			delete patsrcs_a[i];
@@ -3431,6 +3358,44 @@ static void driver(const char * type,
 		delete sink;
 		if(fout != NULL) delete fout;
 	}
+	closeEbwt(ebwtFw);
+}
+
+extern "C" int bowtie(int argc, const char **argv);
+
+/**
+ * Load the index named 'ebwtFile' and keep it in memory while serving
+ * alignment jobs on serverSock.  Each job's arguments are appended to
+ * this command line (minus --server), so options given here become
+ * the defaults for every job.
+ */
+static int serve(int argc, const char **argv, const string& ebwtFile) {
+	typedef String<Dna, Alloc<> > TStr;
+	string sock = serverSock;
+	vector<string> baseArgs;
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if(arg == "--server") {
+			i++;
+			continue;
+		}
+		if(arg.compare(0, 9, "--server=") == 0) continue;
+		baseArgs.push_back(arg);
+	}
+	keepIndex = true;
+	adjustedEbwtFileBase = adjustEbwtBase(argv0, ebwtFile, verbose);
+	bool isBt2Index = (gEbwt_ext == "bt2" || gEbwt_ext == "bt2l");
+	{
+		Timer _t(cerr, "Time loading index: ", timing);
+		Ebwt<TStr>* fw = openEbwt<TStr>(true, isBt2Index);
+		fw->loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
+		Ebwt<TStr>* bw = openEbwt<TStr>(false, isBt2Index);
+		bw->loadIntoMemory(color ? 1 : 0, -1, !noRefNames, startVerbose);
+	}
+	int ret = serveJobs(sock, argv0, baseArgs, bowtie);
+	dropKeptIndexes<TStr>();
+	keepIndex = false;
+	return ret;
 }
 
 // C++ name mangling is disabled for the bowtie() function to make it
@@ -3453,7 +3418,13 @@ int bowtie(int argc, const char **argv) {
   #endif
 		// Reset all global state, including getopt state
 		opterr = optind = 1;
+#ifdef __GLIBC__
+		// Also forget any option cluster a failed --server job left
+		// half-parsed
+		optind = 0;
+#endif
 		resetOptions();
+		argstr.clear();
 		for(int i = 0; i < argc; i++) {
 			argstr += argv[i];
 			if(i < argc-1) argstr += " ";
@@ -3502,6 +3473,14 @@ int bowtie(int argc, const char **argv) {
 				return 1;
 			}
 			ebwtFile = argv[optind++];
+			if(!serverSock.empty()) {
+				if(keepIndex) {
+					// A job can't start a server of its own
+					cerr << "Error: --server cannot be given in a job sent to a server" << endl;
+					return 1;
+				}
+				return serve(argc, argv, ebwtFile);
+			}
 
 			// Get query filename
 			if(optind >= argc) {
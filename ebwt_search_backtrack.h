@@ -8,9 +8,29 @@
 #include "ebwt_search_util.h"
 #include "range.h"
 #include "range_source.h"
+#include "range_cache.h"
+#include "kmer_table.h"
+#include "search_scheme.h"
 #include "aligner_metrics.h"
 #include "search_globals.h"
 
+/**
+ * The BW ranges visited while matching the unrevisitable 3' end of the
+ * last query searched against one index in one orientation.  When
+ * reads are searched in sorted order, consecutive queries usually
+ * share a long stretch of that path, so the next query resumes from
+ * the deepest range they have in common; in effect, the sorted batch
+ * is searched as a trie.
+ */
+struct SharedPath {
+	SharedPath() : ebwt(NULL) { }
+
+	const void*             ebwt;  /// index the ranges belong to
+	std::vector<uint8_t>    chars; /// chars[d] = query char at depth d
+	std::vector<TIndexOffU> tops;  /// tops[i] = top after ftabChars+i chars
+	std::vector<TIndexOffU> bots;  /// bots[i] = bot after ftabChars+i chars
+};
+
 /**
  * Class that coordinates quality- and quantity-aware backtracking over
  * some range of a read sequence.
@@ -76,10 +96,24 @@ public:
 		_preLtop(),
 		_preLbot(),
 		_verbose(verbose),
-		_ihits(0llu)
-	{ }
+		_ihits(0llu),
+		_cacheFw(NULL),
+		_cacheBw(NULL),
+		_cacheLimit(0),
+		_cacheEnt(),
+		_sharePaths(false),
+		_kmerFw(NULL),
+		_kmerBw(NULL),
+		_ebwtBw(NULL),
+		_lastRight(0)
+	{
+		_kmerHits[0] = _kmerHits[1] = 0;
+		_kmerMisses[0] = _kmerMisses[1] = 0;
+	}
 
 	~GreedyDFSRangeSource() {
+		if(_kmerFw != NULL) _kmerFw->addStats(_kmerHits[0], _kmerMisses[0]);
+		if(_kmerBw != NULL) _kmerBw->addStats(_kmerHits[1], _kmerMisses[1]);
 		if(_pairs != NULL) delete[] _pairs;
 		if(_elims != NULL) delete[] _elims;
 		if(_chars != NULL) delete[] _chars;
@@ -143,6 +177,35 @@ public:
 		_rand.init(r.seed);
 	}
 
+	/**
+	 * Resolve the rows of full-alignment ranges wider than 'cacheLimit'
+	 * through whichever of 'cacheFw' and 'cacheBw' matches the index
+	 * being searched.
+	 */
+	void setRangeCaches(RangeCache *cacheFw, RangeCache *cacheBw, uint32_t cacheLimit) {
+		_cacheFw = cacheFw;
+		_cacheBw = cacheBw;
+		_cacheLimit = cacheLimit;
+	}
+
+	/**
+	 * Set whether each search should start from the deepest BW range
+	 * it shares with the previous search's exact-match path (see
+	 * SharedPath).  Only pays when reads arrive sorted.
+	 */
+	void setSharePaths(bool share) {
+		_sharePaths = share;
+	}
+
+	/**
+	 * Start exact matches through whichever of 'kmerFw' and 'kmerBw'
+	 * matches the index being searched, where they're enabled.
+	 */
+	void setKmerTables(KmerTable *kmerFw, KmerTable *kmerBw) {
+		_kmerFw = (kmerFw != NULL && kmerFw->enabled()) ? kmerFw : NULL;
+		_kmerBw = (kmerBw != NULL && kmerBw->enabled()) ? kmerBw : NULL;
+	}
+
 	/**
 	 * Apply a batch of mutations to this read, possibly displacing a
 	 * previous batch of mutations.
@@ -255,7 +318,46 @@ public:
 		// m = depth beyond which ftab must not extend or else we might
 		// miss some legitimate paths
 		uint32_t m = min<uint32_t>(_unrevOff, (uint32_t)_qlen);
-		if(nsInFtab == 0 && m >= (uint32_t)ftabChars) {
+		KmerTable *kmers = ebwt.fw() ? _kmerFw : _kmerBw;
+		uint64_t kmer = 0;
+		if(nsInFtab == 0 && m >= (uint32_t)ftabChars && !_sharePaths &&
+		   kmers != NULL && kmerKey(*kmers, m, kmer))
+		{
+			// The first k chars can't mismatch; get their range from
+			// the table, or match them and put it there
+			const uint32_t k = (uint32_t)kmers->len();
+			const int i = ebwt.fw() ? 0 : 1;
+			TIndexOffU top = 0, bot = 0;
+			if(kmers->lookup(kmer, top, bot)) {
+				_kmerHits[i]++;
+			} else {
+				_kmerMisses[i]++;
+				uint32_t ftabOff = calcFtabOff();
+				top = ebwt.ftabHi(ftabOff);
+				bot = ebwt.ftabLo(ftabOff+1);
+				for(uint32_t d = (uint32_t)ftabChars; d < k && bot > top; d++) {
+					matchChar(d, top, bot);
+				}
+				if(bot <= top) top = bot = 0;
+				kmers->insert(kmer, top, bot);
+			}
+			if(bot <= top) {
+				ret = false;
+			} else if(_qlen == (TIndexOffU)k) {
+				ret = reportAlignment(0, top, bot, ham);
+			} else {
+				ret = backtrack(k, top, bot, ham, false);
+			}
+		} else if(nsInFtab == 0 && m >= (uint32_t)ftabChars &&
+		   _sharePaths && _qlen > (TIndexOffU)ftabChars && !_halfAndHalf)
+		{
+			// Pick up the previous query's path where it diverges from
+			// ours and follow ours through the unrevisitable region
+			uint32_t depth = 0;
+			TIndexOffU top = 0, bot = 0;
+			walkSharedPath(min<uint32_t>(m, (uint32_t)_qlen - 1), depth, top, bot);
+			ret = (bot > top) && backtrack(depth, top, bot, ham, false);
+		} else if(nsInFtab == 0 && m >= (uint32_t)ftabChars) {
 			uint32_t ftabOff = calcFtabOff();
 			TIndexOffU top = ebwt.ftabHi(ftabOff);
 			TIndexOffU bot = ebwt.ftabLo(ftabOff+1);
@@ -300,6 +402,155 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Find the end-to-end alignments covered by the searches in 'ss',
+	 * using the forward index together with the mirror index 'ebwtBw'
+	 * as one bidirectional index: a search keeps the range of the
+	 * aligned region in both, so it can grow the region to the left
+	 * through the forward index and to the right through the mirror.
+	 * This only works if the mirror text is the exact reverse of the
+	 * forward text.
+	 *
+	 * Return true iff the HitSink has indicated that we're done with
+	 * this read.
+	 */
+	bool bidirSearch(const Ebwt<String<Dna> >& ebwtBw,
+	                 const std::vector<BidirSearch>& ss)
+	{
+		assert(_ebwt->fw());
+		assert(!ebwtBw.fw());
+		assert_eq(_ebwt->_eh._ftabChars, ebwtBw._eh._ftabChars);
+		assert(_muts == NULL);
+		assert_eq(0, _reportPartials);
+		_ebwtBw = &ebwtBw;
+		_mms.clear();
+		_refcs.clear();
+		for(size_t i = 0; i < ss.size(); i++) {
+			const BidirSearch& s = ss[i];
+			for(int j = 0; j <= s.pieces; j++) {
+				_pieceOffs[j] = (uint32_t)((s.ends[j] * _qlen) / s.ends[s.pieces]);
+			}
+			_lastRight = s.lastRight();
+			if(bidirStart(s)) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * If the first k chars searched are all unrevisitable and none is
+	 * an N, and the table can stand in for them, set 'key' to them and
+	 * return true.  'm' is the depth of the unrevisitable region.
+	 */
+	bool kmerKey(const KmerTable& kmers, uint32_t m, uint64_t& key) const {
+		const uint32_t k = (uint32_t)kmers.len();
+		if(m < k || _qlen < k || _halfAndHalf) return false;
+		// A k-mer that's the whole read is reported directly, which
+		// is only right for end-to-end exact hits
+		if(_qlen == k && (_reportPartials > 0 || !_reportExacts)) return false;
+		key = 0;
+		for(uint32_t d = 0; d < k; d++) {
+			int c = (int)(*_qry)[_qlen - d - 1];
+			if(c == 4) return false;
+			key |= ((uint64_t)c << (2 * d));
+		}
+		return true;
+	}
+
+	/**
+	 * Narrow [top, bot) by the query char at depth 'd', leaving
+	 * top == bot if nothing matches.
+	 */
+	void matchChar(uint32_t d, TIndexOffU& top, TIndexOffU& bot) const {
+		int c = (int)(*_qry)[_qlen - d - 1];
+		mapRange(*_ebwt, c, top, bot);
+	}
+
+	/**
+	 * Narrow [top, bot) of 'ebwt' to the rows that char 'c' extends,
+	 * leaving top == bot if there are none.
+	 */
+	static void mapRange(const Ebwt<String<Dna> >& ebwt, int c,
+	                     TIndexOffU& top, TIndexOffU& bot)
+	{
+		assert_lt(c, 4);
+		SideLocus ltop, lbot;
+		SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+		if(top+1 == bot) {
+			top = bot = ebwt.mapLF1(top, ltop, c);
+			if(bot == OFF_MASK) top = bot = 0;
+			else bot++;
+		} else {
+			top = ebwt.mapLF(ltop, c);
+			bot = ebwt.mapLF(lbot, c);
+		}
+	}
+
+	/**
+	 * Match the query exactly from the 3' end to depth 'lim', starting
+	 * from the deepest range shared with the previous query against
+	 * this index in this orientation and recording the new path for
+	 * the next one.  Stops early at an N or where the next range would
+	 * be empty, leaving those for backtrack() to deal with.  Sets
+	 * 'depth', 'top' and 'bot' to where it stopped.
+	 */
+	void walkSharedPath(uint32_t lim, uint32_t& depth, TIndexOffU& top, TIndexOffU& bot) {
+		const Ebwt<String<Dna> >& ebwt = *_ebwt;
+		const uint32_t ftabChars = (uint32_t)ebwt._eh._ftabChars;
+		assert_geq(lim, ftabChars);
+		assert_lt(lim, _qlen);
+		SharedPath& sp = _paths[(ebwt.fw() ? 0 : 2) + (_params.fw() ? 0 : 1)];
+		if(sp.ebwt != _ebwt) {
+			sp.ebwt = _ebwt;
+			sp.chars.clear();
+			sp.tops.clear();
+			sp.bots.clear();
+		}
+		// How much of the previous path is ours too?
+		uint32_t d = 0;
+		const uint32_t have = min<uint32_t>((uint32_t)sp.chars.size(), lim);
+		while(d < have && sp.chars[d] == (uint8_t)(int)(*_qry)[_qlen - d - 1]) d++;
+		if(d < ftabChars) {
+			uint32_t ftabOff = calcFtabOff();
+			top = ebwt.ftabHi(ftabOff);
+			bot = ebwt.ftabLo(ftabOff+1);
+			sp.chars.resize(ftabChars);
+			for(d = 0; d < ftabChars; d++) {
+				sp.chars[d] = (uint8_t)(int)(*_qry)[_qlen - d - 1];
+			}
+			sp.tops.assign(1, top);
+			sp.bots.assign(1, bot);
+		} else {
+			top = sp.tops[d - ftabChars];
+			bot = sp.bots[d - ftabChars];
+			sp.chars.resize(d);
+			sp.tops.resize(d - ftabChars + 1);
+			sp.bots.resize(d - ftabChars + 1);
+		}
+		while(d < lim && bot > top) {
+			int c = (int)(*_qry)[_qlen - d - 1];
+			if(c == 4) break;
+			SideLocus ltop, lbot;
+			SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+			TIndexOffU ntop, nbot;
+			if(top+1 == bot) {
+				ntop = nbot = ebwt.mapLF1(top, ltop, c);
+				if(nbot == OFF_MASK) break;
+				nbot++;
+			} else {
+				ntop = ebwt.mapLF(ltop, c);
+				nbot = ebwt.mapLF(lbot, c);
+				if(nbot <= ntop) break;
+			}
+			sp.chars.push_back((uint8_t)c);
+			sp.tops.push_back(ntop);
+			sp.bots.push_back(nbot);
+			top = ntop;
+			bot = nbot;
+			d++;
+		}
+		depth = d;
+	}
+
 	/**
 	 * If there are any buffered results that have yet to be committed,
 	 * commit them.  This happens when looking for partial alignments.
@@ -1172,9 +1423,9 @@ protected:
 				// This mismatch falls within the seed; count it
 				// toward the stratum to report
 				stratum++;
-				// Don't currently support more than 3
+				// Only the search-scheme engine goes past 3
 				// mismatches in the seed
-				assert_leq(stratum, 3);
+				assert_leq(stratum, SEARCH_SCHEME_MAX_MMS);
 			}
 		}
 		return stratum;
@@ -1344,6 +1595,162 @@ protected:
 		return true;
 	}
 
+	/**
+	 * Begin search 's' at the right end of its first piece.  If the
+	 * first steps grow the region to the left without mismatches for
+	 * at least ftabChars chars, look those chars up in both ftabs.
+	 */
+	bool bidirStart(const BidirSearch& s) {
+		const uint32_t ftabChars = (uint32_t)_ebwt->_eh._ftabChars;
+		const uint32_t pe = _pieceOffs[s.order[0] + 1];
+		uint32_t exact = pe; // start of the stretch that must match exactly
+		for(int i = 0; i < s.pieces && s.left(i); i++) {
+			if(s.lo[i] > 0 || s.pieceLo[i] > 0) break;
+			if(s.hi[i] > 0 && s.pieceHi[i] > 0) break;
+			exact = _pieceOffs[s.order[i]];
+		}
+		TIndexOffU ftop = 0, fbot = 0, btop = 0, bbot = 0;
+		uint32_t l = pe;
+		int step = 0;
+		if(pe - exact >= ftabChars) {
+			uint32_t fwOff = 0, bwOff = 0;
+			for(uint32_t i = 0; i < ftabChars; i++) {
+				int c = (int)(*_qry)[pe - ftabChars + i];
+				if(c == 4) return false; // N where no mismatch is allowed
+				fwOff = (fwOff << 2) | c;
+				bwOff |= (c << (2 * i));
+			}
+			ftop = _ebwt->ftabHi(fwOff);
+			fbot = _ebwt->ftabLo(fwOff + 1);
+			if(fbot <= ftop) return false;
+			if(_lastRight > 0) {
+				btop = _ebwtBw->ftabHi(bwOff);
+				bbot = _ebwtBw->ftabLo(bwOff + 1);
+				assert_eq(fbot - ftop, bbot - btop);
+			}
+			l -= ftabChars;
+			while(l < _pieceOffs[s.order[step]]) step++;
+		}
+		return bidirExtend(s, step, l, pe, ftop, fbot, btop, bbot, 0, 0);
+	}
+
+	/**
+	 * Grow the region [l, r) of the query in step 'step' of search
+	 * 's'.  The region is aligned with 'mms' mismatches, 'pmms' of them
+	 * in the step's piece, and matches rows [ftop, fbot) of the forward
+	 * index and [btop, bbot) of the mirror index; bot == 0 means the
+	 * region is empty.  The mirror range is only kept up to date while
+	 * a later step still grows the region to the right.
+	 */
+	bool bidirExtend(const BidirSearch& s, int step,
+	                 uint32_t l, uint32_t r,
+	                 TIndexOffU ftop, TIndexOffU fbot,
+	                 TIndexOffU btop, TIndexOffU bbot,
+	                 int mms, int pmms)
+	{
+		const int piece = s.order[step];
+		const bool left = s.left(step);
+		const int rem = (int)(left ? (l - _pieceOffs[piece]) :
+		                             (_pieceOffs[piece + 1] - r));
+		if(rem == 0) {
+			// Done with this piece
+			if(mms < s.lo[step] || pmms < s.pieceLo[step]) return false;
+			if(step + 1 == s.pieces) {
+				assert_eq(0, l);
+				assert_eq(_qlen, r);
+				return reportAlignment(mms, ftop, fbot, 0);
+			}
+			return bidirExtend(s, step + 1, l, r, ftop, fbot, btop, bbot, mms, 0);
+		}
+		if(mms + rem < s.lo[step] || pmms + rem < s.pieceLo[step]) {
+			return false; // can't pick up enough mismatches in this piece
+		}
+		const uint32_t q = left ? l - 1 : r; // query offset to match next
+		const int qc = (int)(*_qry)[q];
+		const bool canMm = mms < s.hi[step] && pmms < s.pieceHi[step];
+		const bool sync = !left || step < _lastRight;
+		if(!canMm && !sync) {
+			// Only an exact match can follow, and only the forward
+			// range matters from here on
+			if(qc == 4) return false;
+			if(fbot == 0) {
+				ftop = _ebwt->fchr()[qc];
+				fbot = _ebwt->fchr()[qc + 1];
+			} else {
+				mapRange(*_ebwt, qc, ftop, fbot);
+			}
+			if(fbot <= ftop) return false;
+			return bidirExtend(s, step, l - 1, r, ftop, fbot, 0, 0, mms, pmms);
+		}
+		// Ranges for each char in the index the region grows through,
+		// and where they start in the other index
+		const Ebwt<String<Dna> >& ebwt = left ? *_ebwt : *_ebwtBw;
+		const TIndexOffU top = left ? ftop : btop;
+		const TIndexOffU bot = left ? fbot : bbot;
+		TIndexOffU tops[4] = {0, 0, 0, 0}, bots[4] = {0, 0, 0, 0};
+		TIndexOffU otops[4] = {0, 0, 0, 0};
+		if(bot == 0) {
+			for(int c = 0; c < 4; c++) {
+				tops[c] = otops[c] = ebwt.fchr()[c];
+				bots[c] = ebwt.fchr()[c + 1];
+				assert(!sync || (left ? _ebwtBw : _ebwt)->fchr()[c] == tops[c]);
+			}
+		} else {
+			SideLocus ltop, lbot;
+			SideLocus::initFromTopBot(top, bot, ebwt._eh, ebwt._ebwt, ltop, lbot);
+			ebwt.mapLFEx(ltop, lbot, tops, bots);
+			if(sync) {
+				// The other index orders the region's rows by the char
+				// on this side of it; the row (if any) for the
+				// occurrence that meets the end of the text comes last
+				TIndexOffU o = left ? btop : ftop;
+				for(int c = 0; c < 4; c++) {
+					otops[c] = o;
+					o += bots[c] - tops[c];
+				}
+				if(top <= ebwt.zOff() && ebwt.zOff() < bot) o++;
+				assert_eq(o, (left ? btop : ftop) + (bot - top));
+			}
+		}
+		if(qc < 4 && bots[qc] > tops[qc]) {
+			if(bidirChild(s, step, left, sync, l, r, tops[qc], bots[qc],
+			              otops[qc], mms, pmms))
+			{
+				return true;
+			}
+		}
+		if(!canMm) return false;
+		for(int c = 0; c < 4; c++) {
+			if(c == qc || bots[c] <= tops[c]) continue;
+			_mms.push_back(q);
+			_refcs.push_back("acgt"[c]);
+			bool ret = bidirChild(s, step, left, sync, l, r, tops[c], bots[c],
+			                      otops[c], mms + 1, pmms + 1);
+			_mms.pop_back();
+			_refcs.pop_back();
+			if(ret) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Continue search 's' after growing the region by one char whose
+	 * rows are [top, bot) in the index the region grew through and
+	 * start at 'otop' in the other.
+	 */
+	bool bidirChild(const BidirSearch& s, int step, bool left, bool sync,
+	                uint32_t l, uint32_t r,
+	                TIndexOffU top, TIndexOffU bot, TIndexOffU otop,
+	                int mms, int pmms)
+	{
+		const TIndexOffU obot = sync ? otop + (bot - top) : 0;
+		if(!sync) otop = 0;
+		if(left) {
+			return bidirExtend(s, step, l - 1, r, top, bot, otop, obot, mms, pmms);
+		}
+		return bidirExtend(s, step, l, r + 1, otop, obot, top, bot, mms, pmms);
+	}
+
 	/**
 	 * Calculate the offset into the ftab for the rightmost 'ftabChars'
 	 * characters of the current query. Rightmost char gets least
@@ -1484,7 +1891,7 @@ protected:
 		if(stackDepth > 0) {
 			stratum = calcStratum(_mms, stackDepth);
 		}
-		assert_lt(stratum, 4);
+		assert_leq(stratum, SEARCH_SCHEME_MAX_MMS);
 		assert_geq(stratum, 0);
 		bool hit;
 		// If _muts != NULL then this alignment extends a partial
@@ -1500,8 +1907,8 @@ protected:
 			// All muts are in the seed, so they count toward the stratum
 			size_t numMuts = length(*_muts);
 			stratum += numMuts;
-			cost |= (stratum << 14);
-			assert_geq(cost, (uint32_t)(stratum << 14));
+			cost |= stratumCost(stratum);
+			assert_geq(cost, (uint32_t)stratumCost(stratum));
 			// Report the range of full alignments
 			hit = reportFullAlignment((uint32_t)(stackDepth + numMuts), top, bot, stratum, cost);
 			// Re-apply partial-alignment mutations
@@ -1509,8 +1916,8 @@ protected:
 			assert_eq(tmp, (*_qry));
 		} else {
 			// Report the range of full alignments
-			cost |= (stratum << 14);
-			assert_geq(cost, (uint32_t)(stratum << 14));
+			cost |= stratumCost(stratum);
+			assert_geq(cost, (uint32_t)stratumCost(stratum));
 			hit = reportFullAlignment(stackDepth, top, bot, stratum, cost);
 		}
 		return hit;
@@ -1540,21 +1947,42 @@ protected:
 		TIndexOffU spread = bot - top;
 		// Pick a random spot in the range to begin report
 		TIndexOffU r = top + (_rand.nextU<TIndexOffU>() % spread);
+		// Wide ranges are likely to come up again for other reads, so
+		// share the work of resolving them through the range cache
+		RangeCache *cache = _ebwt->fw() ? _cacheFw : _cacheBw;
+		bool cached = cache != NULL && spread > _cacheLimit &&
+		              cache->lookup(top, bot, _cacheEnt);
 		for(TIndexOffU i = 0; i < spread; i++) {
 			TIndexOffU ri = r + i;
 			if(ri >= bot) ri -= spread;
 			// reportChaseOne takes the _mms[] list in terms of
 			// their indices into the query string; not in terms
 			// of their offset from the 3' or 5' end.
-			assert_geq(cost, (uint32_t)(stratum << 14));
-			if(_ebwt->reportChaseOne((*_qry), _qual, _name,
-			                         _color, _primer, _trimc, colorExEnds,
-			                         snpPhred, _refs, _mms, _refcs,
-			                         stackDepth, ri, top, bot,
-			                         (uint32_t)_qlen, stratum, cost, _patid,
-			                         _seed, _params))
-			{
+			assert_geq(cost, (uint32_t)stratumCost(stratum));
+			bool stop;
+			if(cached) {
+				TIndexOffU off = _cacheEnt.get(ri - top);
+				if(off == RANGE_NOT_SET) {
+					off = RowChaser<DnaString>::toFlatRefOff(_ebwt, (TIndexOffU)_qlen, ri);
+					_cacheEnt.install(ri - top, off);
+				}
+				stop = _ebwt->report((*_qry), _qual, _name,
+				                     _color, _primer, _trimc, colorExEnds,
+				                     snpPhred, _refs, _mms, _refcs,
+				                     stackDepth, off, top, bot,
+				                     (uint32_t)_qlen, stratum, cost, _patid,
+				                     _seed, _params);
+			} else {
+				stop = _ebwt->reportChaseOne((*_qry), _qual, _name,
+				                             _color, _primer, _trimc, colorExEnds,
+				                             snpPhred, _refs, _mms, _refcs,
+				                             stackDepth, ri, top, bot,
+				                             (uint32_t)_qlen, stratum, cost, _patid,
+				                             _seed, _params);
+			}
+			if(stop) {
 				// Return value of true means that we can stop
+				_cacheEnt.reset();
 				return true;
 			}
 			// Return value of false means that we should continue
@@ -1565,6 +1993,7 @@ protected:
 			// didn't report a hit because the alignment was spurious
 			// (i.e. overlapped some padding).
 		}
+		_cacheEnt.reset();
 		// All range elements were examined and we should keep going
 		return false;
 	}
@@ -1782,6 +2211,29 @@ protected:
 	char                _primer;
 	char                _trimc;
 	uint32_t            _seed;
+	/// Shared caches of resolved offsets for each index (or NULL)
+	RangeCache         *_cacheFw;
+	RangeCache         *_cacheBw;
+	/// Only ranges with more than this many rows use _cache
+	uint32_t            _cacheLimit;
+	/// Entry for the range being reported
+	RangeCacheEntry     _cacheEnt;
+	/// Resume searches from the previous query's path?
+	bool                _sharePaths;
+	/// Previous paths, by index direction and read orientation
+	SharedPath          _paths[4];
+	/// Shared k-mer tables for each index (or NULL)
+	KmerTable          *_kmerFw;
+	KmerTable          *_kmerBw;
+	/// K-mer lookups that did and didn't hit, by index direction
+	uint64_t            _kmerHits[2];
+	uint64_t            _kmerMisses[2];
+	/// Mirror index paired with _ebwt by bidirSearch()
+	const Ebwt<String<Dna> >* _ebwtBw;
+	/// Query offsets where the pieces of the current search start
+	uint32_t            _pieceOffs[SEARCH_SCHEME_MAX_PIECES + 1];
+	/// Last step of the current search that grows its region rightward
+	int                 _lastRight;
 #ifndef NDEBUG
 	std::set<TIndexOff> allTops_;
 #endif
@@ -3,7 +3,6 @@
 
 #include <iostream>
 #include <vector>
-#include <map>
 #include <stdint.h>
 #include <seqan/sequence.h>
 #include "hit.h"
@@ -161,13 +160,23 @@ void printHit(const vector<String<Dna5> >& os,
 			  bool ebwtFw);
 
 /**
- * A synchronized data structure for storing partial alignments
- * associated with patids, with particular attention to compactness.
+ * Stores the partial alignments that one search thread finds for the
+ * reads it has in flight, keyed by patid.  Each search thread owns its
+ * own manager, so nothing is locked.  The seeded search only ever has
+ * one read's partials in here at a time, so a patid is found by a
+ * short scan; the storage is reused from read to read.
  */
 class PartialAlignmentManager {
+
+	/// Where a patid's partial alignments are in _partialsList
+	struct Extent {
+		uint32_t patid;
+		uint32_t off;
+		uint32_t len;
+	};
+
 public:
-	PartialAlignmentManager(size_t listSz = 10 * 1024 * 1024) {
-		// Reserve space for 10M partialsList entries = 40 MB
+	PartialAlignmentManager(size_t listSz = 64) {
 		_partialsList.reserve(listSz);
 	}
 
@@ -175,61 +184,32 @@ public:
 
 	/**
 	 * Add a set of partial alignments for a particular patid into the
-	 * partial-alignment database.  This version locks the database,
-	 * and so is safe to call if there are potential readers or
-	 * writers currently running.
+	 * partial-alignment database.
 	 */
 	void addPartials(uint32_t patid, const vector<PartialAlignment>& ps) {
 		if(ps.size() == 0) return;
-		ThreadSafe _ts(&mutex_m);
-		size_t origPlSz = _partialsList.size();
 		// Assert that the entry doesn't exist yet
-		assert(_partialsMap.find(patid) == _partialsMap.end());
-		if(ps.size() == 1) {
-			_partialsMap[patid] = ps[0];
-			_partialsMap[patid].entry.type = 0; // singleton
-		} else {
-#ifndef NDEBUG
-			// Make sure there are not duplicate entries
-			for(size_t i = 0; i < ps.size()-1; i++)
-				for(size_t j = i+1; j < ps.size(); j++)
-					assert(!samePartialAlignment(ps[i], ps[j]));
-#endif
-			// Insert a "pointer" record into the map that refers to
-			// the stretch of the _partialsList vector that contains
-			// the partial alignments.
-			PartialAlignment al;
-			al.u64.u64 = 0xffffffffffffffffllu;
-			al.off.off = origPlSz;
-			al.off.type = 1; // list offset
-			_partialsMap[patid] = al; // install pointer
-			assert_gt(ps.size(), 1);
-			// Now add all the non-tail partial alignments (all but the
-			// last) to the _partialsList
-			for(size_t i = 0; i < ps.size()-1; i++) {
-				assert(validPartialAlignment(ps[i]));
-				_partialsList.push_back(ps[i]);
-				// list entry (non-tail)
-				_partialsList.back().entry.type = 2;
-			}
-			// Now add the tail (last) partial alignment and mark it as
-			// such
-			assert(validPartialAlignment(ps.back()));
-			_partialsList.push_back(ps.back());
-			// list tail
-			_partialsList.back().entry.type = 3;
+		assert(find(patid) == NULL);
 #ifndef NDEBUG
-			// Make sure there are not duplicate entries
-			assert_eq(_partialsList.size(), origPlSz + ps.size());
-			for(size_t i = origPlSz; i < _partialsList.size()-1; i++) {
-				for(size_t j = i+1; j < _partialsList.size(); j++) {
-					assert(!samePartialAlignment(_partialsList[i], _partialsList[j]));
-				}
-			}
+		// Make sure there are not duplicate entries
+		for(size_t i = 0; i+1 < ps.size(); i++)
+			for(size_t j = i+1; j < ps.size(); j++)
+				assert(!samePartialAlignment(ps[i], ps[j]));
 #endif
+		Extent e;
+		e.patid = patid;
+		e.off = (uint32_t)_partialsList.size();
+		e.len = (uint32_t)ps.size();
+		_extents.push_back(e);
+		for(size_t i = 0; i < ps.size(); i++) {
+			assert(validPartialAlignment(ps[i]));
+			_partialsList.push_back(ps[i]);
+			// singleton, list entry (non-tail) or list tail
+			_partialsList.back().entry.type =
+				(ps.size() == 1) ? 0 : ((i+1 < ps.size()) ? 2 : 3);
 		}
 		// Assert that we added an entry
-		assert(_partialsMap.find(patid) != _partialsMap.end());
+		assert(find(patid) != NULL);
 	}
 
 	/**
@@ -238,69 +218,33 @@ public:
 	 */
 	void getPartials(uint32_t patid, vector<PartialAlignment>& ps) {
 		assert_eq(0, ps.size());
-		ThreadSafe _ts(&mutex_m);
-		getPartialsUnsync(patid, ps);
-	}
-
-	/**
-	 * Get a set of partial alignments for a particular patid out of
-	 * the partial-alignment database.  This version does not attempt to
-	 * lock the database.  This is more efficient than the synchronized
-	 * version, but is unsafe if there are other threads that may be
-	 * writing to the database.
-	 */
-	void getPartialsUnsync(uint32_t patid, vector<PartialAlignment>& ps) {
-		assert_eq(0, ps.size());
-		if(_partialsMap.find(patid) == _partialsMap.end()) {
-			return;
-		}
-		PartialAlignment al;
-		al.u64.u64 = _partialsMap[patid].u64.u64;
-		uint32_t type = al.unk.type;
-		if(type == 0) {
-			// singleton
-			ps.push_back(al);
-		} else {
-			// list
-			assert_eq(1, type);
-			uint32_t off = (uint32_t)al.off.off;
-			do {
-				assert_lt(off, _partialsList.size());
-				ASSERT_ONLY(type = _partialsList[off].entry.type);
-				assert(type == 2 || type == 3);
+		const Extent *e = find(patid);
+		if(e == NULL) return;
+		for(uint32_t off = e->off; off < e->off + e->len; off++) {
+			assert_lt(off, _partialsList.size());
 #ifndef NDEBUG
-				// Make sure this entry isn't equal to any other entry
-				for(size_t i = 0; i < ps.size(); i++) {
-					assert(validPartialAlignment(ps[i]));
-					assert(!samePartialAlignment(ps[i], _partialsList[off]));
-				}
+			// Make sure this entry isn't equal to any other entry
+			for(size_t i = 0; i < ps.size(); i++) {
+				assert(validPartialAlignment(ps[i]));
+				assert(!samePartialAlignment(ps[i], _partialsList[off]));
+			}
 #endif
-				assert(validPartialAlignment(_partialsList[off]));
-				ps.push_back(_partialsList[off]);
-				ASSERT_ONLY(uint32_t pos0 = ps.back().entry.pos0);
-				ASSERT_ONLY(uint32_t pos1 = ps.back().entry.pos1);
-				ASSERT_ONLY(uint32_t pos2 = ps.back().entry.pos2);
-				assert(pos1 == 0xffff || pos0 != pos1);
-				assert(pos2 == 0xffff || pos0 != pos2);
-				assert(pos2 == 0xffff || pos1 != pos2);
-			} while(_partialsList[off++].entry.type == 2);
-			assert_eq(3, _partialsList[off-1].entry.type);
+			assert(validPartialAlignment(_partialsList[off]));
+			ps.push_back(_partialsList[off]);
 		}
 		assert_gt(ps.size(), 0);
 	}
 
 	/// Call to clear the database when there is only one element in it
 	void clear(uint32_t patid) {
-		assert_eq(1, _partialsMap.count(patid));
-		assert_eq(1, _partialsMap.size());
-		_partialsMap.erase(patid);
-		assert_eq(0, _partialsMap.size());
+		assert_eq(1, _extents.size());
+		assert(find(patid) != NULL);
+		_extents.clear();
 		_partialsList.clear();
-		assert_eq(0, _partialsList.size());
 	}
 
 	size_t size() {
-		return _partialsMap.size();
+		return _extents.size();
 	}
 
 	/**
@@ -360,13 +304,22 @@ public:
 		return oldQuals;
 	}
 private:
-	/// Maps patids to partial alignments for that patid
-	map<uint32_t, PartialAlignment> _partialsMap;
-	/// Overflow for when a patid has more than 1 partial alignment
+
+	/**
+	 * Return the extent of patid's partial alignments, or NULL if it
+	 * has none.
+	 */
+	const Extent* find(uint32_t patid) const {
+		for(size_t i = 0; i < _extents.size(); i++) {
+			if(_extents[i].patid == patid) return &_extents[i];
+		}
+		return NULL;
+	}
+
+	/// Which patids have partial alignments, and where
+	vector<Extent> _extents;
+	/// Partial alignments of all those patids, back to back
 	vector<PartialAlignment> _partialsList;
-	/// Lock for 'partialsMap' and 'partialsList'; necessary because
-	/// search threads will be reading and writing them
-	MUTEX_T mutex_m;
 };
 
 #endif /* EBWT_SEARCH_UTIL_H_ */
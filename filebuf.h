@@ -540,11 +540,12 @@ public:
 	~OutFileBuf() { close(); }
 
 	/**
-	 * Open a new output stream to a file with given name.
+	 * Open a new output stream to a file with given name, appending to
+	 * it rather than truncating it if append is true.
 	 */
-	void setFile(const char *out, bool binary = false) {
+	void setFile(const char *out, bool binary = false, bool append = false) {
 		assert(out != NULL);
-		out_ = fopen(out, binary ? "wb" : "w");
+		out_ = fopen(out, append ? (binary ? "ab" : "a") : (binary ? "wb" : "w"));
 		if(out_ == NULL) {
 			std::cerr << "Error: Could not open alignment output file " << out << std::endl;
 			throw 1;
@@ -1,5 +1,13 @@
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/resource.h>
+#endif
 #include "hit.h"
 #include "hit_set.h"
+#include "dup_cache.h"
 #include "search_globals.h"
 
 using namespace std;
@@ -10,6 +18,200 @@ bool operator< (const Hit& a, const Hit& b) {
 	return a.h < b.h;
 }
 
+/**
+ * Turn on sharded output.  The directory is created if it doesn't
+ * already exist.
+ */
+void HitSink::setShards(
+	const string& dir,
+	uint64_t shardLen,
+	const string& ext,
+	int offBase,
+	uint64_t partLen)
+{
+	assert(!dir.empty());
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0777);
+#endif
+	struct stat st;
+	if(stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+		cerr << "Error: Could not create --shard-out directory " << dir << endl;
+		throw 1;
+	}
+	shardDir_ = dir;
+	shardLen_ = shardLen;
+	shardExt_ = ext;
+	shardOffBase_ = offBase;
+	shardPartLen_ = partLen;
+	// Small ranges can mean more shard files than we may hold open, so
+	// keep at most half the file descriptor limit open and reopen the
+	// rest for appending as needed
+	maxOpenShards_ = 256;
+#ifndef _WIN32
+	struct rlimit rl;
+	if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+		maxOpenShards_ = max<size_t>((size_t)rl.rlim_cur / 2, 1);
+	}
+#endif
+	ptShards_.resize(nthreads_);
+}
+
+void HitSink::shardRecord(size_t threadId, uint64_t refid, uint64_t off) {
+	assert(sharded());
+	bool ranged = (refid != ~(uint64_t)0 && shardLen_ > 0);
+	uint64_t pos = off + shardOffBase_;
+	uint64_t range = ranged ? pos / shardLen_ : 0;
+	BTString& o = ptBufs_[threadId];
+	size_t beg = 0;
+	while(beg < o.length()) {
+		size_t end = beg;
+		while(end < o.length() && o[end] != '\n') end++;
+		if(end < o.length()) end++;
+		HitShardBuf& sb = shardBuf(threadId, TShardKey(refid, range));
+		sb.buf.append(o.buf() + beg, end - beg);
+		if(++sb.count >= (size_t)perThreadBufSize_ || nthreads_ == 1) {
+			flushShard(sb);
+		}
+		beg = end;
+		if(ranged && shardPartLen_ > 0) {
+			// The next line is the same alignment printed for the
+			// next partition; file it by where that partition starts
+			pos = (pos / shardPartLen_ + 1) * shardPartLen_;
+			range = pos / shardLen_;
+		}
+	}
+	o.clear();
+}
+
+HitShardBuf& HitSink::shardBuf(size_t threadId, const TShardKey& key) {
+	HitShardBuf& sb = ptShards_[threadId][key];
+	if(sb.shard == NULL) {
+		// First record this thread has seen for this shard; find the
+		// shard, opening its file if no thread has done so yet
+		ThreadSafe _ts(&shardsLock_);
+		HitShard*& sh = shards_[key];
+		if(sh == NULL) {
+			ostringstream fn;
+			fn << shardDir_ << "/";
+			if(key.first == ~(uint64_t)0) {
+				fn << "unaligned";
+			} else {
+				fn << key.first;
+				if(_refnames != NULL && key.first < _refnames->size()) {
+					// Append the reference name up to the first
+					// whitespace, minus any characters that don't
+					// belong in a file name
+					const string& nm = (*_refnames)[key.first];
+					fn << '_';
+					for(size_t i = 0; i < nm.length() && !isspace(nm[i]); i++) {
+						fn << ((isalnum(nm[i]) || nm[i] == '.' || nm[i] == '-') ? nm[i] : '_');
+					}
+				}
+				if(shardLen_ > 0) {
+					fn << '_' << key.second;
+				}
+			}
+			fn << shardExt_;
+			sh = new HitShard(fn.str());
+			if(!shardHeader_.empty()) {
+				sh->out.writeString(shardHeader_);
+			}
+			openShards_.push_front(sh);
+			sh->lru = openShards_.begin();
+			touchShard(sh);
+		}
+		sb.shard = sh;
+	}
+	return sb;
+}
+
+void HitSink::flushShard(HitShardBuf& sb) {
+	HitShard *sh = sb.shard;
+	if(sh != NULL && !sb.buf.empty()) {
+		{
+			// Pin the shard's file open while we write to it
+			ThreadSafe _ts(&shardsLock_);
+			touchShard(sh);
+			sh->pins++;
+		}
+		{
+			ThreadSafe _ts(&sh->lock);
+			sh->out.writeString(sb.buf);
+		}
+		ThreadSafe _ts(&shardsLock_);
+		assert_gt(sh->pins, 0);
+		sh->pins--;
+	}
+	sb.buf.clear();
+	sb.count = 0;
+}
+
+void HitSink::touchShard(HitShard *sh) {
+	if(sh->out.closed()) {
+		sh->out.setFile(sh->fname_.c_str(), false, true);
+		openShards_.push_front(sh);
+		sh->lru = openShards_.begin();
+	} else if(sh->lru != openShards_.begin()) {
+		openShards_.splice(openShards_.begin(), openShards_, sh->lru);
+	}
+	list<HitShard*>::iterator it = openShards_.end();
+	while(openShards_.size() > maxOpenShards_ && it != openShards_.begin()) {
+		--it;
+		HitShard *old = *it;
+		if(old == sh || old->pins > 0) continue;
+		// No thread can be writing an unpinned shard
+		old->out.close();
+		it = openShards_.erase(it);
+	}
+}
+
+void HitSink::closeShards() {
+	for(size_t i = 0; i < ptShards_.size(); i++) {
+		for(map<TShardKey, HitShardBuf>::iterator it = ptShards_[i].begin();
+		    it != ptShards_[i].end(); ++it)
+		{
+			flushShard(it->second);
+		}
+		ptShards_[i].clear();
+	}
+	for(map<TShardKey, HitShard*>::iterator it = shards_.begin();
+	    it != shards_.end(); ++it)
+	{
+		it->second->out.close();
+		delete it->second;
+	}
+	shards_.clear();
+	openShards_.clear();
+}
+
+void HitSinkPerThread::rememberRead(PatternSourcePerThread& p, uint32_t ret) {
+	if(DupReadCache::cacheable(p.bufa())) {
+		_sink.dupCache()->insert(p.bufa(), ret, _bufferedHits);
+	}
+}
+
+bool HitSinkPerThread::replayDuplicate(PatternSourcePerThread& p) {
+	DupReadCache *cache = _sink.dupCache();
+	const Read& r = p.bufa();
+	if(cache == NULL || !DupReadCache::cacheable(r)) return false;
+	assert_eq(0, _bufferedHits.size());
+	uint32_t ret = 0;
+	if(!cache->lookup(r, ret, _bufferedHits)) return false;
+	// The cached hits are anonymous; make them this read's
+	for(size_t i = 0; i < _bufferedHits.size(); i++) {
+		Hit& h = _bufferedHits[i];
+		h.patId   = (uint32_t)p.rdid();
+		h.patName = r.name;
+		h.patSeq  = h.fw ? r.patFw : r.patRc;
+		h.quals   = h.fw ? r.qual : r.qualRev;
+		h.seed    = r.seed;
+	}
+	flushRead(p, ret, true);
+	return true;
+}
+
 /**
  * Report a maxed-out read.
  */
@@ -233,20 +435,19 @@ void VerboseHitSink::append(
 			const size_t len = length(h.patSeq);
 			// Output mismatch column
 			bool firstmm = true;
-			for (unsigned int i = 0; i < len; ++ i) {
-				if(h.mms.test(i)) {
-					// There's a mismatch at this position
-					if (!firstmm) {
-						o << ",";
-					}
-					o << i; // position
-					assert_gt(h.refcs.size(), i);
-					char refChar = toupper(h.refcs[i]);
-					char qryChar = (h.fw ? h.patSeq[i] : h.patSeq[length(h.patSeq)-i-1]);
-					assert_neq(refChar, qryChar);
-					o << ":" << refChar << ">" << qryChar;
-					firstmm = false;
+			for (size_t j = 0; j < h.mms.size(); ++ j) {
+				// There's a mismatch at this position
+				const unsigned int i = h.mms[j].pos;
+				assert_lt(i, len);
+				if (!firstmm) {
+					o << ",";
 				}
+				o << i; // position
+				char refChar = toupper((char)h.mms[j].chr);
+				char qryChar = (h.fw ? h.patSeq[i] : h.patSeq[len-i-1]);
+				assert_neq(refChar, qryChar);
+				o << ":" << refChar << ">" << qryChar;
+				firstmm = false;
 			}
 			if(partition != 0 && firstmm) o << '-';
 		}
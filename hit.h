@@ -18,7 +18,10 @@
 #include "filebuf.h"
 #include "edit.h"
 #include "sstring.h"
+#include "hit_sort.h"
 #include <algorithm>
+#include <list>
+#include <map>
 
 /**
  * Classes for dealing with reporting alignments.
@@ -27,6 +30,8 @@
 using namespace std;
 using namespace seqan;
 
+class DupReadCache;
+
 /// Constants for the various output modes
 enum output_types {
 	OUTPUT_FULL = 1,
@@ -46,6 +51,106 @@ static const std::string output_type_names[] = {
 
 typedef pair<TIndexOffU,TIndexOffU> UPair;
 
+/**
+ * A hit's mismatches, sorted by position.  The first few are held
+ * inline so that typical alignments don't allocate; more spill to
+ * the heap.
+ */
+class HitEdits {
+public:
+	/// # edits held without allocating
+	static const uint32_t INLINE = 5;
+
+	HitEdits() : n_(0), cap_(INLINE), heap_(NULL) { }
+
+	HitEdits(const HitEdits& o) : n_(0), cap_(INLINE), heap_(NULL) {
+		*this = o;
+	}
+
+	~HitEdits() {
+		delete[] heap_;
+	}
+
+	HitEdits& operator=(const HitEdits& o) {
+		if(&o == this) return *this;
+		n_ = 0;
+		reserve(o.n_);
+		for(uint32_t i = 0; i < o.n_; i++) buf()[i] = o[i];
+		n_ = o.n_;
+		return *this;
+	}
+
+	/**
+	 * Record that position 'pos' mismatches reference character 'chr',
+	 * replacing any edit already recorded there.
+	 */
+	void set(uint32_t pos, int chr) {
+		assert_lt(pos, 1023);
+		Edit *es = buf();
+		uint32_t i = n_;
+		while(i > 0 && es[i-1].pos > pos) i--;
+		if(i > 0 && es[i-1].pos == pos) {
+			es[i-1] = Edit(pos, chr);
+			return;
+		}
+		reserve(n_ + 1);
+		es = buf();
+		for(uint32_t j = n_; j > i; j--) es[j] = es[j-1];
+		es[i] = Edit(pos, chr);
+		n_++;
+	}
+
+	/**
+	 * Return true iff there's an edit at position 'pos'.
+	 */
+	bool test(uint32_t pos) const {
+		for(uint32_t i = 0; i < n_; i++) {
+			if((*this)[i].pos == pos) return true;
+		}
+		return false;
+	}
+
+	void clear() { n_ = 0; }
+	size_t size() const { return n_; }
+	bool empty() const { return n_ == 0; }
+
+	const Edit& operator[](size_t i) const {
+		assert_lt(i, n_);
+		return heap_ != NULL ? heap_[i] : inline_[i];
+	}
+
+private:
+
+	Edit* buf() { return heap_ != NULL ? heap_ : inline_; }
+
+	/**
+	 * Make room for at least 'n' edits.
+	 */
+	void reserve(uint32_t n) {
+		if(n <= cap_) return;
+		uint32_t cap = cap_ * 2;
+		while(cap < n) cap *= 2;
+		Edit *es = new Edit[cap];
+		for(uint32_t i = 0; i < n_; i++) es[i] = buf()[i];
+		delete[] heap_;
+		heap_ = es;
+		cap_ = cap;
+	}
+
+	uint32_t n_;    /// # edits
+	uint32_t cap_;  /// # edits that fit in inline_ or heap_
+	Edit*    heap_; /// edits, once there are more than INLINE
+	Edit     inline_[INLINE];
+};
+
+/**
+ * Return the cost bits that put an alignment in 'stratum'.  The cost
+ * only has 2 bits for the stratum, so strata past 3 share them with 3.
+ */
+static inline uint16_t stratumCost(int stratum) {
+	return (uint16_t)(std::min(stratum, 3) << 14);
+}
+
 /**
  * Encapsulates a hit, including a text-id/text-offset pair, a pattern
  * id, and a boolean indicating whether it matched as its forward or
@@ -63,10 +168,8 @@ public:
 	String<Dna5>        colSeq;  /// original color sequence, not decoded
 	String<char>        quals;   /// read qualities
 	String<char>        colQuals;/// original color qualities, not decoded
-	FixedBitset<1024>   mms;     /// nucleotide mismatch mask
-	FixedBitset<1024>   cmms;    /// color mismatch mask (if relevant)
-	vector<char>        refcs;   /// reference characters for mms
-	vector<char>        crefcs;  /// reference characters for cmms
+	HitEdits            mms;     /// nucleotide mismatches & their ref chars
+	HitEdits            cmms;    /// color mismatches (if relevant)
 	uint32_t            oms;     /// # of other possible mappings; 0 -> this is unique
 	bool                fw;      /// orientation of read in alignment
 	bool                mfw;     /// orientation of mate in alignment
@@ -86,7 +189,7 @@ public:
 	 * throw an assertion.
 	 */
 	bool repOk() const {
-		assert_geq(cost, (uint32_t)(stratum << 14));
+		assert_geq(cost, (uint32_t)stratumCost(stratum));
 		return true;
 	}
 
@@ -103,8 +206,6 @@ public:
 		this->colQuals= other.colQuals;
 		this->mms     = other.mms;
 		this->cmms    = other.cmms;
-		this->refcs   = other.refcs;
-		this->crefcs  = other.crefcs;
 		this->oms     = other.oms;
 		this->fw      = other.fw;
 		this->mfw     = other.mfw;
@@ -139,6 +240,49 @@ public:
 /// Sort by text-id then by text-offset
 bool operator< (const Hit& a, const Hit& b);
 
+/**
+ * One thread's alignment tallies.  Each field is written only by the
+ * owning thread and read without locks by whoever is summarizing (the
+ * end-of-run summary or the --progress reporter).  Padded to a cache
+ * line so that threads updating their tallies don't share lines.
+ */
+struct HitSinkTallies {
+	volatile uint64_t numAligned;        /// reads with >= 1 reported alignment
+	volatile uint64_t numReported;       /// unpaired alignments reported
+	volatile uint64_t numReportedPaired; /// paired alignments reported (x2)
+	volatile uint64_t numUnaligned;      /// reads that failed to align
+	volatile uint64_t numMaxed;          /// reads with more than -m alignments
+	volatile uint64_t numCutoff;         /// reads whose --btsens budget ran out
+	volatile uint64_t bytesOut;          /// bytes of alignment records produced
+	char pad_[64 - 7 * sizeof(uint64_t)];
+};
+
+/**
+ * One output file of a sharded HitSink (--shard-out), holding the
+ * records for one range of one reference sequence.  Each shard has its
+ * own buffer and its own lock, so threads writing different shards
+ * don't contend.
+ */
+struct HitShard {
+	explicit HitShard(const std::string& fname) :
+		fname_(fname), out(fname_), lock(), pins(0), lru() { }
+	std::string fname_; /// name of the file; must outlive out
+	OutFileBuf  out;    /// output stream for this shard; closed while evicted
+	MUTEX_T     lock;   /// serializes writes to out
+	size_t      pins;   /// # threads about to write out; guarded by the sink's shardsLock_
+	std::list<HitShard*>::iterator lru; /// place in the sink's list of open shards
+};
+
+/**
+ * A thread's pending records for one shard.
+ */
+struct HitShardBuf {
+	HitShardBuf() : shard(NULL), buf(), count(0) { }
+	HitShard *shard; /// shard the records are destined for
+	BTString  buf;   /// records not yet written
+	size_t    count; /// # of times records were appended to buf
+};
+
 /**
  * Encapsulates an object that accepts hits, optionally retains them in
  * a vector, and does something else with them according to
@@ -170,16 +314,31 @@ public:
 		ptBufs_(),
 		ptCounts_(nthreads_),
 		perThreadBufSize_(perThreadBufSize),
-		ptNumAligned_(NULL),
-		reorder_(reorder)
+		ptTalliesBuf_(NULL),
+		ptTallies_(NULL),
+		reorder_(reorder),
+		sorter_(NULL),
+		shardDir_(),
+		shardLen_(0),
+		shardOffBase_(0),
+		shardPartLen_(0),
+		shardExt_(),
+		shardHeader_(),
+		shards_(),
+		openShards_(),
+		maxOpenShards_(0),
+		ptShards_(),
+		dupCache_(NULL),
+		batchOrder_(false),
+		ptHeld_(),
+		ptBatch_()
 	{
-		size_t nelt = 5 * nthreads_;
-		ptNumAligned_ = new uint64_t[nelt];
-		std::memset(reinterpret_cast<void*>(const_cast<uint64_t*>(ptNumAligned_)), 0, sizeof(uint64_t) * nelt);
-		ptNumReported_ = ptNumAligned_ + nthreads_;
-		ptNumReportedPaired_ = ptNumReported_ + nthreads_;
-		ptNumUnaligned_ = ptNumReportedPaired_ + nthreads_;
-		ptNumMaxed_ = ptNumUnaligned_ + nthreads_;
+		// Give each thread's tallies a cache line of its own
+		ptTalliesBuf_ = new char[(nthreads_ + 1) * sizeof(HitSinkTallies)];
+		size_t misalign = (size_t)ptTalliesBuf_ % sizeof(HitSinkTallies);
+		ptTallies_ = reinterpret_cast<HitSinkTallies*>(
+			ptTalliesBuf_ + (misalign == 0 ? 0 : sizeof(HitSinkTallies) - misalign));
+		std::memset(reinterpret_cast<void*>(ptTallies_), 0, sizeof(HitSinkTallies) * nthreads_);
 		ptBufs_.resize(nthreads_);
 		ptCounts_.resize(nthreads_, 0);
 		initDumps();
@@ -189,11 +348,17 @@ public:
 	 * Destroy HitSinkobject;
 	 */
 	virtual ~HitSink() {
-		if(ptNumAligned_ != NULL) {
-			delete[] ptNumAligned_;
-			ptNumAligned_ = NULL;
+		if(ptTalliesBuf_ != NULL) {
+			delete[] ptTalliesBuf_;
+			ptTalliesBuf_ = NULL;
+			ptTallies_ = NULL;
+		}
+		if(sorter_ != NULL) {
+			delete sorter_;
+			sorter_ = NULL;
 		}
 		closeOuts();
+		closeShards();
 		destroyDumps();
 	}
 
@@ -202,6 +367,77 @@ public:
 	 */
 	virtual void append(BTString& o, const Hit& h, int mapq, int xms) = 0;
 
+	/**
+	 * Hold all output records until finish() and then write them out
+	 * sorted by reference id and offset, with unaligned records last.
+	 * At most about memLimit bytes of records are kept in memory; the
+	 * rest are spilled to sorted runs in tmpDir.  Must be called before
+	 * any hits are reported.
+	 */
+	void setSort(size_t memLimit, const std::string& tmpDir) {
+		if(sorter_ != NULL) delete sorter_;
+		sorter_ = new HitSorter(nthreads_, memLimit, tmpDir);
+	}
+
+	/**
+	 * Return true iff output records are being sorted by coordinate.
+	 */
+	bool sorted() const { return sorter_ != NULL; }
+
+	/**
+	 * Instead of writing all records to the main output stream, write
+	 * them to one file per reference range in directory dir.  Each
+	 * reference is cut into ranges of shardLen bases (0 -> one range
+	 * per reference); a record goes to the range containing its
+	 * leftmost offset plus offBase, the base its offsets are printed
+	 * in.  partLen is the --partition size when alignments straddling
+	 * a partition boundary are printed once per partition (0 -> never).
+	 * Unaligned records go to a file of their own.  Must be called
+	 * before any hits are reported.
+	 */
+	void setShards(const std::string& dir, uint64_t shardLen, const std::string& ext,
+	               int offBase = 0, uint64_t partLen = 0);
+
+	/**
+	 * Return true iff records are written to per-range shard files.
+	 */
+	bool sharded() const { return !shardDir_.empty(); }
+
+	/**
+	 * Hold each thread's records until it moves on to its next batch
+	 * of reads, then write them in input order.  For use when reads
+	 * are searched in some other order within a batch.  Must be called
+	 * before any hits are reported.
+	 */
+	void setBatchOrder() {
+		batchOrder_ = true;
+		ptHeld_.resize(nthreads_);
+		ptBatch_.resize(nthreads_, std::numeric_limits<TReadId>::max());
+	}
+
+	/**
+	 * Called before a thread reports a read from the batch starting
+	 * with read 'batchRdid'.  Writes out the records held for the
+	 * thread's previous batch, if any.
+	 */
+	void enterBatch(size_t threadId, TReadId batchRdid) {
+		if(!batchOrder_ || ptBatch_[threadId] == batchRdid) return;
+		flush(threadId, false);
+		ptBatch_[threadId] = batchRdid;
+	}
+
+	/**
+	 * Remember each unpaired read's alignments in 'cache' and report
+	 * later copies of the same read from there.  The caller owns the
+	 * cache.  Must be called before any hits are reported.
+	 */
+	void setDupCache(DupReadCache *cache) { dupCache_ = cache; }
+
+	/**
+	 * Return the duplicate-read cache, or NULL if there isn't one.
+	 */
+	DupReadCache* dupCache() const { return dupCache_; }
+
 	/**
 	 * Add a number of alignments to the tally.  Tally shouldn't
 	 * include reads that fail to align either because they had 0
@@ -209,11 +445,12 @@ public:
 	 */
 	void tallyAlignments(size_t threadId, size_t numAl, bool paired) {
         assert(!paired || (numAl % 2) == 0);
-        ptNumAligned_[threadId] ++;
+		HitSinkTallies& t = ptTallies_[threadId];
+		t.numAligned++;
 		if(paired) {
-			ptNumReportedPaired_[threadId] += numAl;
+			t.numReportedPaired += numAl;
 		} else {
-			ptNumReported_[threadId] += numAl;
+			t.numReported += numAl;
 		}
 	}
 
@@ -237,14 +474,23 @@ public:
 		}
 		const Hit& firstHit = (hptr == NULL) ? (*hsptr)[start] : *hptr;
 		bool paired = firstHit.mate > 0;
-		maybeFlush(threadId);
+		if(sorter_ == NULL && !sharded() && !batchOrder_) maybeFlush(threadId);
 		BTString& o = ptBufs_[threadId];
 		// Per-thread buffering is active
 		for(size_t i = start; i < end; i++) {
 			const Hit& h = (hptr == NULL) ? (*hsptr)[i] : *hptr;
 			assert(h.repOk());
+			size_t olen = o.length();
 			append(o, h, mapq, xms);
-			if(nthreads_ == 1) {
+			ptTallies_[threadId].bytesOut += (o.length() - olen);
+			if(sorter_ != NULL) {
+				sortRecord(threadId, HitSortKey(h.h.first, h.h.second,
+				                                rdid, (uint32_t)(i - start)));
+			} else if(sharded()) {
+				shardRecord(threadId, h.h.first, h.h.second);
+			} else if(batchOrder_) {
+				holdRecord(threadId, rdid, olen);
+			} else if(nthreads_ == 1) {
 				out_.writeString(o);
 				o.clear();
 			}
@@ -263,29 +509,36 @@ public:
 		// Flush all per-thread buffers
 		flushAll();
 
+		// Write out sorted records
+		if(sorter_ != NULL) {
+			sorter_->merge(out_);
+		}
+
+		// Flush and close all shard files
+		closeShards();
+
 		// Close all output streams
 		closeOuts();
 
 		// Print information about how many unpaired and/or paired
 		// reads were aligned.
 		if(!quiet_) {
-			uint64_t numReported = 0, numReportedPaired = 0;
-			uint64_t numAligned = 0, numUnaligned = 0;
-			uint64_t numMaxed = 0;
-			for(size_t i = 0; i < nthreads_; i++) {
-				numReported += ptNumReported_[i];
-				numReportedPaired += ptNumReportedPaired_[i];
-				numAligned += ptNumAligned_[i];
-				numUnaligned += ptNumUnaligned_[i];
-				numMaxed += ptNumMaxed_[i];
-			}
+			HitSinkTallies sum;
+			tallies(sum);
+			uint64_t numReported = sum.numReported;
+			uint64_t numReportedPaired = sum.numReportedPaired;
+			uint64_t numAligned = sum.numAligned;
+			uint64_t numUnaligned = sum.numUnaligned;
+			uint64_t numMaxed = sum.numMaxed;
+			uint64_t numCutoff = sum.numCutoff;
 
 			uint64_t tot = numAligned + numUnaligned;
-			double alPct = 0.0, unalPct = 0.0, maxPct = 0.0;
+			double alPct = 0.0, unalPct = 0.0, maxPct = 0.0, cutPct = 0.0;
 			if(tot > 0) {
 				alPct   = 100.0 * (double)numAligned / (double)tot;
 				unalPct = 100.0 * (double)numUnaligned / (double)tot;
 				maxPct  = 100.0 * (double)numMaxed / (double)tot;
+				cutPct  = 100.0 * (double)numCutoff / (double)tot;
 			}
 			cerr << "# reads processed: " << tot << endl;
 			cerr << "# reads with at least one reported alignment: "
@@ -305,6 +558,11 @@ public:
 						 << maxPct << "%)" << endl;
 				}
 			}
+			if(numCutoff > 0) {
+				cerr << "# reads whose search ran out of backtracks: "
+				     << numCutoff << " (" << fixed << setprecision(2)
+				     << cutPct << "%)" << endl;
+			}
 			if(numReported == 0 && numReportedPaired == 0) {
 				cerr << "No alignments" << endl;
 			}
@@ -326,12 +584,34 @@ public:
 				cerr << "reporter:counter:Bowtie,Reads with reported alignments," << numAligned << endl;
 				cerr << "reporter:counter:Bowtie,Reads with no alignments," << numUnaligned << endl;
 				cerr << "reporter:counter:Bowtie,Reads exceeding -m limit," << numMaxed << endl;
+				if(numCutoff > 0) {
+					cerr << "reporter:counter:Bowtie,Reads out of backtracks," << numCutoff << endl;
+				}
 				cerr << "reporter:counter:Bowtie,Unpaired alignments reported," << numReported << endl;
 				cerr << "reporter:counter:Bowtie,Paired alignments reported," << numReportedPaired << endl;
 			}
 		}
 	}
 
+	/**
+	 * Sum all threads' tallies into t.  Takes no locks, so may be
+	 * called while search threads are running; the result is then a
+	 * consistent-enough snapshot for progress reporting.
+	 */
+	void tallies(HitSinkTallies& t) const {
+		std::memset(reinterpret_cast<void*>(&t), 0, sizeof(t));
+		for(size_t i = 0; i < nthreads_; i++) {
+			const HitSinkTallies& pt = ptTallies_[i];
+			t.numAligned        += pt.numAligned;
+			t.numReported       += pt.numReported;
+			t.numReportedPaired += pt.numReportedPaired;
+			t.numUnaligned      += pt.numUnaligned;
+			t.numMaxed          += pt.numMaxed;
+			t.numCutoff         += pt.numCutoff;
+			t.bytesOut          += pt.bytesOut;
+		}
+	}
+
 	/**
 	 * Returns alignment output stream.
 	 */
@@ -535,7 +815,7 @@ public:
 		size_t threadId,
 		PatternSourcePerThread& p)
 	{
-		ptNumMaxed_[threadId]++;
+		ptTallies_[threadId].numMaxed++;
 	}
 
 	/**
@@ -546,7 +826,15 @@ public:
 		size_t threadId,
 		PatternSourcePerThread& p)
 	{
-		ptNumUnaligned_[threadId]++;
+		ptTallies_[threadId].numUnaligned++;
+	}
+
+	/**
+	 * Note that a read's search ended because it ran out of
+	 * backtracks, so alignments may have been missed.
+	 */
+	void reportCutoff(size_t threadId) {
+		ptTallies_[threadId].numCutoff++;
 	}
 
 protected:
@@ -555,6 +843,10 @@ protected:
 	 * Flush thread's output buffer and reset both buffer and count.
 	 */
 	void flush(size_t threadId, bool force) {
+		if(batchOrder_ && !ptHeld_[threadId].empty()) {
+			flushHeld(threadId);
+			return;
+		}
 		{
 			ThreadSafe _ts(&mutex_); // flush
 			out_.writeString(ptBufs_[threadId]);
@@ -563,6 +855,81 @@ protected:
 		ptBufs_[threadId].clear();
 	}
 
+	/**
+	 * Note that the record just appended to the thread's output
+	 * buffer, starting at offset 'off', belongs to read 'rdid'.
+	 */
+	void holdRecord(size_t threadId, TReadId rdid, size_t off) {
+		HeldRecord r;
+		r.rdid = rdid;
+		r.off = off;
+		r.len = ptBufs_[threadId].length() - off;
+		ptHeld_[threadId].push_back(r);
+	}
+
+	/**
+	 * Write the thread's held records in read order.
+	 */
+	void flushHeld(size_t threadId) {
+		std::vector<HeldRecord>& held = ptHeld_[threadId];
+		std::sort(held.begin(), held.end());
+		const char *buf = ptBufs_[threadId].buf();
+		{
+			ThreadSafe _ts(&mutex_); // flush
+			for(size_t i = 0; i < held.size(); i++) {
+				out_.writeChars(buf + held[i].off, held[i].len);
+			}
+		}
+		held.clear();
+		ptCounts_[threadId] = 0;
+		ptBufs_[threadId].clear();
+	}
+
+	/**
+	 * Hand the record just appended to the thread's output buffer over
+	 * to the sorter.
+	 */
+	void sortRecord(size_t threadId, const HitSortKey& key) {
+		assert(sorter_ != NULL);
+		BTString& o = ptBufs_[threadId];
+		sorter_->add(threadId, key, o.buf(), o.length());
+		o.clear();
+	}
+
+	/**
+	 * Move the record just appended to the thread's output buffer into
+	 * the thread's buffer for the shard covering the given reference
+	 * position, flushing that buffer if it's full.  A record is more
+	 * than one line when an alignment straddles a --partition boundary
+	 * and is printed once per partition; each line after the first
+	 * goes to the range holding the start of its own partition.
+	 */
+	void shardRecord(size_t threadId, uint64_t refid, uint64_t off);
+
+	/**
+	 * Return the thread's buffer for the given shard, opening the
+	 * shard's file if no thread has done so yet.
+	 */
+	HitShardBuf& shardBuf(size_t threadId, const std::pair<uint64_t, uint64_t>& key);
+
+	/**
+	 * Write a thread's pending records for a shard to the shard's file.
+	 */
+	void flushShard(HitShardBuf& sb);
+
+	/**
+	 * Make sh the most recently used open shard, reopening its file
+	 * for appending if it was evicted, then close least recently used
+	 * files that no thread is about to write until no more than
+	 * maxOpenShards_ are open.  Caller must hold shardsLock_.
+	 */
+	void touchShard(HitShard *sh);
+
+	/**
+	 * Flush all threads' shard buffers and close all shard files.
+	 */
+	void closeShards();
+
 	/**
 	 * Flush all output buffers.
 	 */
@@ -598,7 +965,40 @@ protected:
 	std::vector<BTString> ptBufs_;
 	std::vector<size_t> ptCounts_;
 	int perThreadBufSize_;
+	char *ptTalliesBuf_;        /// memory backing ptTallies_
+	HitSinkTallies *ptTallies_; /// per-thread tallies, cache-line aligned
 	bool reorder_;
+	HitSorter *sorter_; /// non-NULL -> output is sorted by coordinate
+
+	// Sharded output (--shard-out)
+	typedef std::pair<uint64_t, uint64_t> TShardKey; /// (ref id, range)
+	std::string shardDir_;    /// directory for shard files; empty -> no sharding
+	uint64_t    shardLen_;    /// bases per shard; 0 -> one shard per reference
+	int         shardOffBase_; /// offset base ranges are measured in
+	uint64_t    shardPartLen_; /// --partition size if records can straddle partitions, else 0
+	std::string shardExt_;    /// extension for shard file names
+	std::string shardHeader_; /// header to write at the top of each shard file
+	std::map<TShardKey, HitShard*> shards_; /// all shards opened so far
+	std::list<HitShard*> openShards_; /// shards with open files, most recently used first
+	size_t      maxOpenShards_; /// most shard files to keep open at once
+	MUTEX_T     shardsLock_;  /// protects shards_, openShards_ and pins
+	std::vector<std::map<TShardKey, HitShardBuf> > ptShards_; /// per-thread shard buffers
+	DupReadCache *dupCache_; /// non-NULL -> duplicate reads replay earlier results
+
+	/// A record in a thread's output buffer, held until its batch is done
+	struct HeldRecord {
+		TReadId rdid;
+		size_t  off;
+		size_t  len;
+
+		bool operator<(const HeldRecord& o) const {
+			if(rdid != o.rdid) return rdid < o.rdid;
+			return off < o.off;
+		}
+	};
+	bool batchOrder_; /// hold records until batch is done; see setBatchOrder()
+	std::vector<std::vector<HeldRecord> > ptHeld_; /// per-thread held records
+	std::vector<TReadId> ptBatch_; /// per-thread first read id of current batch
 
 	// Output filenames for dumping
 	std::string dumpAlBase_;
@@ -717,11 +1117,6 @@ protected:
 	bool dumpMaxedFlag_;
 
 	volatile bool first_;       /// true -> first hit hasn't yet been reported
-	volatile uint64_t *ptNumAligned_;
-	volatile uint64_t *ptNumReported_;
-	volatile uint64_t *ptNumReportedPaired_;
-	volatile uint64_t *ptNumUnaligned_;
-	volatile uint64_t *ptNumMaxed_;
 
 	bool quiet_;  /// true -> don't print alignment stats at the end
 };
@@ -757,6 +1152,9 @@ public:
 	/// Return the vector of retained hits
 	vector<Hit>& retainedHits()   { return _hits; }
 
+	/// Note that the current read ran out of its --btsens backtracks
+	void reportCutoff() { _sink.reportCutoff(threadId_); }
+
 	/// Finalize current read
 	virtual uint32_t finishRead(PatternSourcePerThread& p, bool report, bool dump) {
 		uint32_t ret = finishReadImpl();
@@ -765,6 +1163,25 @@ public:
 			_bufferedHits.clear();
 			return 0;
 		}
+		if(dump && _sink.dupCache() != NULL) {
+			rememberRead(p, ret);
+		}
+		return flushRead(p, ret, dump);
+	}
+
+	/**
+	 * If an identical copy of the current read was aligned earlier,
+	 * report its alignments again, as this read's, and return true.
+	 * The caller then skips searching for the read.
+	 */
+	bool replayDuplicate(PatternSourcePerThread& p);
+
+	/**
+	 * Report or dump the current read given that it yielded 'ret'
+	 * reportable alignments, now in _bufferedHits.
+	 */
+	uint32_t flushRead(PatternSourcePerThread& p, uint32_t ret, bool dump) {
+		_sink.enterBatch(threadId_, p.batchRdid());
 		bool maxed = (ret > _max);
 		bool unal = (ret == 0);
 		if(dump && (unal || maxed)) {
@@ -808,6 +1225,11 @@ public:
 
 	virtual uint32_t finishReadImpl() = 0;
 
+	/**
+	 * Put the current read's outcome in the duplicate-read cache.
+	 */
+	void rememberRead(PatternSourcePerThread& p, uint32_t ret);
+
 	/**
 	 * Add a hit to the internal buffer.  Not yet reporting the hits.
 	 */
@@ -0,0 +1,191 @@
+/*
+ * hit_sort.cpp
+ *
+ * External merge sort of output records; see hit_sort.h.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "hit_sort.h"
+
+using namespace std;
+
+HitSorter::HitSorter(size_t nthreads, size_t memLimit, const string& tmpDir) :
+	nthreads_((nthreads > 0) ? nthreads : 1),
+	runLimit_(0),
+	tmpDir_(tmpDir),
+	runs_(),
+	spills_(),
+	lock_()
+{
+	if(tmpDir_.empty()) {
+		const char *env = getenv("TMPDIR");
+		tmpDir_ = (env != NULL && env[0] != '\0') ? env : ".";
+	}
+	runLimit_ = max<size_t>(memLimit / nthreads_, 64 * 1024);
+	runs_.resize(nthreads_);
+}
+
+HitSorter::~HitSorter() {
+	for(size_t i = 0; i < spills_.size(); i++) {
+		remove(spills_[i].c_str());
+	}
+}
+
+/**
+ * Copy the record into thread's run.  The run is sorted and written to
+ * disk first if adding the record would take it over its budget.
+ */
+void HitSorter::add(size_t threadId, const HitSortKey& key, const char *rec, size_t len) {
+	assert_lt(threadId, runs_.size());
+	Run& r = runs_[threadId];
+	if(!r.recs.empty() && r.footprint() + sizeof(Rec) + len > runLimit_) {
+		spill(threadId);
+	}
+	Rec re;
+	re.key = key;
+	re.off = r.bytes.size();
+	re.len = (uint32_t)len;
+	r.recs.push_back(re);
+	r.bytes.insert(r.bytes.end(), rec, rec + len);
+}
+
+/**
+ * Sort thread's run and write it to a new temporary file.  Sorting
+ * happens in the calling thread, so threads sort their runs in
+ * parallel; only the registration of the file name is synchronized.
+ */
+void HitSorter::spill(size_t threadId) {
+	Run& r = runs_[threadId];
+	sort(r.recs.begin(), r.recs.end(), RecCompare());
+	string fname;
+	{
+		ThreadSafe _ts(&lock_);
+		ostringstream ss;
+		ss << tmpDir_ << "/bowtie-sort." << getpid() << "." << spills_.size() << ".tmp";
+		fname = ss.str();
+		spills_.push_back(fname);
+	}
+	FILE *f = fopen(fname.c_str(), "wb");
+	if(f == NULL) {
+		cerr << "Error: Could not open temporary file " << fname
+		     << " for writing sorted alignments; try a different --sort-tmp" << endl;
+		throw 1;
+	}
+	bool ok = true;
+	for(size_t i = 0; i < r.recs.size() && ok; i++) {
+		const Rec& re = r.recs[i];
+		ok = fwrite(&re.key.refid, 8, 1, f) == 1 &&
+		     fwrite(&re.key.off,   8, 1, f) == 1 &&
+		     fwrite(&re.key.rdid,  8, 1, f) == 1 &&
+		     fwrite(&re.key.sub,   4, 1, f) == 1 &&
+		     fwrite(&re.len,       4, 1, f) == 1 &&
+		     (re.len == 0 || fwrite(&r.bytes[re.off], re.len, 1, f) == 1);
+	}
+	if(fclose(f) != 0 || !ok) {
+		cerr << "Error while writing sorted alignments to temporary file " << fname << endl;
+		throw 1;
+	}
+	r.recs.clear();
+	r.bytes.clear();
+}
+
+/**
+ * A sorted stream of records being merged; either an in-memory run or a
+ * spilled run being read back from disk.
+ */
+struct HitSorter::Source {
+	Source() : f(NULL), run(NULL), cur(0), key(), len(0), rec(NULL), buf() { }
+
+	/**
+	 * Advance to the next record; return false if there are none left.
+	 */
+	bool next() {
+		if(f != NULL) {
+			if(fread(&key.refid, 8, 1, f) != 1) return false;
+			if(fread(&key.off,   8, 1, f) != 1 ||
+			   fread(&key.rdid,  8, 1, f) != 1 ||
+			   fread(&key.sub,   4, 1, f) != 1 ||
+			   fread(&len,       4, 1, f) != 1)
+			{
+				cerr << "Error: temporary file of sorted alignments is truncated" << endl;
+				throw 1;
+			}
+			buf.resize(len);
+			if(len > 0 && fread(&buf[0], len, 1, f) != 1) {
+				cerr << "Error: temporary file of sorted alignments is truncated" << endl;
+				throw 1;
+			}
+			rec = len > 0 ? &buf[0] : NULL;
+			return true;
+		}
+		if(cur >= run->recs.size()) return false;
+		const Rec& re = run->recs[cur++];
+		key = re.key;
+		len = re.len;
+		rec = len > 0 ? &run->bytes[re.off] : NULL;
+		return true;
+	}
+
+	FILE             *f;   /// spilled run, or NULL if in memory
+	const Run        *run; /// in-memory run, or NULL if spilled
+	size_t            cur; /// next record in run
+	HitSortKey        key; /// key of current record
+	uint32_t          len; /// length of current record
+	const char       *rec; /// bytes of current record
+	std::vector<char> buf; /// holds current record read from file
+};
+
+/**
+ * k-way merge all in-memory and spilled runs into 'out'.
+ */
+void HitSorter::merge(OutFileBuf& out) {
+	// Sort what's left in memory
+	vector<Source> srcs(runs_.size() + spills_.size());
+	for(size_t i = 0; i < runs_.size(); i++) {
+		sort(runs_[i].recs.begin(), runs_[i].recs.end(), RecCompare());
+		srcs[i].run = &runs_[i];
+	}
+	for(size_t i = 0; i < spills_.size(); i++) {
+		FILE *f = fopen(spills_[i].c_str(), "rb");
+		if(f == NULL) {
+			cerr << "Error: Could not re-open temporary file " << spills_[i] << endl;
+			throw 1;
+		}
+		srcs[runs_.size() + i].f = f;
+	}
+	// Min-heap of (key, source index)
+	typedef pair<HitSortKey, size_t> THeapEnt;
+	priority_queue<THeapEnt, vector<THeapEnt>, greater<THeapEnt> > heap;
+	for(size_t i = 0; i < srcs.size(); i++) {
+		if(srcs[i].next()) heap.push(make_pair(srcs[i].key, i));
+	}
+	while(!heap.empty()) {
+		size_t i = heap.top().second;
+		heap.pop();
+		out.writeChars(srcs[i].rec, srcs[i].len);
+		if(srcs[i].next()) heap.push(make_pair(srcs[i].key, i));
+	}
+	for(size_t i = 0; i < srcs.size(); i++) {
+		if(srcs[i].f != NULL) fclose(srcs[i].f);
+	}
+	for(size_t i = 0; i < spills_.size(); i++) {
+		remove(spills_[i].c_str());
+	}
+	spills_.clear();
+	for(size_t i = 0; i < runs_.size(); i++) {
+		runs_[i].recs.clear();
+		runs_[i].bytes.clear();
+	}
+}
@@ -0,0 +1,138 @@
+/*
+ * hit_sort.h
+ *
+ * Support for emitting alignment records in reference-coordinate order
+ * (--sort).  Search threads hand finished output records to a HitSorter
+ * along with a sort key.  Each thread accumulates its records in a
+ * private, memory-capped run; when the run fills up, the thread sorts it
+ * and spills it to a temporary file.  Once all searching is done, the
+ * leftover in-memory runs and all spilled runs are k-way merged into the
+ * final output stream.
+ */
+
+#ifndef HIT_SORT_H_
+#define HIT_SORT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "assert_helpers.h"
+#include "filebuf.h"
+#include "threading.h"
+
+/**
+ * Key used to order output records.  Records are ordered by reference
+ * id, then by reference offset.  Ties are broken by read id and then by
+ * the order in which the records for that read were submitted, so that
+ * output is identical regardless of the number of threads.
+ */
+struct HitSortKey {
+
+	HitSortKey() : refid(0), off(0), rdid(0), sub(0) { }
+
+	HitSortKey(uint64_t refid_, uint64_t off_, uint64_t rdid_, uint32_t sub_) :
+		refid(refid_), off(off_), rdid(rdid_), sub(sub_) { }
+
+	/**
+	 * Return a key for a record with no reference position; these
+	 * sort after all aligned records, in read-id order.
+	 */
+	static HitSortKey unaligned(uint64_t rdid) {
+		return HitSortKey(~(uint64_t)0, ~(uint64_t)0, rdid, 0);
+	}
+
+	bool operator<(const HitSortKey& o) const {
+		if(refid != o.refid) return refid < o.refid;
+		if(off   != o.off)   return off   < o.off;
+		if(rdid  != o.rdid)  return rdid  < o.rdid;
+		return sub < o.sub;
+	}
+
+	uint64_t refid; /// reference id
+	uint64_t off;   /// 0-based offset into reference
+	uint64_t rdid;  /// read id
+	uint32_t sub;   /// index of record among those for the same read
+};
+
+/**
+ * Accumulates output records from many threads and writes them out in
+ * HitSortKey order when merge() is called.  add() may be called
+ * concurrently from different threads as long as each thread uses its
+ * own threadId.
+ */
+class HitSorter {
+
+public:
+
+	/**
+	 * Create a sorter for 'nthreads' producer threads that keeps at
+	 * most about 'memLimit' bytes of records in memory (split evenly
+	 * among the threads) and spills sorted runs to files in 'tmpDir'
+	 * ($TMPDIR or the working directory if empty).
+	 */
+	HitSorter(size_t nthreads, size_t memLimit, const std::string& tmpDir);
+
+	/**
+	 * Remove any spill files that are still around.
+	 */
+	~HitSorter();
+
+	/**
+	 * Add a record to thread 'threadId's current run, spilling the run
+	 * to disk first if it's full.
+	 */
+	void add(size_t threadId, const HitSortKey& key, const char *rec, size_t len);
+
+	/**
+	 * Merge all runs, both in memory and on disk, and write the records
+	 * to 'out' in sorted order.  Not synchronized; call only after all
+	 * producer threads have finished.
+	 */
+	void merge(OutFileBuf& out);
+
+	/**
+	 * Return the number of runs spilled to disk so far.
+	 */
+	size_t numSpills() const { return spills_.size(); }
+
+private:
+
+	/// A record in an in-memory run; bytes live in Run::bytes
+	struct Rec {
+		HitSortKey key;
+		size_t     off; /// offset of record bytes in Run::bytes
+		uint32_t   len; /// length of record in bytes
+	};
+
+	/// Order Recs by key
+	struct RecCompare {
+		bool operator()(const Rec& a, const Rec& b) const {
+			return a.key < b.key;
+		}
+	};
+
+	/// One thread's in-memory run
+	struct Run {
+		Run() : recs(), bytes() { }
+		size_t footprint() const {
+			return recs.size() * sizeof(Rec) + bytes.size();
+		}
+		std::vector<Rec>  recs;
+		std::vector<char> bytes;
+	};
+
+	/// A sorted stream of records being merged; see hit_sort.cpp
+	struct Source;
+
+	void spill(size_t threadId);
+
+	size_t                   nthreads_;
+	size_t                   runLimit_; /// bytes per thread before spilling
+	std::string              tmpDir_;
+	std::vector<Run>         runs_;     /// per-thread in-memory runs
+	std::vector<std::string> spills_;   /// names of spilled run files
+	MUTEX_T                  lock_;     /// protects spills_
+};
+
+#endif /* HIT_SORT_H_ */
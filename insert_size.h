@@ -0,0 +1,183 @@
+/*
+ * insert_size.h
+ *
+ * Learns the fragment-length distribution of a paired-end run from its
+ * first concordant pairs, so that the search for a mate near an
+ * aligned anchor can look in the window where mates actually land
+ * before falling back to the full -I/-X window.
+ *
+ * One InsertSizeEstimator is shared by all search threads.  Each
+ * thread tallies fragment lengths in its own InsertSizeTally without
+ * taking a lock; the thread that records the Nth pair overall merges
+ * the tallies and publishes the learned window.
+ */
+
+#ifndef INSERT_SIZE_H_
+#define INSERT_SIZE_H_
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "assert_helpers.h"
+#include "threading.h"
+
+/// Fraction of learned fragment lengths left outside the window, per side
+static const double INSERT_TAIL = 0.005;
+/// Amount the learned window is widened by, as a fraction of its width
+static const double INSERT_SLOP = 0.25;
+
+/**
+ * One search thread's fragment-length histogram and counters.  Only
+ * the owning thread writes it.
+ */
+struct InsertSizeTally {
+	InsertSizeTally(uint32_t maxIns) :
+		counts(maxIns + 1, 0), narrowed(0), fallbacks(0) { }
+
+	std::vector<uint32_t> counts;    /// pairs by fragment length
+	uint64_t              narrowed;  /// mate searches in the learned window
+	uint64_t              fallbacks; /// ... that then had to try the full window
+};
+
+class InsertSizeEstimator {
+public:
+	/**
+	 * Learn from the first 'learn' concordant pairs, which must fall
+	 * within [minIns, maxIns].
+	 */
+	InsertSizeEstimator(uint32_t learn, uint32_t minIns, uint32_t maxIns) :
+		learn_(learn),
+		minIns_(minIns),
+		maxIns_(maxIns),
+		seen_(0),
+		ready_(false),
+		lo_(minIns),
+		hi_(maxIns),
+		learned_(maxIns + 1, 0)
+	{
+		assert_gt(learn_, 0);
+		assert_leq(minIns_, maxIns_);
+	}
+
+	~InsertSizeEstimator() {
+		for(size_t i = 0; i < tallies_.size(); i++) {
+			delete tallies_[i];
+		}
+	}
+
+	/**
+	 * Return a new tally for a search thread.  The estimator owns it.
+	 */
+	InsertSizeTally* newTally() {
+		ThreadSafe _ts(&lock_);
+		tallies_.push_back(new InsertSizeTally(maxIns_));
+		return tallies_.back();
+	}
+
+	/**
+	 * Note a concordant pair with fragment length 'frag', measured
+	 * as if neither mate had been trimmed.
+	 */
+	void record(InsertSizeTally* t, uint32_t frag) {
+		if(ready_ || frag > maxIns_) return;
+		t->counts[frag]++;
+		if(__sync_add_and_fetch(&seen_, 1) == learn_) {
+			learn();
+		}
+	}
+
+	/**
+	 * If the window has been learned, set lo and hi to it and return
+	 * true.  Otherwise return false.
+	 */
+	bool window(uint32_t& lo, uint32_t& hi) const {
+		if(!ready_) return false;
+		lo = lo_;
+		hi = hi_;
+		return true;
+	}
+
+	/**
+	 * Print what was learned and how often it helped.
+	 */
+	void printStats(std::ostream& os) {
+		ThreadSafe _ts(&lock_);
+		uint64_t narrowed = 0, fallbacks = 0;
+		for(size_t i = 0; i < tallies_.size(); i++) {
+			narrowed += tallies_[i]->narrowed;
+			fallbacks += tallies_[i]->fallbacks;
+		}
+		if(!ready_) {
+			os << "Insert size: saw " << seen_ << " of the " << learn_
+			   << " concordant pairs needed to learn a window" << std::endl;
+			return;
+		}
+		uint64_t n = 0;
+		double sum = 0.0, sumsq = 0.0;
+		for(uint32_t i = 0; i <= maxIns_; i++) {
+			n += learned_[i];
+			sum += (double)learned_[i] * i;
+			sumsq += (double)learned_[i] * i * i;
+		}
+		double mean = sum / n;
+		double sd = sqrt(std::max(0.0, sumsq / n - mean * mean));
+		os << "Insert size (from " << n << " pairs): mean " << mean
+		   << ", s.d. " << sd << ", median " << quantile(0.5)
+		   << "; searched " << lo_ << "-" << hi_ << " first, "
+		   << fallbacks << " of " << narrowed
+		   << " mate searches fell back to " << minIns_ << "-" << maxIns_ << std::endl;
+	}
+
+private:
+
+	/**
+	 * Merge the per-thread tallies and publish the learned window.
+	 * Increments that other threads make meanwhile may be missed,
+	 * which doesn't matter for an estimate.
+	 */
+	void learn() {
+		ThreadSafe _ts(&lock_);
+		for(size_t i = 0; i < tallies_.size(); i++) {
+			for(uint32_t j = 0; j <= maxIns_; j++) {
+				learned_[j] += tallies_[i]->counts[j];
+			}
+		}
+		uint32_t lo = quantile(INSERT_TAIL);
+		uint32_t hi = quantile(1.0 - INSERT_TAIL);
+		uint32_t slop = (uint32_t)((hi - lo) * INSERT_SLOP) + 1;
+		lo_ = (lo > minIns_ + slop) ? lo - slop : minIns_;
+		hi_ = std::min(maxIns_, hi + slop);
+		__sync_synchronize();
+		ready_ = true;
+	}
+
+	/**
+	 * Return the smallest fragment length with at least fraction q of
+	 * the learned pairs at or below it.
+	 */
+	uint32_t quantile(double q) const {
+		uint64_t n = 0;
+		for(uint32_t i = 0; i <= maxIns_; i++) n += learned_[i];
+		uint64_t target = (uint64_t)ceil(q * n), cum = 0;
+		for(uint32_t i = 0; i <= maxIns_; i++) {
+			cum += learned_[i];
+			if(cum >= target && cum > 0) return i;
+		}
+		return maxIns_;
+	}
+
+	const uint32_t learn_;    /// # pairs to learn from
+	const uint32_t minIns_;   /// -I
+	const uint32_t maxIns_;   /// -X
+	volatile uint32_t seen_;  /// # pairs recorded so far
+	volatile bool  ready_;    /// lo_ and hi_ are learned?
+	uint32_t       lo_;       /// learned window
+	uint32_t       hi_;
+	std::vector<uint64_t> learned_; /// merged tallies
+	std::vector<InsertSizeTally*> tallies_;
+	MUTEX_T        lock_;
+};
+
+#endif /* INSERT_SIZE_H_ */
@@ -0,0 +1,178 @@
+/*
+ * kmer_table.h
+ *
+ * A table mapping fixed-length k-mers to the BW ranges they match, so
+ * that searches starting with a k-mer seen before can skip the LF
+ * steps between the ftab and depth k.  Guide-counting and small-RNA
+ * libraries consist almost entirely of a limited set of short exact
+ * sequences, and so keep hitting the same k-mers.
+ *
+ * One KmerTable per index is shared by all search threads.  It's
+ * filled as searches go rather than built in advance, and never grows
+ * beyond the memory it's given: a k-mer is hashed to a short run of
+ * slots and, if they're all taken, overwrites the first of them.
+ * Slots are guarded by sequence counters like RangeCacheSlot, except
+ * that writers claim a slot by incrementing its counter rather than
+ * by taking a lock, and a writer that loses the race just doesn't
+ * write.
+ */
+
+#ifndef KMER_TABLE_H_
+#define KMER_TABLE_H_
+
+#include <stdint.h>
+#include <iostream>
+#include <stdexcept>
+#include "ebwt.h"
+
+/// Table slots examined before a lookup gives up or an insert overwrites
+static const uint32_t KMER_TABLE_MAX_PROBE = 4;
+/// Longest k-mer that fits in a key
+static const int KMER_TABLE_MAX_LEN = 32;
+
+/**
+ * A slot in the table.  seq is 0 if the slot was never written and
+ * odd while a write is in progress.  top == bot records a k-mer that
+ * doesn't occur.
+ */
+struct KmerTableSlot {
+	volatile uint32_t   seq;
+	volatile uint64_t   key; /// 2 bits per char, first char searched lowest
+	volatile TIndexOffU top;
+	volatile TIndexOffU bot;
+};
+
+class KmerTable {
+
+	typedef KmerTableSlot Slot;
+
+public:
+	/**
+	 * Create a table of 'len'-mers that uses at most about
+	 * 'lim' bytes.  A limit too small to hold anything disables it.
+	 */
+	KmerTable(size_t lim, int len) :
+		len_(len), mask_(0), slots_(NULL), hits_(0), misses_(0)
+	{
+		assert_gt(len_, 0);
+		assert_leq(len_, KMER_TABLE_MAX_LEN);
+		if(lim < KMER_TABLE_MAX_PROBE * sizeof(Slot)) return;
+		// Round down to a power of 2
+		size_t nslots = 1;
+		while(2 * nslots * sizeof(Slot) <= lim) nslots <<= 1;
+		try {
+			slots_ = new Slot[nslots];
+		} catch(std::bad_alloc& e) {
+			cerr << "Allocation error allocating " << lim
+			     << " bytes of k-mer table memory" << endl;
+			throw 1;
+		}
+		for(size_t i = 0; i < nslots; i++) {
+			slots_[i].seq = 0;
+			slots_[i].key = 0;
+			slots_[i].top = 0;
+			slots_[i].bot = 0;
+		}
+		mask_ = nslots - 1;
+	}
+
+	~KmerTable() {
+		delete[] slots_;
+	}
+
+	/**
+	 * Return true iff the table has memory to work with.
+	 */
+	bool enabled() const {
+		return slots_ != NULL;
+	}
+
+	/**
+	 * Length of the k-mers in the table.
+	 */
+	int len() const { return len_; }
+
+	/**
+	 * If 'key' is in the table, set top and bot to its range and
+	 * return true.  A slot that's being written at the time is treated
+	 * as absent.
+	 */
+	bool lookup(uint64_t key, TIndexOffU& top, TIndexOffU& bot) const {
+		assert(enabled());
+		size_t i = home(key);
+		for(uint32_t probe = 0; probe < KMER_TABLE_MAX_PROBE; probe++) {
+			const Slot& s = slots_[(i + probe) & mask_];
+			uint32_t seq = s.seq;
+			if(seq == 0) return false; // never written; key can't be further on
+			if((seq & 1) == 0) {
+				__sync_synchronize();
+				uint64_t k = s.key;
+				TIndexOffU t = s.top, b = s.bot;
+				__sync_synchronize();
+				if(s.seq == seq && k == key) {
+					top = t;
+					bot = b;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Record that 'key' matches range [top, bot).
+	 */
+	void insert(uint64_t key, TIndexOffU top, TIndexOffU bot) {
+		assert(enabled());
+		assert_leq(top, bot);
+		size_t i = home(key);
+		Slot* victim = &slots_[i];
+		for(uint32_t probe = 0; probe < KMER_TABLE_MAX_PROBE; probe++) {
+			Slot& s = slots_[(i + probe) & mask_];
+			if(s.seq == 0) {
+				victim = &s;
+				break;
+			}
+		}
+		uint32_t seq = victim->seq;
+		if((seq & 1) != 0 || !__sync_bool_compare_and_swap(&victim->seq, seq, seq + 1)) {
+			return; // somebody else is writing it
+		}
+		__sync_synchronize();
+		victim->key = key;
+		victim->top = top;
+		victim->bot = bot;
+		__sync_synchronize();
+		victim->seq = seq + 2;
+	}
+
+	/**
+	 * Add a search thread's tallies of lookups that did and didn't
+	 * find their k-mer.
+	 */
+	void addStats(uint64_t hits, uint64_t misses) {
+		if(hits > 0)   __sync_fetch_and_add(&hits_, hits);
+		if(misses > 0) __sync_fetch_and_add(&misses_, misses);
+	}
+
+	uint64_t hits() const { return hits_; }
+	uint64_t misses() const { return misses_; }
+
+private:
+
+	/**
+	 * Table position at which to start probing for 'key'.
+	 */
+	size_t home(uint64_t key) const {
+		uint64_t h = key * 0x9e3779b97f4a7c15ull;
+		return (size_t)(h >> 32) & mask_;
+	}
+
+	const int         len_;   /// k
+	size_t            mask_;  /// # slots - 1
+	Slot*             slots_;
+	volatile uint64_t hits_;
+	volatile uint64_t misses_;
+};
+
+#endif /* KMER_TABLE_H_ */
@@ -39,6 +39,23 @@ static inline void swap(TVal* s, size_t slen, TPos a, TPos b) {
 	s[b] = tmp;
 }
 
+/**
+ * Return a pseudo-random pivot in [begin, end) that depends only on
+ * the range, so the threads sorting blocks don't share generator state
+ * (as they did through rand()) and the choice doesn't depend on which
+ * thread sorts a block, or when.
+ */
+static inline size_t randPivot(size_t begin, size_t end) {
+	assert_gt(end, begin);
+	uint64_t x = ((uint64_t)begin * 0x9e3779b97f4a7c15ull) ^ (uint64_t)end;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return begin + (size_t)(x % (end - begin));
+}
+
 /**
  * Helper macro for swapping elements a and b in seqan::String s.  Does
  * some additional sainty checking w/r/t begin and end (which are
@@ -188,10 +205,7 @@ static inline void vecswap2(TVal* s, size_t slen, TVal* s2, TPos i, TPos j, TPos
 
 // Note that CHOOSE_AND_SWAP_RANDOM_PIVOT is unused
 #define CHOOSE_AND_SWAP_RANDOM_PIVOT(sw, ch) {                            \
-	/* Note: rand() didn't really cut it here; it seemed to run out of */ \
-	/* randomness and, after a time, returned the same thing over and */  \
-	/* over again */                                                      \
-	a = (rand() % n) + begin; /* choose pivot between begin and end */  \
+	a = randPivot(begin, begin + n); /* choose pivot in [begin, end) */ \
 	assert_lt(a, end); assert_geq(a, begin);                              \
 	sw(s, s2, begin, a); /* move pivot to beginning */                    \
 }
@@ -694,10 +708,7 @@ void qsortSufDc(const T& host,
 	assert_gt(end, begin);
 	size_t n = end - begin;
 	if(n <= 1) return;                 // 1-element list already sorted
-	// Note: rand() didn't really cut it here; it seemed to run out of
-	// randomness and, after a time, returned the same thing over and
-	// over again
-	size_t a = (rand() % n) + begin; // choose pivot between begin and end
+	size_t a = randPivot(begin, end); // choose pivot between begin and end
 	assert_lt(a, end);
 	assert_geq(a, begin);
 	SWAP(s, end-1, a); // move pivot to end
@@ -791,10 +802,7 @@ void qsortSufDcU8(const T1& host1,
 	assert_gt(end, begin);
 	size_t n = end - begin;
 	if(n <= 1) return;                 // 1-element list already sorted
-	// Note: rand() didn't really cut it here; it seemed to run out of
-	// randomness and, after a time, returned the same thing over and
-	// over again
-	size_t a = (rand() % n) + begin; // choose pivot between begin and end
+	size_t a = randPivot(begin, end); // choose pivot between begin and end
 	assert_lt(a, end);
 	assert_geq(a, begin);
 	SWAP(s, end-1, a); // move pivot to end
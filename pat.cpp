@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <string>
@@ -5,6 +6,7 @@
 #include <seqan/sequence.h>
 #include <seqan/file.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "pat.h"
 #include "filebuf.h"
@@ -12,6 +14,15 @@
 using namespace std;
 using namespace seqan;
 
+/**
+ * Return the wall-clock time in microseconds.
+ */
+static uint64_t nowUs() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+}
+
 /**
  * Calculate a per-read random seed based on a combination of
  * the read data (incl. sequence, name, quals) and the global
@@ -86,6 +97,127 @@ void PatternSourcePerThread::finalizePair(Read& ra, Read& rb) {
 	rb.seed = genRandSeed(rb.patFw, rb.qual, rb.name, seed_);
 }
 
+/**
+ * Get a new batch from the composition layer, first telling the
+ * BatchSizer, if any, how long the last one took and asking it how
+ * big this one should be.
+ */
+pair<bool, int> PatternSourcePerThread::nextBatch() {
+	if(sizer_ != NULL) {
+		uint64_t t = nowUs();
+		if(last_batch_size_ > 0) {
+			uint64_t workUs = (t > fetchedAt_) ? (t - fetchedAt_) : 0;
+			sizer_->record(tid_, last_batch_size_, fetchUs_, workUs);
+		}
+		buf_.setMaxBuf(sizer_->next(tid_));
+	}
+	if(gate_ != NULL && !gate_->enter(tid_)) {
+		// Searching was called off; stop here
+		return make_pair(true, 0);
+	}
+	uint64_t start = (sizer_ != NULL) ? nowUs() : 0;
+	buf_.reset();
+	pair<bool, int> res = composer_.nextBatch(buf_);
+	buf_.init();
+	if(sizer_ != NULL) {
+		fetchedAt_ = nowUs();
+		fetchUs_ = fetchedAt_ - start;
+	}
+	if(res.first && gate_ != NULL) gate_->exhausted();
+	return res;
+}
+
+BatchSizer::BatchSizer(
+	size_t base,
+	int nthreads,
+	const vector<PatternSource*>& srcs) :
+	base_(base),
+	cap_(max(base, min(base * GROW_MAX, (size_t)MAX_CAPACITY))),
+	nthreads_(nthreads),
+	srcs_(srcs),
+	slots_(NULL)
+{
+	assert_gt(base, 0);
+	assert_gt(nthreads, 0);
+	slots_ = new Slot[nthreads_];
+	memset(reinterpret_cast<void*>(slots_), 0, sizeof(Slot) * nthreads_);
+	for(int i = 0; i < nthreads_; i++) {
+		slots_[i].size = base_;
+	}
+}
+
+BatchSizer::~BatchSizer() {
+	delete[] slots_;
+}
+
+/**
+ * Return the size of thread 'tid's next batch: the size it has grown
+ * or shrunk to, but no more than its share of what's left of the
+ * input split into TAIL_BATCHES batches per thread.
+ */
+size_t BatchSizer::next(int tid) {
+	assert_lt(tid, nthreads_);
+	Slot& s = slots_[tid];
+	s.last = s.size;
+	uint64_t tot = 0, done = 0;
+	for(size_t i = 0; i < srcs_.size(); i++) {
+		if(srcs_[i] == NULL) continue;
+		uint64_t t = srcs_[i]->bytesTotal();
+		if(t == 0) return (size_t)s.last; // can't tell how much is left
+		tot += t;
+		done += srcs_[i]->bytesRead();
+	}
+	if(done == 0 || done >= tot) return (size_t)s.last;
+	uint64_t reads = 0;
+	for(int i = 0; i < nthreads_; i++) {
+		reads += slots_[i].reads;
+	}
+	double left = (double)reads * (double)(tot - done) / (double)done;
+	double share = left / (double)(TAIL_BATCHES * nthreads_);
+	if(share < (double)s.last) {
+		s.last = max<uint64_t>((uint64_t)share, 1);
+	}
+	return (size_t)s.last;
+}
+
+/**
+ * Grow the thread's batches while getting them costs more than 5% of
+ * its time, and shrink them toward the base size while it costs less
+ * than 1%.
+ */
+void BatchSizer::record(int tid, size_t n, uint64_t fetchUs, uint64_t workUs) {
+	assert_lt(tid, nthreads_);
+	Slot& s = slots_[tid];
+	s.reads += n;
+	s.fetchUs += fetchUs;
+	s.workUs += workUs;
+	if(fetchUs + workUs == 0) return;
+	double r = (double)fetchUs / (double)(fetchUs + workUs);
+	s.ratio = (s.ratio == 0.0) ? r : (0.75 * s.ratio + 0.25 * r);
+	size_t size = (size_t)s.size;
+	if(s.ratio > 0.05) {
+		size = min(size * 2, cap_);
+	} else if(s.ratio < 0.01) {
+		size = max(size / 2, base_);
+	}
+	s.size = size;
+}
+
+void BatchSizer::stats(double& size, double& fetchFrac) const {
+	uint64_t sizes = 0, active = 0, fetchUs = 0, workUs = 0;
+	for(int i = 0; i < nthreads_; i++) {
+		const Slot& s = slots_[i];
+		if(s.reads == 0) continue;
+		sizes += s.last;
+		active++;
+		fetchUs += s.fetchUs;
+		workUs += s.workUs;
+	}
+	size = (active > 0) ? ((double)sizes / (double)active) : (double)base_;
+	fetchFrac = (fetchUs + workUs > 0) ?
+		((double)fetchUs / (double)(fetchUs + workUs)) : 0.0;
+}
+
 /**
  * Get the next paired or unpaired read from the wrapped
  * PatternComposer.  Returns a pair of bools; first indicates
@@ -102,6 +234,9 @@ pair<bool, bool> PatternSourcePerThread::nextReadPair() {
 		last_batch_ = res.first;
 		last_batch_size_ = res.second;
 		assert_eq(0, buf_.cur_buf_);
+		if(sortChars_ > 0) {
+			sortBatch(res.second);
+		}
 	} else {
 		buf_.next(); // advance cursor
 		assert_gt(buf_.cur_buf_, 0);
@@ -110,6 +245,13 @@ pair<bool, bool> PatternSourcePerThread::nextReadPair() {
 	if(buf_.rdid() < skip_) {
 		return make_pair(false, this_is_last ? last_batch_ : false);
 	}
+	if(!buf_.order_.empty()) {
+		// Already parsed and finalized by sortBatch()
+		if(!parsed_[buf_.slot()]) {
+			return make_pair(false, false);
+		}
+		return make_pair(true, this_is_last ? last_batch_ : false);
+	}
 	// Parse read/pair
 	assert(strlen(buf_.read_a().readOrigBuf) != 0);
 	assert(buf_.read_a().empty());
@@ -125,6 +267,49 @@ pair<bool, bool> PatternSourcePerThread::nextReadPair() {
 	return make_pair(true, this_is_last ? last_batch_ : false);
 }
 
+void PatternSourcePerThread::sortBatch(int n) {
+	assert(buf_.order_.empty());
+	assert_gt(sortChars_, 0);
+	assert_leq(sortChars_, 16);
+	const size_t nslots = buf_.bufa_.size();
+	parsed_.assign(nslots, false);
+	keys_.clear();
+	for(int i = 0; i < n; i++) {
+		buf_.cur_buf_ = i;
+		Read& ra = buf_.read_a();
+		if(buf_.rdid() < skip_ || strlen(ra.readOrigBuf) == 0 ||
+		   !parse(ra, buf_.read_b()))
+		{
+			// Left for nextReadPair() to pass over; sort it last
+			keys_.push_back(make_pair(~(uint64_t)0, (uint32_t)i));
+			continue;
+		}
+		if(paired()) {
+			finalizePair(ra, buf_.read_b());
+		} else {
+			finalize(ra);
+		}
+		parsed_[i] = true;
+		// Same digits as the ftab offset of the read's 3' end, then
+		// the characters the search visits next, leftward from there;
+		// Ns count as As
+		const int len = (int)seqan::length(ra.patFw);
+		uint64_t key = 0;
+		for(int j = sortChars_; j > sortChars_ - 32; j--) {
+			int off = (j > 0) ? len - j : len - sortChars_ - 1 + j;
+			key <<= 2;
+			if(off >= 0 && off < len) key |= std::min((int)ra.patFw[off], 3);
+		}
+		keys_.push_back(make_pair(key, (uint32_t)i));
+	}
+	std::sort(keys_.begin(), keys_.end());
+	buf_.order_.resize(nslots);
+	for(size_t i = 0; i < nslots; i++) {
+		buf_.order_[i] = (i < keys_.size()) ? keys_[i].second : (uint32_t)i;
+	}
+	buf_.cur_buf_ = 0;
+}
+
 /**
  * The main member function for dispensing pairs of reads or
  * singleton reads.  Returns true iff ra and rb contain a new
@@ -253,6 +438,7 @@ pair<bool, int> CFilePatternSource::nextBatchImpl(
 	}
 	assert_geq(nread, 0);
 	readCnt_ += nread;
+	bytesCnt_ = doneBytes_ + filePos();
 	return make_pair(done, nread);
 }
 
@@ -276,6 +462,7 @@ pair<bool, int> CFilePatternSource::nextBatch(
  */
 void CFilePatternSource::open() {
 	if(is_open_) {
+		doneBytes_ += filePos();
 		is_open_ = false;
 		if (compressed_) {
 			gzclose(zfp_);
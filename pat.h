@@ -318,18 +318,32 @@ struct PerThreadReadBuf {
 		reset();
 	}
 	
-	Read& read_a() { return bufa_[cur_buf_]; }
-	Read& read_b() { return bufb_[cur_buf_]; }
+	Read& read_a() { return bufa_[slot()]; }
+	Read& read_b() { return bufb_[slot()]; }
 	
-	const Read& read_a() const { return bufa_[cur_buf_]; }
-	const Read& read_b() const { return bufb_[cur_buf_]; }
+	const Read& read_a() const { return bufa_[slot()]; }
+	const Read& read_b() const { return bufb_[slot()]; }
+	
+	/**
+	 * Return the buffer slot of the read/pair under the cursor.
+	 */
+	size_t slot() const {
+		return order_.empty() ? cur_buf_ : order_[cur_buf_];
+	}
 	
 	/**
 	 * Return read id for read/pair currently in the buffer.
 	 */
 	TReadId rdid() const {
 		assert_neq(rdid_, std::numeric_limits<TReadId>::max());
-		return rdid_ + cur_buf_;
+		return rdid_ + slot();
+	}
+	
+	/**
+	 * Return read id of the first read in the current batch.
+	 */
+	TReadId batchRdid() const {
+		return rdid_;
 	}
 	
 	/**
@@ -337,11 +351,12 @@ struct PerThreadReadBuf {
 	 */
 	void reset() {
 		cur_buf_ = bufa_.size();
-		for(size_t i = 0; i < max_buf_; i++) {
+		for(size_t i = 0; i < bufa_.size(); i++) {
 			bufa_[i].reset();
 			bufb_[i].reset();
 		}
 		rdid_ = std::numeric_limits<TReadId>::max();
+		order_.clear();
 	}
 	
 	/**
@@ -357,7 +372,17 @@ struct PerThreadReadBuf {
 	 */
 	bool exhausted() {
 		assert_leq(cur_buf_, bufa_.size());
-		return cur_buf_ >= bufa_.size()-1;
+		return cur_buf_ >= max_buf_-1;
+	}
+
+	/**
+	 * Set the # reads to read into the buffer at once, up to the
+	 * number of slots.  Takes effect with the next batch.
+	 */
+	void setMaxBuf(size_t max_buf) {
+		assert_gt(max_buf, 0);
+		assert_leq(max_buf, bufa_.size());
+		max_buf_ = max_buf;
 	}
 	
 	/**
@@ -376,11 +401,12 @@ struct PerThreadReadBuf {
 		assert_neq(rdid_, std::numeric_limits<TReadId>::max());
 	}
 	
-	const size_t max_buf_; // max # reads to read into buffer at once
+	size_t max_buf_;       // max # reads to read into buffer at once
 	vector<Read> bufa_; // Read buffer for mate as
 	vector<Read> bufb_; // Read buffer for mate bs
 	size_t cur_buf_;       // Read buffer currently active
 	TReadId rdid_;         // index of read at offset 0 of bufa_/bufb_
+	std::vector<uint32_t> order_; // slot to dish out at each cursor position; empty -> in order
 };
 
 
@@ -396,6 +422,7 @@ class PatternSource {
 public:
 	PatternSource() :
 		readCnt_(0),
+		bytesCnt_(0),
 		mutex()
 	{ }
 
@@ -419,13 +446,26 @@ public:
 	virtual bool parse(Read& ra, Read& rb, TReadId rdid) const = 0;
 	
 	/// Reset state to start over again with the first read
-	virtual void reset() { readCnt_ = 0; }
+	virtual void reset() { readCnt_ = 0; bytesCnt_ = 0; }
 
 	/**
 	 * Return the number of reads attempted.
 	 */
 	TReadId readCount() const { return readCnt_; }
 
+	/**
+	 * Return the number of input bytes consumed so far (compressed
+	 * bytes for compressed input).  Read without locking, so may lag
+	 * slightly behind.
+	 */
+	uint64_t bytesRead() const { return bytesCnt_; }
+
+	/**
+	 * Return the total size of the input, in the same units as
+	 * bytesRead(), or 0 if it isn't known (e.g. for stdin).
+	 */
+	virtual uint64_t bytesTotal() const { return 0; }
+
 protected:
 
 	/**
@@ -443,6 +483,9 @@ protected:
 	/// The number of reads read by this PatternSource
 	volatile uint64_t readCnt_;
 
+	/// The number of input bytes consumed by this PatternSource
+	volatile uint64_t bytesCnt_;
+
 	/// Lock enforcing mutual exclusion for (a) file I/O, (b) writing fields
 	/// of this or another other shared object.
 	MUTEX_T mutex;
@@ -541,7 +584,9 @@ public:
 		fp_(NULL),
 		qfp_(NULL),
 		is_open_(false),
-		first_(true)
+		first_(true),
+		doneBytes_(0),
+		totBytes_(0)
 	{
 		qinfiles_.clear();
 		if(qinfiles != NULL) qinfiles_ = *qinfiles;
@@ -556,6 +601,17 @@ public:
 		}
 		open(); // open first file in the list
 		filecur_++;
+		// Total size is only known if every input is a regular file
+		for(size_t i = 0; i < infiles_.size(); i++) {
+			struct stat st;
+			if(infiles_[i] == "-" || stat(infiles_[i].c_str(), &st) != 0 ||
+			   !S_ISREG(st.st_mode))
+			{
+				totBytes_ = 0;
+				break;
+			}
+			totBytes_ += (uint64_t)st.st_size;
+		}
 	}
 
 	virtual ~CFilePatternSource() {
@@ -591,6 +647,12 @@ public:
 		bool batch_a,
 		bool lock);
 	
+	/**
+	 * Return the summed sizes of the input files, or 0 if any of them
+	 * isn't a regular file.
+	 */
+	virtual uint64_t bytesTotal() const { return totBytes_; }
+
 	/**
 	 * Reset so that next call to nextBatch* gets the first batch.
 	 * Should only be called by the master thread.
@@ -598,6 +660,7 @@ public:
 	virtual void reset() {
 		TrimmingPatternSource::reset();
 		filecur_ = 0,
+		doneBytes_ = 0;
 		open();
 		filecur_++;
 	}
@@ -631,6 +694,24 @@ protected:
 		return compressed_ ? gzungetc(c, zfp_) : ungetc(c, fp_);
 	}
 
+	/**
+	 * Return how far into the current (possibly compressed) file we've
+	 * read.
+	 */
+	uint64_t filePos() {
+		if(!is_open_) return 0;
+		if(compressed_) {
+#if ZLIB_VERNUM < 0x1240
+			return 0;
+#else
+			z_off_t off = gzoffset(zfp_);
+			return off < 0 ? 0 : (uint64_t)off;
+#endif
+		}
+		long off = ftell(fp_);
+		return off < 0 ? 0 : (uint64_t)off;
+	}
+
 	bool is_gzipped_file(const std::string& filename) {
 		struct stat s;
 		if (stat(filename.c_str(), &s) != 0) {
@@ -660,6 +741,8 @@ protected:
 	char buf_[64*1024]; /// file buffer for sequences
 	char qbuf_[64*1024]; /// file buffer for qualities
     bool compressed_;
+	uint64_t doneBytes_; /// bytes in input files we're done with
+	uint64_t totBytes_;  /// bytes in all input files; 0 if unknown
 
 private:
 
@@ -1177,6 +1260,99 @@ protected:
 	vector<PatternSource*> srcb_; /// PatternSources for 2nd mates
 };
 
+/**
+ * Lets whoever runs the search threads throttle them at batch
+ * boundaries; see WorkerPool.
+ */
+class BatchGate {
+public:
+	virtual ~BatchGate() { }
+
+	/**
+	 * Called by thread 'tid' before it fetches a new batch.  May block
+	 * until the thread is allowed to continue.  Returns false if the
+	 * thread should instead stop as though the input were exhausted.
+	 */
+	virtual bool enter(int tid) = 0;
+
+	/**
+	 * Called when a thread learns that the input is exhausted, or that
+	 * it has read as much of it as it will (-u).
+	 */
+	virtual void exhausted() = 0;
+};
+
+/**
+ * Chooses how many reads each search thread takes per batch
+ * (--adapt-batch).  A thread's batches grow while getting them (waiting
+ * for the input lock, then parsing under it) takes more than a few
+ * percent of its time, and shrink back toward the base size when it
+ * takes less.  Near the end of the input, batches shrink so that the
+ * reads left are spread over all threads and they finish together.
+ * Each thread writes only its own slot; the totals for --progress are
+ * read without locks.
+ */
+class BatchSizer {
+
+	static const size_t GROW_MAX      = 8;    // batches grow to at most base x this
+	static const size_t MAX_CAPACITY  = 1024; // ... and to at most this many reads
+	static const int    TAIL_BATCHES  = 4;    // batches per thread to split the tail into
+
+public:
+
+	/**
+	 * Size batches for 'nthreads' threads starting from 'base' reads,
+	 * gauging how much input is left from 'srcs'.
+	 */
+	BatchSizer(
+		size_t base,
+		int nthreads,
+		const std::vector<PatternSource*>& srcs);
+
+	~BatchSizer();
+
+	/**
+	 * Return the most reads a batch may hold.
+	 */
+	size_t capacity() const { return cap_; }
+
+	/**
+	 * Return the size of thread 'tid's next batch.
+	 */
+	size_t next(int tid);
+
+	/**
+	 * Note that thread 'tid' took 'fetchUs' microseconds to get its
+	 * last batch, of 'n' reads, and 'workUs' to align them.
+	 */
+	void record(int tid, size_t n, uint64_t fetchUs, uint64_t workUs);
+
+	/**
+	 * Return the mean size of the threads' latest batches, and the
+	 * fraction of their time spent getting batches.
+	 */
+	void stats(double& size, double& fetchFrac) const;
+
+private:
+
+	/// One thread's sizing state and totals, padded to a cache line
+	struct Slot {
+		volatile uint64_t size;    /// size batches have grown or shrunk to
+		volatile uint64_t last;    /// size of the thread's latest batch
+		volatile uint64_t reads;   /// reads fetched
+		volatile uint64_t fetchUs; /// time spent getting batches
+		volatile uint64_t workUs;  /// time spent aligning batches
+		double            ratio;   /// smoothed fraction of time getting batches
+		char pad_[64 - 5 * sizeof(uint64_t) - sizeof(double)];
+	};
+
+	size_t base_;
+	size_t cap_;
+	int nthreads_;
+	std::vector<PatternSource*> srcs_;
+	Slot *slots_;
+};
+
 /**
  * Encapsulates a single thread's interaction with the PatternSource.
  * Most notably, this class holds the buffers into which the
@@ -1192,13 +1368,25 @@ public:
 		PatternComposer& composer,
 		uint32_t max_buf,
 		uint32_t skip,
-		uint32_t seed) :
+		uint32_t seed,
+		BatchGate *gate = NULL,
+		int tid = 0,
+		int sortChars = 0,
+		BatchSizer *sizer = NULL) :
 		composer_(composer),
-		buf_(max_buf),
+		buf_(sizer == NULL ? max_buf : sizer->capacity()),
       	last_batch_(false),
 		last_batch_size_(0),
 		skip_(skip),
-		seed_(seed) { }
+		seed_(seed),
+		gate_(gate),
+		tid_(tid),
+		sortChars_(sortChars),
+		sizer_(sizer),
+		fetchUs_(0),
+		fetchedAt_(0),
+		parsed_(),
+		keys_() { }
 
 	/**
 	 * Get the next paired or unpaired read from the wrapped
@@ -1208,6 +1396,14 @@ public:
 	 */
 	std::pair<bool, bool> nextReadPair();
 
+	/**
+	 * Called when the caller stops reading before the input is
+	 * exhausted because it has all the reads it wants (-u).
+	 */
+	void stop() {
+		if(gate_ != NULL) gate_->exhausted();
+	}
+
 	Read& bufa() { return buf_.read_a(); }
 	Read& bufb() { return buf_.read_b(); }
 	
@@ -1216,6 +1412,12 @@ public:
 	
 	TReadId rdid() const { return buf_.rdid(); }
 	
+	/**
+	 * Return the read id of the first read in the current batch; it
+	 * changes exactly when a new batch is started.
+	 */
+	TReadId batchRdid() const { return buf_.batchRdid(); }
+	
 	/**
 	 * Return true iff the read currently in the buffer is a
 	 * paired-end read.
@@ -1234,12 +1436,7 @@ private:
 	 * the current batch, we go get the next one by calling into
 	 * the composition layer.
 	 */
-	std::pair<bool, int> nextBatch() {
-		buf_.reset();
-		std::pair<bool, int> res = composer_.nextBatch(buf_);
-		buf_.init();
-		return res;
-	}
+	std::pair<bool, int> nextBatch();
 
 	/**
 	 * Once name/sequence/qualities have been parsed for an
@@ -1263,12 +1460,29 @@ private:
 		return composer_.parse(ra, rb, buf_.rdid());
 	}
 
+	/**
+	 * Parse and finalize all 'n' reads of a new batch up front, then
+	 * order them by the 'sortChars_' characters at their 3' ends and
+	 * the characters a search visits after those, so that reads whose
+	 * searches begin in the same part of the index are searched back
+	 * to back.
+	 */
+	void sortBatch(int n);
+
 	PatternComposer& composer_; // pattern composer
 	PerThreadReadBuf buf_;    // read data buffer
 	bool last_batch_;         // true if this is final batch
 	int last_batch_size_;     // # reads read in previous batch
 	uint32_t skip_;           // skip reads with rdids less than this
 	uint32_t seed_;           // pseudo-random seed based on read content
+	BatchGate *gate_;         // consulted before each batch; may be NULL
+	int tid_;                 // id of the thread that owns this object
+	int sortChars_;           // sort batches by this many 3' chars; 0 = don't
+	BatchSizer *sizer_;       // sizes each batch; NULL -> always max_buf
+	uint64_t fetchUs_;        // time taken to get the current batch
+	uint64_t fetchedAt_;      // when the current batch was got
+	std::vector<bool> parsed_;    // per slot: parsed ok by sortBatch()?
+	std::vector<std::pair<uint64_t, uint32_t> > keys_; // sortBatch() scratch: key, slot
 };
 
 /**
@@ -1280,17 +1494,25 @@ public:
 		PatternComposer& composer,
 		uint32_t max_buf,
 		uint32_t skip,
-		uint32_t seed):
+		uint32_t seed,
+		BatchGate *gate = NULL,
+		int tid = 0,
+		int sortChars = 0,
+		BatchSizer *sizer = NULL):
 		composer_(composer),
 		max_buf_(max_buf),
 		skip_(skip),
-		seed_(seed) {}
+		seed_(seed),
+		gate_(gate),
+		tid_(tid),
+		sortChars_(sortChars),
+		sizer_(sizer) {}
 
 	/**
 	 * Create a new heap-allocated PatternSourcePerThreads.
 	 */
 	virtual PatternSourcePerThread* create() const {
-		return new PatternSourcePerThread(composer_, max_buf_, skip_, seed_);
+		return new PatternSourcePerThread(composer_, max_buf_, skip_, seed_, gate_, tid_, sortChars_, sizer_);
 	}
 
 	/**
@@ -1300,7 +1522,7 @@ public:
 	virtual std::vector<PatternSourcePerThread*>* create(uint32_t n) const {
 		std::vector<PatternSourcePerThread*>* v = new std::vector<PatternSourcePerThread*>;
 		for(size_t i = 0; i < n; i++) {
-			v->push_back(new PatternSourcePerThread(composer_, max_buf_, skip_, seed_));
+			v->push_back(new PatternSourcePerThread(composer_, max_buf_, skip_, seed_, gate_, tid_, sortChars_, sizer_));
 			assert(v->back() != NULL);
 		}
 		return v;
@@ -1336,6 +1558,13 @@ private:
 	uint32_t max_buf_;
 	uint32_t skip_;
 	uint32_t seed_;
+	/// Gate passed to each PatternSourcePerThread, and its thread id
+	BatchGate *gate_;
+	int tid_;
+	/// Passed to each PatternSourcePerThread; see sortBatch()
+	int sortChars_;
+	/// Sizes the batches of each PatternSourcePerThread; may be NULL
+	BatchSizer *sizer_;
 };
 
 #endif /*PAT_H_*/
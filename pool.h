@@ -8,119 +8,134 @@
 #include <iostream>
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 #include <string.h>
 #include <stdlib.h>
 #include "bitset.h"
 #include "log.h"
 #include "search_globals.h"
 
+/// Bytes of chunk memory a ChunkPool reserves at a time
+static const uint32_t CHUNK_SLAB_BYTES = 8 * 1024 * 1024;
+
 /**
- * Very simple allocator for fixed-size chunks of memory.  Chunk size
- * is set at construction time.  Heap memory is only allocated at
- * construction and deallocated at destruction.
+ * Allocator for fixed-size chunks of memory, scoped to the search for
+ * one read.  Chunks are carved off large slabs with a bump pointer and
+ * freed chunks are recycled LIFO; reset() hands everything back at
+ * once.  Slabs are only reserved when a read needs them, up to the
+ * pool's total size, and are kept from read to read.
  */
 class ChunkPool {
 public:
 	/**
-	 * Initialize a new pool with an initial size of about 'bytes'
-	 * bytes.  Exit with an error message if we can't allocate it.
+	 * Initialize a new pool of chunks of 'chunkSz' bytes that can grow
+	 * to about 'totSz' bytes.
 	 */
 	ChunkPool(uint32_t chunkSz, uint32_t totSz, bool verbose_) :
-		verbose(verbose_), patid(0), pool_(NULL), cur_(0),
+		verbose(verbose_), patid(0), slabs_(), free_(), slab_(0), cur_(0),
 		chunkSz_(chunkSz), totSz_(totSz), lim_(totSz/chunkSz),
-		bits_(lim_), exhaustCrash_(false),
+		slabChunks_(std::max<uint32_t>(1, std::min(lim_, CHUNK_SLAB_BYTES/chunkSz))),
+		used_(0), peak_(0), maxPeak_(0), exhaustCrash_(false),
 		lastSkippedRead_(0xffffffff), readName_(NULL)
 	{
 		assert_gt(lim_, 0);
-		try {
-			if((pool_ = new int8_t[totSz_]) == NULL) {
-				throw std::bad_alloc();
-			}
-		} catch(std::bad_alloc& e) {
-			ThreadSafe _ts(&gLock);
-			std::cerr << "Error: Could not allocate ChunkPool of "
-			          << totSz << " bytes" << std::endl;
-			exhausted();
-			throw 1; // Exit if we haven't already
-		}
 	}
 
 	/**
-	 * Delete all the pools.
+	 * Delete all the slabs.
 	 */
 	~ChunkPool() {
-		if(pool_ != NULL) delete[] pool_;
+		for(size_t i = 0; i < slabs_.size(); i++) {
+			delete[] slabs_[i];
+		}
 	}
 
 	/**
 	 * Reset the pool, freeing all arrays that had been given out.
 	 */
 	void reset(String<char>* name, uint32_t patid_) {
+		if(verbose && peak_ > 0) {
+			stringstream ss;
+			ss << patid << ": Peak chunk memory: " << ((uint64_t)peak_ * chunkSz_) << " bytes";
+			glog.msg(ss.str());
+		}
+		maxPeak_ = std::max(maxPeak_, peak_);
 		patid = patid_;
 		readName_ = name;
-		cur_ = 0;
-		bits_.clear();
-		assert_eq(0, bits_.test(0));
+		slab_ = cur_ = 0;
+		free_.clear();
+		used_ = peak_ = 0;
 	}
 
 	/**
-	 * Return our current position.
+	 * Return the number of chunks ever carved off the slabs since the
+	 * last reset.
 	 */
 	uint32_t pos() {
-		return cur_;
+		return slab_ * slabChunks_ + cur_;
 	}
 
 	/**
-	 * Return our current position.
+	 * Return the number of chunks that can still be given out.
 	 */
 	uint32_t remaining() {
-		assert_geq(lim_, cur_);
-		return lim_ - cur_;
+		assert_geq(lim_, used_);
+		return lim_ - used_;
 	}
 
 	/**
-	 * Allocate a single T from the pool.
+	 * Allocate a single chunk from the pool, or return NULL if the pool
+	 * is at its limit or can't grow.
 	 */
 	void* alloc() {
-		assert_lt(cur_, lim_);
-		uint32_t cur = cur_;
-		while(bits_.test(cur)) {
-			cur++;
-			if(cur >= lim_) {
-				cur = 0;
+		int8_t *ptr;
+		if(!free_.empty()) {
+			ptr = free_.back();
+			free_.pop_back();
+		} else {
+			if(pos() >= lim_) {
+				return NULL;
+			}
+			if(cur_ == slabChunks_) {
+				slab_++;
+				cur_ = 0;
 			}
-			if(cur == cur_) {
-				// Wrapped all the way around without finding a free
-				// chunk
+			if(slab_ == slabs_.size() && !grow()) {
 				return NULL;
 			}
+			ptr = &slabs_[slab_][cur_ * chunkSz_];
+			cur_++;
 		}
-		void * ptr = (void *)(&pool_[cur * chunkSz_]);
-		assert(!bits_.test(cur));
-		bits_.set(cur);
-		assert(bits_.test(cur));
+		used_++;
+		peak_ = std::max(peak_, used_);
 		if(verbose) {
 			stringstream ss;
-			ss << patid << ": Allocating chunk with offset: " << cur;
+			ss << patid << ": Allocating chunk; " << used_ << " in use";
 			glog.msg(ss.str());
 		}
-		cur_ = cur;
-		return ptr;
+		return (void *)ptr;
 	}
 
 	/**
-	 *
+	 * Return a chunk to the pool.
 	 */
 	void free(void *ptr) {
-		uint32_t off = (uint32_t)((int8_t*)ptr - pool_);
-		assert_eq(0, off % chunkSz_);
-		off /= chunkSz_;
+		assert_gt(used_, 0);
 		if(verbose) {
 			stringstream ss;
-			ss << patid << ": Freeing chunk with offset: " << cur_;
+			ss << patid << ": Freeing chunk; " << (used_-1) << " in use";
 			glog.msg(ss.str());
 		}
-		bits_.clear(off);
+		free_.push_back((int8_t*)ptr);
+		used_--;
+	}
+
+	/**
+	 * Return the most memory, in bytes, any one read has had in use at
+	 * once so far.
+	 */
+	uint64_t peakBytes() const {
+		return (uint64_t)std::max(maxPeak_, peak_) * chunkSz_;
 	}
 
 	/**
@@ -151,7 +166,7 @@ public:
 			}
 			if(exhaustCrash_) {
 				if(!quiet) {
-					std::cerr << "Please try specifying a larger --chunkmbs <int> (default is 32)" << std::endl;
+					std::cerr << "Please try specifying a larger --chunkmbs <int> (default is 512)" << std::endl;
 				}
 				throw 1;
 			}
@@ -164,12 +179,36 @@ public:
 
 protected:
 
-	int8_t*  pool_; /// the memory pools
-	uint32_t cur_;  /// index of next free element of pool_
+	/**
+	 * Reserve another slab; return false if we're out of memory.
+	 */
+	bool grow() {
+		int8_t *slab = NULL;
+		try {
+			slab = new int8_t[(size_t)slabChunks_ * chunkSz_];
+		} catch(std::bad_alloc& e) {
+			return false;
+		}
+		if(verbose) {
+			stringstream ss;
+			ss << patid << ": Reserving chunk slab " << slabs_.size();
+			glog.msg(ss.str());
+		}
+		slabs_.push_back(slab);
+		return true;
+	}
+
+	std::vector<int8_t*> slabs_; /// slabs reserved so far
+	std::vector<int8_t*> free_;  /// freed chunks, most recent last
+	uint32_t slab_; /// slab we're carving chunks from
+	uint32_t cur_;  /// index of next uncarved chunk in slab_
 	const uint32_t chunkSz_;
 	const uint32_t totSz_;
-	uint32_t lim_;  /// # elements held in pool_
-	FixedBitset2 bits_;
+	uint32_t lim_;  /// most chunks we'll give out at once
+	uint32_t slabChunks_; /// # chunks per slab
+	uint32_t used_; /// # chunks given out and not freed
+	uint32_t peak_; /// most chunks given out at once for this read
+	uint32_t maxPeak_; /// largest peak_ of any earlier read
 	bool exhaustCrash_; /// abort hard when memory's exhausted?
 	uint32_t lastSkippedRead_;
 	String<char>* readName_;
@@ -0,0 +1,191 @@
+/*
+ * progress.h
+ *
+ * Periodic reporting of alignment throughput while a run is in
+ * progress (--progress).  A background thread wakes up every so often,
+ * sums the HitSink's per-thread tallies and the read sources' byte
+ * counts without taking any locks, and prints a one-line JSON summary
+ * of the rates since the previous report.
+ */
+
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#ifdef WITH_TBB
+#include <thread>
+#endif
+#include "threading.h"
+#include "hit.h"
+#include "pat.h"
+
+/**
+ * Owns the reporter thread.  Construct after the HitSink and read
+ * sources exist; call start() before the search begins and stop()
+ * once it's over (but before the HitSink is destroyed).
+ */
+class ProgressReporter {
+
+public:
+
+	/**
+	 * Report every 'interval' seconds on the alignments going through
+	 * 'sink' and the reads coming from 'srcs', and on the batch sizes
+	 * chosen by 'sizer' if it's non-NULL.  If 'statusFile' is empty,
+	 * reports are appended to stderr; otherwise each report replaces
+	 * the contents of 'statusFile'.
+	 */
+	ProgressReporter(
+		const HitSink& sink,
+		const std::vector<PatternSource*>& srcs,
+		int interval,
+		const std::string& statusFile,
+		const BatchSizer *sizer = NULL) :
+		sink_(sink),
+		srcs_(srcs),
+		sizer_(sizer),
+		interval_(interval > 0 ? interval : 1),
+		statusFile_(statusFile),
+		stop_(false),
+		thread_(NULL),
+		start_(0),
+		last_(0)
+	{
+		memset(&lastTallies_, 0, sizeof(lastTallies_));
+	}
+
+	~ProgressReporter() {
+		stop();
+	}
+
+	/**
+	 * Launch the reporter thread.
+	 */
+	void start() {
+		assert(thread_ == NULL);
+		start_ = last_ = time(0);
+#ifdef WITH_TBB
+		thread_ = new std::thread(ProgressReporter::run, (void*)this);
+#else
+		thread_ = new tthread::thread(ProgressReporter::run, (void*)this);
+#endif
+	}
+
+	/**
+	 * Stop the reporter thread and print a final report covering the
+	 * whole run.
+	 */
+	void stop() {
+		if(thread_ == NULL) return;
+		stop_ = true;
+		thread_->join();
+		delete thread_;
+		thread_ = NULL;
+		report(true);
+	}
+
+private:
+
+	/**
+	 * Body of the reporter thread.  Wakes up every 100 ms so that
+	 * stop() doesn't have to wait a whole interval.
+	 */
+	static void run(void *vp) {
+		ProgressReporter *pr = reinterpret_cast<ProgressReporter*>(vp);
+		while(!pr->stop_) {
+			SLEEP(100);
+			if(!pr->stop_ && time(0) - pr->last_ >= pr->interval_) {
+				pr->report(false);
+			}
+		}
+	}
+
+	/**
+	 * Print one report.  Rates are computed over the time since the
+	 * previous report, or over the whole run if 'final' is true.
+	 */
+	void report(bool final) {
+		time_t now = time(0);
+		HitSinkTallies cur;
+		sink_.tallies(cur);
+		uint64_t bytesIn = 0;
+		for(size_t i = 0; i < srcs_.size(); i++) {
+			if(srcs_[i] != NULL) bytesIn += srcs_[i]->bytesRead();
+		}
+		HitSinkTallies prev;
+		time_t since = final ? start_ : last_;
+		if(final) {
+			memset(&prev, 0, sizeof(prev));
+		} else {
+			prev = lastTallies_;
+		}
+		double secs = (double)(now - since);
+		if(secs <= 0.0) secs = 1.0;
+		uint64_t reads     = cur.numAligned + cur.numUnaligned;
+		uint64_t dReads    = reads - (prev.numAligned + prev.numUnaligned);
+		uint64_t als       = cur.numReported + cur.numReportedPaired / 2;
+		uint64_t dAls      = als - (prev.numReported + prev.numReportedPaired / 2);
+		uint64_t dUnal     = cur.numUnaligned - prev.numUnaligned;
+		uint64_t dMaxed    = cur.numMaxed - prev.numMaxed;
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(2)
+		   << "{\"final\":" << (final ? "true" : "false")
+		   << ",\"elapsed\":" << (uint64_t)(now - start_)
+		   << ",\"reads\":" << reads
+		   << ",\"reads_per_s\":" << (dReads / secs)
+		   << ",\"alignments\":" << als
+		   << ",\"alignments_per_s\":" << (dAls / secs)
+		   << std::setprecision(4)
+		   << ",\"unaligned_rate\":" << (dReads > 0 ? (double)dUnal / dReads : 0.0)
+		   << ",\"maxed_rate\":" << (dReads > 0 ? (double)dMaxed / dReads : 0.0)
+		   << ",\"bytes_in\":" << bytesIn
+		   << ",\"bytes_out\":" << (uint64_t)cur.bytesOut;
+		if(sizer_ != NULL) {
+			double size = 0.0, fetchFrac = 0.0;
+			sizer_->stats(size, fetchFrac);
+			ss << std::setprecision(1) << ",\"batch_size\":" << size
+			   << std::setprecision(4) << ",\"batch_fetch_frac\":" << fetchFrac;
+		}
+		ss << "}\n";
+		if(statusFile_.empty()) {
+			std::cerr << ss.str() << std::flush;
+		} else {
+			// Write to a temporary file and rename so that readers
+			// never see a partial report
+			std::string tmp = statusFile_ + ".tmp";
+			FILE *f = fopen(tmp.c_str(), "w");
+			if(f != NULL) {
+				fputs(ss.str().c_str(), f);
+				fclose(f);
+				rename(tmp.c_str(), statusFile_.c_str());
+			}
+		}
+		lastTallies_ = cur;
+		last_ = now;
+	}
+
+	const HitSink&              sink_;
+	std::vector<PatternSource*> srcs_;
+	const BatchSizer           *sizer_;      /// NULL unless batches are sized adaptively
+	time_t                      interval_;    /// seconds between reports
+	std::string                 statusFile_;  /// empty -> report to stderr
+	volatile bool               stop_;        /// tells thread to exit
+#ifdef WITH_TBB
+	std::thread                *thread_;
+#else
+	tthread::thread            *thread_;
+#endif
+	time_t                      start_;       /// time reporting started
+	time_t                      last_;        /// time of last report
+	HitSinkTallies              lastTallies_; /// tallies as of last report
+};
+
+#endif /* PROGRESS_H_ */
@@ -1,7 +1,17 @@
 /*
  * range_cache.h
  *
- * Classes that encapsulate the caching of
+ * Classes that encapsulate the caching of reference offsets resolved
+ * for BW ranges, so that repetitive reads that land in the same large
+ * ranges don't have to walk every row back to a marked row again.
+ *
+ * One RangeCache per index is shared by all search threads.  Lookups
+ * and installs don't take a lock: entries are found through an open-
+ * addressing table whose slots are guarded by sequence counters, and a
+ * thread pins an entry while it holds a view of it.  Creating an entry
+ * takes the cache's lock; when memory runs out, a clock hand recycles
+ * entries that haven't been used since it last passed and that nobody
+ * has pinned.
  */
 
 #ifndef RANGE_CACHE_H_
@@ -11,115 +21,54 @@
 #include <utility>
 #include <iostream>
 #include <stdexcept>
-#include <map>
+#include <vector>
 #include "ebwt.h"
 #include "row_chaser.h"
+#include "threading.h"
 
 #define RANGE_NOT_SET OFF_MASK
-#define RANGE_CACHE_BAD_ALLOC OFF_MASK
+
+/// Reference offsets held by one block of cache memory
+static const uint32_t RANGE_CACHE_BLOCK_ROWS = 16;
+/// Marks the end of a block chain, or no block at all
+static const uint32_t RANGE_CACHE_NO_BLOCK = 0xffffffff;
+/// Table slots examined before a lookup or insert gives up
+static const uint32_t RANGE_CACHE_MAX_PROBE = 32;
 
 /**
- * Manages a pool of memory used exclusively for range cache entries.
- * This manager is allocate-only; it exists mainly so that we can avoid
- * lots of new[]s and delete[]s.
- *
- * A given stretch of words may be one of two types: a cache entry, or
- * a cache entry wrapper.  A cache entry has a length and a list of
- * already-resolved reference positions.  A cache entry wrapper has a
- * pointer to a cache entry for a different range, along with an
- * integer indicating how many "jumps" to the left that range is from
- * the one that owns the wrapper.
+ * Metadata for a fixed-size unit of cache memory.  A cache entry is a
+ * chain of one or more blocks; the first (head) block's metadata
+ * describes the whole entry.
  */
-class RangeCacheMemPool {
-public:
-	RangeCacheMemPool(TIndexOffU lim /* max cache size in bytes */) :
-		lim_(lim >> 2 /* convert to words */), occ_(0), buf_(NULL),
-		closed_(false)
-	{
-		if(lim_ > 0) {
-			try {
-				buf_ = new TIndexOffU[lim_];
-				if(buf_ == NULL) throw std::bad_alloc();
-			} catch(std::bad_alloc& e) {
-				cerr << "Allocation error allocating " << lim
-					 << " words of range-cache memory" << endl;
-				throw 1;
-			}
-			assert(buf_ != NULL);
-			// Fill with 1s to signal that these elements are
-			// uninitialized
-			memset(buf_, 0xff, lim_ << 2 /* convert back to bytes */);
-		}
-	}
-
-	~RangeCacheMemPool() {
-		// Release all word memory!
-		if(lim_ > 0) delete[] buf_;
-	}
-
-	/**
-	 * Allocate numElts elements from the word pool.
-	 */
-	TIndexOffU alloc(TIndexOffU numElts) {
-		assert_gt(numElts, 0);
-		assert_leq(occ_, lim_);
-		if(occ_ + numElts > lim_ || numElts >= CACHE_WRAPPER_BIT) {
-			return RANGE_CACHE_BAD_ALLOC;
-		}
-		assert_gt(lim_, 0);
-		TIndexOffU ret = occ_;
-		assert(allocs_.find(ret) == allocs_.end());
-		ASSERT_ONLY(allocs_.insert(ret));
-		// Clear the first elt so that we don't think there's already
-		// something there
-#ifndef NDEBUG
-		for(TIndexOffU i = 0; i < numElts; i++) {
-			assert_eq(OFF_MASK, buf_[occ_ + i]);
-		}
-#endif
-		buf_[occ_] = 0;
-		occ_ += numElts;
-		assert_leq(occ_, lim_);
-		if(lim_ - occ_ < 10) {
-			// No more room - don't try anymore
-			closed_ = true;
-		}
-		return ret;
-	}
-
-	/**
-	 * Turn a pool-array index into a pointer; check that it doesn't
-	 * fall outside the pool first.
-	 */
-	inline TIndexOffU *get(TIndexOffU off) {
-		assert_gt(lim_, 0);
-		assert_lt(off, lim_);
-		assert(allocs_.find(off) != allocs_.end());
-		TIndexOffU *ret = buf_ + off;
-		assert_neq(CACHE_WRAPPER_BIT, ret[0]);
-		assert_neq(OFF_MASK, ret[0]);
-		return ret;
-	}
-
-	/**
-	 * Return true iff there's no more room in the cache.
-	 */
-	inline bool closed() {
-		return closed_;
-	}
+struct RangeCacheBlock {
+	volatile int32_t  pins; /// views holding the entry; -1 -> being recycled
+	volatile uint32_t gen;  /// incremented every time the entry is recycled
+	volatile uint32_t ref;  /// clock bit: used since the hand last passed?
+	uint32_t          next; /// next block in the chain
+	TIndexOffU        top;  /// head: top of the entry's range; else RANGE_NOT_SET
+	TIndexOffU        len;  /// head: # rows in the entry's range
+};
 
-private:
-	TIndexOffU lim_;  /// limit on number of 32-bit words to dish out in total
-	TIndexOffU occ_;  /// number of occupied words
-	TIndexOffU *buf_; /// buffer of 32-bit words
-	bool closed_;   ///
-#ifndef NDEBUG
-	std::set<TIndexOffU> allocs_; // elements allocated
-#endif
+/**
+ * A slot in the table mapping range tops to entries.  A slot whose key
+ * is the top of a range further right in an entry's "tunnel" refers to
+ * that entry with a non-zero number of jumps.  Slots are written only
+ * under the cache's lock; seq is odd while a write is in progress.
+ */
+struct RangeCacheSlot {
+	volatile uint32_t   seq;
+	volatile uint32_t   block; /// head block of the entry
+	volatile uint32_t   gen;   /// generation of that block when written
+	volatile TIndexOffU key;   /// range top, or RANGE_NOT_SET if never used
+	volatile TIndexOffU jumps; /// # LF steps from key's range to the entry's
+	volatile TIndexOffU len;   /// # rows of key's range known to map to the entry
 };
 
+class RangeCache;
+
 /**
- * A view to a range of cached reference positions.
+ * A view to a range of cached reference positions.  The entry stays
+ * pinned, and so can't be recycled, until the view is reset.
  */
 class RangeCacheEntry {
 
@@ -131,107 +80,44 @@ public:
 	 *
 	 */
 	RangeCacheEntry(bool sanity = false) :
-		top_(OFF_MASK), jumps_(0), len_(0), ents_(NULL), ebwt_(NULL),
-		sanity_(sanity)
+		cache_(NULL), head_(RANGE_CACHE_NO_BLOCK), top_(OFF_MASK), jumps_(0),
+		len_(0), cur_(RANGE_CACHE_NO_BLOCK), curChunk_(0), ebwt_(NULL),
+		hits_(0), misses_(0), sanity_(sanity)
 	{ }
 
-	/**
-	 * Create a new RangeCacheEntry from the data in the pool at 'ents'.
-	 */
-	RangeCacheEntry(RangeCacheMemPool& pool, TIndexOffU top,
-			TIndexOffU ent, TEbwt* ebwt, bool sanity = false) :
-	    sanity_(sanity)
-	{
-		init(pool, top, ent, ebwt);
-	}
-
-	/**
-	 * Initialize a RangeCacheEntry from the data in the pool at 'ents'.
-	 */
-	void init(RangeCacheMemPool& pool, TIndexOffU top, TIndexOffU ent, TEbwt* ebwt) {
-		assert(ebwt != NULL);
-		top_ = top;
-		ebwt_ = ebwt;
-		TIndexOffU *ents = pool.get(ent);
-		assert_neq(CACHE_WRAPPER_BIT, ents[0]);
-		// Is hi bit set?
-		if((ents[0] & CACHE_WRAPPER_BIT) != 0) {
-			// If so, the target is a wrapper and the non-hi bits
-			// contain the # jumps
-			jumps_ = (ents[0] & ~CACHE_WRAPPER_BIT);
-			assert_gt(jumps_, 0);
-			assert_leq(jumps_, ebwt_->_eh._len);
-			// Get the target entry
-			TIndexOffU *dest = pool.get(ents[1]);
-			// Get the length from the target entry
-			len_ = dest[0];
-			assert_leq(top_ + len_, ebwt_->_eh._len);
-			assert_gt(len_, 0);
-			assert_leq(len_, ebwt_->_eh._len);
-			// Get the pointer to the entries themselves
-			ents_ = dest + 1;
-		} else {
-			// Not a wrapper, so there are no jumps
-			jumps_ = 0;
-			// Get the length from the target entry
-			len_  = ents[0];
-			assert_leq(top_ + len_, ebwt_->_eh._len);
-			assert_gt(len_, 0);
-			assert_leq(len_, ebwt_->_eh._len);
-			// Get the pointer to the entries themselves
-			ents_ = ents + 1;
-		}
-		assert(sanityCheckEnts());
+	~RangeCacheEntry() {
+		reset();
 	}
 
 	/**
-	 * Initialize a wrapper with given number of jumps and given target
-	 * entry index.
+	 * Initialize a view of the pinned entry starting at block 'head'
+	 * for the first 'len' rows of the range with top 'top', 'jumps' LF
+	 * steps to the right of the entry's own range.
 	 */
-	void init(RangeCacheMemPool& pool, TIndexOffU top, TIndexOffU jumps,
-			TIndexOffU ent, TEbwt* ebwt)
-	{
-		assert(ebwt != NULL);
-		ebwt_ = ebwt;
-		top_ = top;
-		jumps_ = jumps;
-		TIndexOffU *ents = pool.get(ent);
-		// Must not be a wrapper
-		assert_eq(0, ents[0] & CACHE_WRAPPER_BIT);
-		// Get the length from the target entry
-		len_ = ents[0];
-		assert_gt(len_, 0);
-		assert_leq(len_, ebwt_->_eh._len);
-		// Get the pointer to the entries themselves
-		ents_ = ents + 1;
-		assert_leq(top_ + len_, ebwt_->_eh._len);
-		assert(sanityCheckEnts());
-	}
+	inline void init(RangeCache* cache, TIndexOffU top, TIndexOffU jumps,
+	                 TIndexOffU len, uint32_t head, TEbwt* ebwt);
 
 	TIndexOffU len() const   {
-		assert(ents_ != NULL);
-		assert(ebwt_ != NULL);
+		assert(valid());
 		return len_;
 	}
 
 	TIndexOffU jumps() const {
-		assert(ents_ != NULL);
-		assert(ebwt_ != NULL);
+		assert(valid());
 		return jumps_;
 	}
 
 	/**
-	 *
+	 * Unpin the entry (if any) and credit its cache with the hits and
+	 * misses seen through this view.
 	 */
-	void reset() {
-		ents_ = NULL;
-	}
+	inline void reset();
 
 	/**
 	 * Return true iff this object represents a valid cache entry.
 	 */
 	bool valid() const {
-		return ents_ != NULL;
+		return cache_ != NULL;
 	}
 
 	TEbwt *ebwt() {
@@ -243,114 +129,116 @@ public:
 	 * adjust for how many jumps down the tunnel the cache entry is
 	 * situated.
 	 */
-	void install(TIndexOffU elt, TIndexOffU val) {
-		if(ents_ == NULL) {
-			// This is not a valid cache entry; do nothing
-			return;
-		}
-		assert(ents_ != NULL);
-		assert(ebwt_ != NULL);
-		assert_leq(jumps_, val);
-		assert_neq(OFF_MASK, val);
-		assert_leq(top_ + len_, ebwt_->_eh._len);
-		if(elt < len_) {
-			val -= jumps_;
-			if(verbose_) cout << "Installed reference offset: " << (top_ + elt) << endl;
-			ASSERT_ONLY(TIndexOffU sanity = TRowChaser::toFlatRefOff(ebwt_, 1, top_ + elt));
-			assert_eq(sanity, val);
-#ifndef NDEBUG
-			for(size_t i = 0; i < len_; i++) {
-				if(i == elt) continue;
-				assert_neq(val, ents_[i]);
-			}
-#endif
-			ents_[elt] = val;
-		} else {
-			// ignore install request
-			if(verbose_) cout << "Fell off end of cache entry for install: " << (top_ + elt) << endl;
-		}
-	}
+	inline void install(TIndexOffU elt, TIndexOffU val);
 
 	/**
 	 * Get an element from the cache, adjusted for tunnel jumps.
 	 */
-	inline TIndexOffU get(TIndexOffU elt) const {
-		if(ents_ == NULL) {
-			// This is not a valid cache entry; do nothing
-			return RANGE_NOT_SET;
-		}
-		assert(ents_ != NULL);
-		assert(ebwt_ != NULL);
-		assert_leq(top_ + len_, ebwt_->_eh._len);
-		if(elt < len_ && ents_[elt] != RANGE_NOT_SET) {
-			if(verbose_) cout << "Retrieved result from cache: " << (top_ + elt) << endl;
-			TIndexOffU ret = ents_[elt] + jumps_;
-			ASSERT_ONLY(TIndexOffU sanity = TRowChaser::toFlatRefOff(ebwt_, 1, top_ + elt));
-			assert_eq(sanity, ret);
-			return ret;
-		} else {
-			if(verbose_) cout << "Cache entry not set: " << (top_ + elt) << endl;
-			return RANGE_NOT_SET;
-		}
-	}
+	inline TIndexOffU get(TIndexOffU elt);
 
-	/**
-	 * Check that len_ and the ents_ array both make sense.
-	 */
-	static bool sanityCheckEnts(TIndexOffU len, TIndexOffU *ents, TEbwt* ebwt) {
-		assert_gt(len, 0);
-		assert_leq(len, ebwt->_eh._len);
-		if(len < 10) {
-			for(size_t i = 0; i < len; i++) {
-				if(ents[i] == OFF_MASK) continue;
-				assert_leq(ents[i], ebwt->_eh._len);
-				for(size_t j = i+1; j < len; j++) {
-					if(ents[j] == OFF_MASK) continue;
-					assert_neq(ents[i], ents[j]);
-				}
-			}
-		} else {
-			std::set<TIndexOffU> seen;
-			for(size_t i = 0; i < len; i++) {
-				if(ents[i] == OFF_MASK) continue;
-				assert(seen.find(ents[i]) == seen.end());
-				seen.insert(ents[i]);
-			}
-		}
-		return true;
-	}
+private:
+
+	RangeCacheEntry(const RangeCacheEntry&);
+	RangeCacheEntry& operator=(const RangeCacheEntry&);
 
 	/**
-	 * Check that len_ and the ents_ array both make sense.
+	 * Return a pointer to the word holding element 'elt', which must
+	 * be less than len_.
 	 */
-	bool sanityCheckEnts() {
-		return RangeCacheEntry::sanityCheckEnts(len_, ents_, ebwt_);
-	}
-
-private:
-
-	TIndexOffU top_;   /// top pointer for this range
-	TIndexOffU jumps_; /// how many tunnel-jumps it is away from the requester
-	TIndexOffU len_;   /// # of entries in cache entry
-	TIndexOffU *ents_; /// ptr to entries, which are flat offs within joined ref
-	TEbwt    *ebwt_; /// index that alignments are in
-	bool     verbose_; /// be talkative?
-	bool     sanity_;  /// do consistency checks?
+	inline volatile TIndexOffU* word(TIndexOffU elt);
+
+	RangeCache *cache_;  /// cache holding the entry; NULL -> not valid
+	uint32_t   head_;    /// head block of the entry
+	TIndexOffU top_;     /// top pointer for the requester's range
+	TIndexOffU jumps_;   /// how many tunnel-jumps it is away from the requester
+	TIndexOffU len_;     /// # of entries in cache entry
+	uint32_t   cur_;     /// block most recently used by word()
+	TIndexOffU curChunk_;/// position of cur_ in the chain
+	TEbwt     *ebwt_;    /// index that alignments are in
+	uint64_t   hits_;    /// elements found in the cache
+	uint64_t   misses_;  /// elements installed after a miss
+	bool       sanity_;  /// do consistency checks?
 };
 
 /**
- *
+ * Cache of resolved reference offsets for one index, shared by all
+ * search threads.
  */
 class RangeCache {
 
 	typedef Ebwt<String<Dna> > TEbwt;
-	typedef std::vector<TIndexOffU> TUVec;
-	typedef std::map<TIndexOffU, TIndexOffU> TMap;
-	typedef std::map<TIndexOffU, TIndexOffU>::iterator TMapItr;
+	typedef RangeCacheBlock Block;
+	typedef RangeCacheSlot Slot;
+
+	friend class RangeCacheEntry;
 
 public:
+	/**
+	 * Create a cache for 'ebwt' that uses at most about 'lim' bytes.
+	 * A limit too small to hold anything disables the cache.
+	 */
 	RangeCache(TIndexOffU lim, TEbwt* ebwt) :
-		lim_(lim), map_(), pool_(lim), closed_(false), ebwt_(ebwt), sanity_(true) { }
+		lim_(0), nblocks_(0), maxChain_(0), hand_(0), mask_(0),
+		blocks_(NULL), vals_(NULL), slots_(NULL), free_(),
+		ebwt_(ebwt), hits_(0), misses_(0), evictions_(0)
+	{
+		const size_t perBlock = RANGE_CACHE_BLOCK_ROWS * sizeof(TIndexOffU) +
+		                        sizeof(Block) + 2 * sizeof(Slot);
+		size_t nblocks = lim / perBlock;
+		if(nblocks >= RANGE_CACHE_NO_BLOCK) nblocks = RANGE_CACHE_NO_BLOCK - 1;
+		if(ebwt_ == NULL || nblocks < 2) return;
+		// Twice as many slots as blocks, rounded up to a power of 2
+		size_t nslots = 1;
+		while(nslots < 2 * nblocks) nslots <<= 1;
+		try {
+			blocks_ = new Block[nblocks];
+			vals_ = new TIndexOffU[nblocks * RANGE_CACHE_BLOCK_ROWS];
+			slots_ = new Slot[nslots];
+			free_.reserve(nblocks);
+		} catch(std::bad_alloc& e) {
+			cerr << "Allocation error allocating " << lim
+			     << " bytes of range-cache memory" << endl;
+			throw 1;
+		}
+		// Fill with 1s to signal that these elements are uninitialized
+		memset(vals_, 0xff, nblocks * RANGE_CACHE_BLOCK_ROWS * sizeof(TIndexOffU));
+		for(size_t i = 0; i < nslots; i++) {
+			slots_[i].seq = 0;
+			slots_[i].block = RANGE_CACHE_NO_BLOCK;
+			slots_[i].gen = 0;
+			slots_[i].key = RANGE_NOT_SET;
+			slots_[i].jumps = 0;
+			slots_[i].len = 0;
+		}
+		for(size_t i = nblocks; i > 0; i--) {
+			Block& b = blocks_[i-1];
+			b.pins = 0;
+			b.gen = 0;
+			b.ref = 0;
+			b.next = RANGE_CACHE_NO_BLOCK;
+			b.top = RANGE_NOT_SET;
+			b.len = 0;
+			free_.push_back((uint32_t)(i-1));
+		}
+		lim_ = lim;
+		nblocks_ = (uint32_t)nblocks;
+		// Don't let one very wide range crowd out everything else
+		maxChain_ = std::max<uint32_t>(1, nblocks_ / 8);
+		mask_ = nslots - 1;
+	}
+
+	~RangeCache() {
+		delete[] blocks_;
+		delete[] vals_;
+		delete[] slots_;
+	}
+
+	/**
+	 * Return true iff the cache has memory to work with.
+	 */
+	bool enabled() const {
+		return lim_ > 0;
+	}
 
 	/**
 	 * Given top and bot offsets, retrieve the canonical cache entry
@@ -360,52 +248,50 @@ public:
 	 * walked backward.
 	 */
 	bool lookup(TIndexOffU top, TIndexOffU bot, RangeCacheEntry& ent) {
-		if(ebwt_ == NULL || lim_ == 0) return false;
-		assert_gt(bot, top);
 		ent.reset();
-		TMapItr itr = map_.find(top);
-		if(itr == map_.end()) {
-			// No cache entry for the given 'top' offset
-			if(closed_) {
-				return false; // failed to get cache entry
-			} else {
-				if(pool_.closed()) {
-					closed_ = true;
-					return false; // failed to get cache entry
-				}
-			}
-			// Use the tunnel
-			bool ret = tunnel(top, bot, ent);
-			return ret;
-		} else {
+		if(!enabled()) return false;
+		assert_gt(bot, top);
+		uint32_t block, gen;
+		TIndexOffU jumps, len;
+		if(find(top, block, gen, jumps, len) && pin(block, gen)) {
 			// There is a cache entry for the given 'top' offset
-			TIndexOffU ret = itr->second;
-			ent.init(pool_, top, ret, ebwt_);
+			ent.init(this, top, jumps, len, block, ebwt_);
 			return true; // success
 		}
+		// Use the tunnel
+		return tunnel(top, bot, ent);
 	}
 
 	/**
-	 * Exhaustively check all entries linked to from map_ to ensure
-	 * they're well-formed.
+	 * Elements found in the cache so far.
+	 */
+	uint64_t hits() const { return hits_; }
+
+	/**
+	 * Elements that had to be resolved and were then cached.
+	 */
+	uint64_t misses() const { return misses_; }
+
+	/**
+	 * Entries recycled to make room for new ones.
+	 */
+	uint64_t evictions() const { return evictions_; }
+
+	/**
+	 * Exhaustively check all entries linked to from the table to
+	 * ensure they're well-formed.  Only safe while no other thread is
+	 * using the cache.
 	 */
 	bool repOk() {
 #ifndef NDEBUG
-		for(TMapItr itr = map_.begin(); itr != map_.end(); itr++) {
-			TIndexOffU top = itr->first;
-			TIndexOffU idx = itr->second;
-			TIndexOffU jumps = 0;
-			assert_leq(top, ebwt_->_eh._len);
-			TIndexOffU *ents = pool_.get(idx);
-			if((ents[0] & CACHE_WRAPPER_BIT) != 0) {
-				jumps = ents[0] & ~CACHE_WRAPPER_BIT;
-				assert_leq(jumps, ebwt_->_eh._len);
-				idx = ents[1];
-				ents = pool_.get(idx);
-			}
-			TIndexOffU len = ents[0];
-			assert_leq(top + len, ebwt_->_eh._len);
-			RangeCacheEntry::sanityCheckEnts(len, ents + 1, ebwt_);
+		for(size_t i = 0; i <= mask_; i++) {
+			const Slot& s = slots_[i];
+			if(s.key == RANGE_NOT_SET || blocks_[s.block].gen != s.gen) continue;
+			const Block& b = blocks_[s.block];
+			assert_neq(RANGE_NOT_SET, b.top);
+			assert_leq(s.jumps, ebwt_->_eh._len);
+			assert_leq(b.top + b.len, ebwt_->_eh._len);
+			assert_leq(chainLen(b.len), maxChain_);
 		}
 #endif
 		return true;
@@ -413,6 +299,177 @@ public:
 
 protected:
 
+	/**
+	 * Number of blocks needed for an entry of 'len' elements.
+	 */
+	static TIndexOffU chainLen(TIndexOffU len) {
+		return (len + RANGE_CACHE_BLOCK_ROWS - 1) / RANGE_CACHE_BLOCK_ROWS;
+	}
+
+	/**
+	 * Table position at which to start probing for 'top'.
+	 */
+	size_t home(TIndexOffU top) const {
+		uint64_t h = (uint64_t)top * 0x9e3779b97f4a7c15ull;
+		return (size_t)(h >> 32) & mask_;
+	}
+
+	/**
+	 * Look for a slot with key 'top' without taking the lock; return
+	 * true and fill in the slot's contents if there is one.  A slot
+	 * that's being written at the time is treated as absent.
+	 */
+	bool find(
+		TIndexOffU top,
+		uint32_t& block,
+		uint32_t& gen,
+		TIndexOffU& jumps,
+		TIndexOffU& len) const
+	{
+		size_t i = home(top);
+		for(uint32_t probe = 0; probe < RANGE_CACHE_MAX_PROBE; probe++) {
+			const Slot& s = slots_[i];
+			uint32_t seq = s.seq;
+			__sync_synchronize();
+			TIndexOffU key = s.key;
+			block = s.block;
+			gen = s.gen;
+			jumps = s.jumps;
+			len = s.len;
+			__sync_synchronize();
+			if((seq & 1) == 0 && s.seq == seq) {
+				if(key == RANGE_NOT_SET) return false; // end of probe chain
+				if(key == top) return true;
+			}
+			i = (i + 1) & mask_;
+		}
+		return false;
+	}
+
+	/**
+	 * Point the slot for 'top' at the entry headed by 'block', noting
+	 * that the first 'len' rows of the range map to it.  Reuses
+	 * the slot that already has key 'top', or else the first slot in
+	 * the probe chain that's empty or refers to a recycled entry.
+	 * Caller must hold lock_.
+	 */
+	bool insert(
+		TIndexOffU top,
+		uint32_t block,
+		uint32_t gen,
+		TIndexOffU jumps,
+		TIndexOffU len)
+	{
+		size_t i = home(top);
+		Slot *dest = NULL;
+		for(uint32_t probe = 0; probe < RANGE_CACHE_MAX_PROBE; probe++) {
+			Slot& s = slots_[i];
+			if(s.key == top) {
+				dest = &s;
+				break;
+			}
+			bool empty = (s.key == RANGE_NOT_SET);
+			if(dest == NULL && (empty || blocks_[s.block].gen != s.gen)) {
+				dest = &s;
+			}
+			if(empty) break;
+			i = (i + 1) & mask_;
+		}
+		if(dest == NULL) return false;
+		dest->seq++;
+		__sync_synchronize();
+		dest->key = top;
+		dest->block = block;
+		dest->gen = gen;
+		dest->jumps = jumps;
+		dest->len = len;
+		__sync_synchronize();
+		dest->seq++;
+		return true;
+	}
+
+	/**
+	 * Pin the entry headed by 'block' if it's still generation 'gen';
+	 * return false if it has been (or is being) recycled.
+	 */
+	bool pin(uint32_t block, uint32_t gen) {
+		Block& b = blocks_[block];
+		while(true) {
+			int32_t p = b.pins;
+			if(p < 0) return false;
+			if(__sync_bool_compare_and_swap(&b.pins, p, p + 1)) break;
+		}
+		if(b.gen != gen) {
+			unpin(block);
+			return false;
+		}
+		b.ref = 1;
+		return true;
+	}
+
+	void unpin(uint32_t block) {
+		__sync_fetch_and_sub(&blocks_[block].pins, 1);
+	}
+
+	/**
+	 * Advance the clock hand until 'need' blocks are free, recycling
+	 * unpinned entries not used since the hand last passed them.
+	 * Caller must hold lock_.
+	 */
+	bool reclaim(size_t need) {
+		for(uint32_t steps = 0; free_.size() < need && steps < 2 * nblocks_; steps++) {
+			uint32_t bi = hand_;
+			hand_ = (hand_ + 1 == nblocks_) ? 0 : hand_ + 1;
+			Block& b = blocks_[bi];
+			if(b.top == RANGE_NOT_SET) continue; // free or not a head
+			if(b.ref) {
+				b.ref = 0; // second chance
+				continue;
+			}
+			if(!__sync_bool_compare_and_swap(&b.pins, 0, -1)) continue;
+			b.gen++;
+			__sync_synchronize();
+			b.top = RANGE_NOT_SET;
+			for(uint32_t c = bi; c != RANGE_CACHE_NO_BLOCK; c = blocks_[c].next) {
+				memset(&vals_[(size_t)c * RANGE_CACHE_BLOCK_ROWS], 0xff,
+				       RANGE_CACHE_BLOCK_ROWS * sizeof(TIndexOffU));
+				free_.push_back(c);
+			}
+			evictions_++;
+			__sync_synchronize();
+			b.pins = 0;
+		}
+		return free_.size() >= need;
+	}
+
+	/**
+	 * Create a pinned entry for the range starting at 'top' with
+	 * 'len' elements and return its head block, or RANGE_CACHE_NO_BLOCK
+	 * if there's no room.  Caller must hold lock_.
+	 */
+	uint32_t create(TIndexOffU top, TIndexOffU len) {
+		TIndexOffU n = chainLen(len);
+		if(n > maxChain_ || !reclaim((size_t)n)) {
+			return RANGE_CACHE_NO_BLOCK;
+		}
+		uint32_t next = RANGE_CACHE_NO_BLOCK;
+		for(TIndexOffU i = 0; i < n; i++) {
+			uint32_t bi = free_.back();
+			free_.pop_back();
+			blocks_[bi].next = next;
+			next = bi;
+		}
+		Block& head = blocks_[next];
+		head.len = len;
+		head.ref = 1;
+		// A reader with a stale slot may be pinning and unpinning
+		// this block right now, so add rather than assign
+		__sync_fetch_and_add(&head.pins, 1);
+		__sync_synchronize();
+		head.top = top;
+		return next;
+	}
+
 	/**
 	 * Tunnel through to the first range that 1) includes all the same
 	 * suffixes (though longer) as the given range, and 2) has a cache
@@ -420,11 +477,11 @@ protected:
 	 */
 	bool tunnel(TIndexOffU top, TIndexOffU bot, RangeCacheEntry& ent) {
 		assert_gt(bot, top);
-		TUVec tops;
 		const TIndexOffU spread = bot - top;
 		SideLocus tloc, bloc;
 		SideLocus::initFromTopBot(top, bot, ebwt_->_eh, ebwt_->_ebwt, tloc, bloc);
 		TIndexOffU newtop = top, newbot = bot;
+		TIndexOffU entTop = top;
 		TIndexOffU jumps = 0;
 		// Walk left through the tunnel
 		while(true) {
@@ -443,102 +500,155 @@ protected:
 			// If the new spread is the same as the old spread, we can
 			// be confident that the new range includes all of the same
 			// suffixes as the last range (though longer by 1 char)
-			if((newbot - newtop) == spread) {
-				// Check if newtop is already cached
-				TMapItr itr = map_.find(newtop);
-				jumps++;
-				if(itr != map_.end()) {
-					// This range, which is further to the left in the
-					// same tunnel as the query range, has a cache
-					// entry already, so use that
-					TIndexOffU idx = itr->second;
-					TIndexOffU *ents = pool_.get(idx);
-					if((ents[0] & CACHE_WRAPPER_BIT) != 0) {
-						// The cache entry we found was a wrapper; make
-						// a new wrapper that points to that wrapper's
-						// target, with the appropriate number of jumps
-						jumps += (ents[0] & ~CACHE_WRAPPER_BIT);
-						idx = ents[1];
-					}
-					// Allocate a new wrapper
-					TIndexOffU newentIdx = pool_.alloc(2);
-					if(newentIdx != RANGE_CACHE_BAD_ALLOC) {
-						// We successfully made a new wrapper entry;
-						// now populate it and install it in map_
-						TIndexOffU *newent = pool_.get(newentIdx); // get ptr to it
-						assert_eq(0, newent[0]);
-						newent[0] = CACHE_WRAPPER_BIT | jumps; // set jumps
-						newent[1] = idx;                // set target
-						assert(map_.find(top) == map_.end());
-						map_[top] = newentIdx;
-						if(sanity_) assert(repOk());
-					}
-					// Initialize the entry
-					ent.init(pool_, top, jumps, idx, ebwt_);
-					return true;
-				}
-				// Save this range
-				tops.push_back(newtop);
-				SideLocus::initFromTopBot(newtop, newbot, ebwt_->_eh, ebwt_->_ebwt, tloc, bloc);
-			} else {
+			if((newbot - newtop) != spread) {
 				// Not all the suffixes were preserved, so we can't
 				// link the source range's cached result to this
 				// range's cached results
 				break;
 			}
-			assert_eq(jumps, tops.size());
+			jumps++;
+			uint32_t block, gen;
+			TIndexOffU more, len;
+			if(find(newtop, block, gen, more, len) && pin(block, gen)) {
+				// This range, which is further to the left in the
+				// same tunnel as the query range, has a cache entry
+				// already, so use that, and remember where it is for
+				// next time.  Only rows in both ranges carry over.
+				jumps += more;
+				len = std::min(len, spread);
+				{
+					ThreadSafe _ts(&lock_);
+					insert(top, block, gen, jumps, len);
+				}
+				ent.init(this, top, jumps, len, block, ebwt_);
+				return true;
+			}
+			entTop = newtop;
+			SideLocus::initFromTopBot(newtop, newbot, ebwt_->_eh, ebwt_->_ebwt, tloc, bloc);
 		}
-		assert_eq(jumps, tops.size());
 		// Try to create a new cache entry for the leftmost range in
 		// the tunnel (which might be the query range)
-		TIndexOffU newentIdx = pool_.alloc(spread + 1);
-		if(newentIdx != RANGE_CACHE_BAD_ALLOC) {
-			// Successfully allocated new range cache entry; install it
-			TIndexOffU *newent = pool_.get(newentIdx);
-			assert_eq(0, newent[0]);
-			// Store cache-range length in first word
-			newent[0] = spread;
-			assert_lt(newent[0], CACHE_WRAPPER_BIT);
-			assert_eq(spread, newent[0]);
-			TIndexOffU entTop = top;
-			TIndexOffU jumps = 0;
-			if(tops.size() > 0) {
-				entTop = tops.back();
-				jumps = (TIndexOff)tops.size();
+		uint32_t block = RANGE_CACHE_NO_BLOCK;
+		{
+			ThreadSafe _ts(&lock_);
+			uint32_t gen;
+			TIndexOffU more, len;
+			if(find(entTop, block, gen, more, len) && more == 0 && pin(block, gen)) {
+				// Another thread created it while we were tunneling
+			} else {
+				block = create(entTop, spread);
+				if(block == RANGE_CACHE_NO_BLOCK) {
+					return false;
+				}
+				gen = blocks_[block].gen;
+				if(!insert(entTop, block, gen, 0, spread)) {
+					// Nowhere to put it; let the clock have it back
+					blocks_[block].ref = 0;
+					unpin(block);
+					return false;
+				}
 			}
-			// Cache the entry for the end of the tunnel
-			assert(map_.find(entTop) == map_.end());
-			map_[entTop] = newentIdx;
-			if(sanity_) assert(repOk());
-			ent.init(pool_, entTop, jumps, newentIdx, ebwt_);
-			assert_eq(spread, newent[0]);
 			if(jumps > 0) {
-				assert_neq(entTop, top);
 				// Cache a wrapper entry for the query range (if possible)
-				TIndexOffU wrapentIdx = pool_.alloc(2);
-				if(wrapentIdx != RANGE_CACHE_BAD_ALLOC) {
-					TIndexOffU *wrapent = pool_.get(wrapentIdx);
-					assert_eq(0, wrapent[0]);
-					wrapent[0] = CACHE_WRAPPER_BIT | jumps;
-					wrapent[1] = newentIdx;
-					assert(map_.find(top) == map_.end());
-					map_[top] = wrapentIdx;
-					if(sanity_) assert(repOk());
-				}
+				assert_neq(entTop, top);
+				insert(top, block, gen, jumps, spread);
 			}
-			return true;
-		} else {
-			// Could not allocate new range cache entry
-			return false;
 		}
+		ent.init(this, top, jumps, spread, block, ebwt_);
+		return true;
 	}
 
-	TIndexOffU lim_;           /// Total number of key/val bytes to keep in cache
-	TMap map_;               ///
-	RangeCacheMemPool pool_; /// Memory pool
-	bool closed_;            /// Out of space; no new entries
-	TEbwt* ebwt_;            /// Index that alignments are in
-	bool sanity_;
+	TIndexOffU        lim_;       /// Total number of bytes to use; 0 -> disabled
+	uint32_t          nblocks_;   /// # blocks of entry memory
+	uint32_t          maxChain_;  /// most blocks one entry may use
+	uint32_t          hand_;      /// clock hand; next block to consider recycling
+	size_t            mask_;      /// # table slots - 1
+	Block            *blocks_;    /// block metadata
+	TIndexOffU       *vals_;      /// RANGE_CACHE_BLOCK_ROWS elements per block
+	Slot             *slots_;     /// table from range tops to entries
+	std::vector<uint32_t> free_;  /// blocks not in any entry
+	TEbwt            *ebwt_;      /// Index that alignments are in
+	volatile uint64_t hits_;
+	volatile uint64_t misses_;
+	volatile uint64_t evictions_;
+	MUTEX_T           lock_;      /// held while creating entries and writing slots
 };
 
+inline void RangeCacheEntry::init(
+	RangeCache* cache,
+	TIndexOffU top,
+	TIndexOffU jumps,
+	TIndexOffU len,
+	uint32_t head,
+	TEbwt* ebwt)
+{
+	assert(ebwt != NULL);
+	assert(!valid());
+	cache_ = cache;
+	head_ = cur_ = head;
+	curChunk_ = 0;
+	top_ = top;
+	jumps_ = jumps;
+	ebwt_ = ebwt;
+	len_ = std::min(len, (TIndexOffU)cache->blocks_[head].len);
+	assert_gt(len_, 0);
+	assert_leq(top_ + len_, ebwt_->_eh._len);
+}
+
+inline void RangeCacheEntry::reset() {
+	if(cache_ == NULL) return;
+	cache_->unpin(head_);
+	if(hits_ > 0)   __sync_fetch_and_add(&cache_->hits_, hits_);
+	if(misses_ > 0) __sync_fetch_and_add(&cache_->misses_, misses_);
+	hits_ = misses_ = 0;
+	cache_ = NULL;
+}
+
+inline volatile TIndexOffU* RangeCacheEntry::word(TIndexOffU elt) {
+	assert_lt(elt, len_);
+	TIndexOffU chunk = elt / RANGE_CACHE_BLOCK_ROWS;
+	if(chunk < curChunk_) {
+		// Chaser wrapped around to the top of the range
+		cur_ = head_;
+		curChunk_ = 0;
+	}
+	for(; curChunk_ < chunk; curChunk_++) {
+		cur_ = cache_->blocks_[cur_].next;
+		assert_neq(RANGE_CACHE_NO_BLOCK, cur_);
+	}
+	return &cache_->vals_[(size_t)cur_ * RANGE_CACHE_BLOCK_ROWS +
+	                      elt % RANGE_CACHE_BLOCK_ROWS];
+}
+
+inline void RangeCacheEntry::install(TIndexOffU elt, TIndexOffU val) {
+	if(cache_ == NULL) {
+		// This is not a valid cache entry; do nothing
+		return;
+	}
+	assert_leq(jumps_, val);
+	assert_neq(OFF_MASK, val);
+	if(elt < len_) {
+		ASSERT_ONLY(TIndexOffU sanity = TRowChaser::toFlatRefOff(ebwt_, 1, top_ + elt));
+		assert_eq(sanity, val);
+		*word(elt) = val - jumps_;
+		misses_++;
+	}
+}
+
+inline TIndexOffU RangeCacheEntry::get(TIndexOffU elt) {
+	if(cache_ == NULL || elt >= len_) {
+		// This is not a valid cache entry; do nothing
+		return RANGE_NOT_SET;
+	}
+	TIndexOffU val = *word(elt);
+	if(val == RANGE_NOT_SET) {
+		return RANGE_NOT_SET;
+	}
+	hits_++;
+	TIndexOffU ret = val + jumps_;
+	ASSERT_ONLY(TIndexOffU sanity = TRowChaser::toFlatRefOff(ebwt_, 1, top_ + elt));
+	assert_eq(sanity, ret);
+	return ret;
+}
+
 #endif /* RANGE_CACHE_H_ */
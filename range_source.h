@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <vector>
+#include <algorithm>
 #include "seqan/sequence.h"
 #include "ebwt.h"
 #include "range.h"
@@ -1144,23 +1145,36 @@ public:
  * A priority queue for Branch objects; makes it easy to process
  * branches in a best-first manner by prioritizing branches with lower
  * cumulative costs over branches with higher cumulative costs.
+ *
+ * Costs are small integers and a search rarely has more than a handful
+ * of distinct costs in flight, so rather than one big heap we keep one
+ * bucket per distinct cost, ordered by cost, and a small heap within
+ * each bucket to apply the rest of CostCompare's tie-breaking.  New
+ * branches almost always land in the lowest or highest bucket, and
+ * buckets (and their storage) are recycled from read to read.
  */
 class BranchQueue {
 
 	typedef std::pair<int, int> TIntPair;
-	typedef std::priority_queue<Branch*, std::vector<Branch*>, CostCompare> TBranchQueue;
+
+	/// All queued branches with a given cost, heap-ordered by CostCompare
+	struct Bucket {
+		uint16_t cost;
+		std::vector<Branch*> heap;
+	};
 
 public:
 
 	BranchQueue(bool verbose, bool quiet) :
-		sz_(0), branchQ_(), patid_(0), verbose_(verbose), quiet_(quiet)
+		sz_(0), buckets_(), live_(), free_(), patid_(0),
+		verbose_(verbose), quiet_(quiet)
 	{ }
 
 	/**
 	 * Return the front (highest-priority) element of the queue.
 	 */
 	Branch *front() {
-		Branch *b = branchQ_.top();
+		Branch *b = top();
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Fronting " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_-1);
@@ -1171,11 +1185,20 @@ public:
 
 	/**
 	 * Remove and return the front (highest-priority) element of the
-	 * queue.
+	 * queue.  The front branch may have had its cost changed since it
+	 * was pushed, so it's taken from the lowest bucket rather than
+	 * looked up by its cost.
 	 */
 	Branch *pop() {
-		Branch *b = branchQ_.top(); // get it
-		branchQ_.pop(); // remove it
+		assert(!empty());
+		Bucket& bk = buckets_[live_.back()];
+		std::pop_heap(bk.heap.begin(), bk.heap.end(), CostCompare());
+		Branch *b = bk.heap.back(); // get it
+		bk.heap.pop_back(); // remove it
+		if(bk.heap.empty()) {
+			free_.push_back(live_.back());
+			live_.pop_back();
+		}
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Popping " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_-1);
@@ -1190,17 +1213,19 @@ public:
 	 */
 	void push(Branch *b) {
 #ifndef NDEBUG
-		bool bIsBetter = empty() || !CostCompare()(b, branchQ_.top());
+		bool bIsBetter = empty() || !CostCompare()(b, top());
 #endif
 		if(verbose_) {
 			stringstream ss;
 			ss << patid_ << ": Pushing " << b->id_ << ", " << b << ", " << b->cost_ << ", " << b->exhausted_ << ", " << b->curtailed_ << ", " << sz_ << "->" << (sz_+1);
 			glog.msg(ss.str());
 		}
-		branchQ_.push(b);
+		std::vector<Branch*>& heap = buckets_[bucket(b->cost_)].heap;
+		heap.push_back(b);
+		std::push_heap(heap.begin(), heap.end(), CostCompare());
 #ifndef NDEBUG
-		assert(bIsBetter  || branchQ_.top() != b || CostCompare::equal(branchQ_.top(), b));
-		assert(!bIsBetter || branchQ_.top() == b || CostCompare::equal(branchQ_.top(), b));
+		assert(bIsBetter  || top() != b || CostCompare::equal(top(), b));
+		assert(!bIsBetter || top() == b || CostCompare::equal(top(), b));
 #endif
 		sz_++;
 	}
@@ -1210,7 +1235,11 @@ public:
 	 */
 	void reset(uint32_t patid) {
 		patid_ = patid;
-		branchQ_ = TBranchQueue();
+		for(size_t i = 0; i < live_.size(); i++) {
+			buckets_[live_[i]].heap.clear();
+			free_.push_back(live_[i]);
+		}
+		live_.clear();
 		sz_ = 0;
 	}
 
@@ -1218,7 +1247,7 @@ public:
 	 * Return true iff the priority queue of branches is empty.
 	 */
 	bool empty() const {
-		bool ret = branchQ_.empty();
+		bool ret = live_.empty();
 		assert(ret || sz_ > 0);
 		assert(!ret || sz_ == 0);
 		return ret;
@@ -1237,13 +1266,16 @@ public:
 	 */
 	bool repOk(std::set<Branch*>& bset) {
 		TIntPair pair = bestStratumAndHam(bset);
-		Branch *b = branchQ_.top();
+		Branch *b = top();
 		assert_eq(pair.first, (b->cost_ >> 14));
 		assert_eq(pair.second, (b->cost_ & ~0xc000));
 		std::set<Branch*>::iterator it;
 		for(it = bset.begin(); it != bset.end(); it++) {
 			assert_gt((*it)->depth3_, 0);
 		}
+		for(size_t i = 1; i < live_.size(); i++) {
+			assert_gt(buckets_[live_[i-1]].cost, buckets_[live_[i]].cost);
+		}
 		return true;
 	}
 #endif
@@ -1274,8 +1306,43 @@ protected:
 	}
 #endif
 
+	/**
+	 * Return the highest-priority branch without logging it.
+	 */
+	Branch *top() const {
+		assert(!live_.empty());
+		return buckets_[live_.back()].heap.front();
+	}
+
+	/**
+	 * Return the index of the live bucket for 'cost', making one if
+	 * there isn't one yet.
+	 */
+	uint32_t bucket(uint16_t cost) {
+		// live_ is sorted by decreasing cost; scan up from the cheapest
+		size_t i = live_.size();
+		while(i > 0 && buckets_[live_[i-1]].cost < cost) i--;
+		if(i > 0 && buckets_[live_[i-1]].cost == cost) {
+			return live_[i-1];
+		}
+		uint32_t idx;
+		if(!free_.empty()) {
+			idx = free_.back();
+			free_.pop_back();
+		} else {
+			idx = (uint32_t)buckets_.size();
+			buckets_.push_back(Bucket());
+		}
+		buckets_[idx].cost = cost;
+		assert(buckets_[idx].heap.empty());
+		live_.insert(live_.begin() + i, idx);
+		return idx;
+	}
+
 	uint32_t sz_;
-	TBranchQueue branchQ_; // priority queue of branches
+	std::vector<Bucket> buckets_;   // bucket storage, live or free
+	std::vector<uint32_t> live_;    // non-empty buckets, by decreasing cost
+	std::vector<uint32_t> free_;    // empty buckets available for reuse
 	uint32_t patid_;
 	bool verbose_;
 	bool quiet_;
@@ -1348,8 +1415,9 @@ public:
 			assert(b != newtop);
 		}
 #endif
-		// Update this PathManager's cost
-		minCost = branchQ_.front()->cost_;
+		// Update this PathManager's cost; if the queue just emptied,
+		// the cost is that of the last branch
+		minCost = branchQ_.empty() ? b->cost_ : branchQ_.front()->cost_;
 		assert(repOk());
 		return b;
 	}
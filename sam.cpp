@@ -31,7 +31,7 @@ void SAMHitSink::appendHeaders(
 	const char *rgline)
 {
 	BTString o;
-	o << "@HD\tVN:1.0\tSO:unsorted\n";
+	o << "@HD\tVN:1.0\tSO:" << (sorted() ? "coordinate" : "unsorted") << '\n';
 	if(!nosq) {
 		for(size_t i = 0; i < numRefs; i++) {
 			// RNAME
@@ -48,7 +48,12 @@ void SAMHitSink::appendHeaders(
 		o << "@RG\t" << rgline << '\n';
 	}
 	o << "@PG\tID:Bowtie\tVN:" << BOWTIE_VERSION << "\tCL:\"" << cmdline << "\"\n";
-	os.writeString(o);
+	if(sharded()) {
+		// Every shard file gets its own copy of the header
+		shardHeader_.assign(o.buf(), o.length());
+	} else {
+		os.writeString(o);
+	}
 }
 
 /**
@@ -77,8 +82,9 @@ void SAMHitSink::reportUnOrMax(
 	assert(!un || hs == NULL || hs->size() == 0);
 	size_t hssz = 0;
 	if(hs != NULL) hssz = hs->size();
-	maybeFlush(threadId);
+	if(!sorted() && !sharded() && !batchOrder_) maybeFlush(threadId);
 	BTString& o = ptBufs_[threadId];
+	size_t olen = o.length();
 	for(int i = 0; i < (int)seqan::length(p.bufa().name) - (paired ? 2 : 0); i++) {
 		if(!noQnameTrunc_ && isspace((int)p.bufa().name[i])) break;
 		o << p.bufa().name[i];
@@ -138,6 +144,14 @@ void SAMHitSink::reportUnOrMax(
 		}
 		o << '\n';
 	}
+	ptTallies_[threadId].bytesOut += (o.length() - olen);
+	if(sorted()) {
+		sortRecord(threadId, HitSortKey::unaligned(p.rdid()));
+	} else if(sharded()) {
+		shardRecord(threadId, ~(uint64_t)0, 0);
+	} else if(batchOrder_) {
+		holdRecord(threadId, p.rdid(), olen);
+	}
 	ptCounts_[threadId]++;
 }
 
@@ -231,9 +245,8 @@ void SAMHitSink::append(BTString& o, const Hit& h, int mapq, int xms) {
 	int nm = 0;
 	int run = 0;
 	o << "\tMD:Z:";
-	const FixedBitset<1024> *mms = &h.mms;
+	const HitEdits *mms = &h.mms;
 	ASSERT_ONLY(const String<Dna5>* pat = &h.patSeq);
-	const vector<char>* refcs = &h.refcs;
 #if 0
 	if(h.color && false) {
 		// Disabled: print MD:Z string w/r/t to colors, not letters
@@ -241,45 +254,43 @@ void SAMHitSink::append(BTString& o, const Hit& h, int mapq, int xms) {
 		ASSERT_ONLY(pat = &h.colSeq);
 		assert_eq(length(h.colSeq), len+1);
 		len = length(h.colSeq);
-		refcs = &h.crefcs;
 	}
 #endif
+	nm = (int)mms->size();
 	if(h.fw) {
-		for (int i = 0; i < (int)len; ++ i) {
-			if(mms->test(i)) {
-				nm++;
-				// There's a mismatch at this position
-				assert_gt((int)refcs->size(), i);
-				char refChar = toupper((*refcs)[i]);
-				ASSERT_ONLY(char qryChar = (h.fw ? (*pat)[i] : (*pat)[len-i-1]));
-				assert_neq(refChar, qryChar);
-				o << run << refChar;
-				run = 0;
-			} else {
-				run++;
-			}
+		int prev = -1;
+		for (size_t j = 0; j < mms->size(); ++ j) {
+			// There's a mismatch at this position
+			const int i = (int)(*mms)[j].pos;
+			assert_lt(i, (int)len);
+			char refChar = toupper((char)(*mms)[j].chr);
+			ASSERT_ONLY(char qryChar = (*pat)[i]);
+			assert_neq(refChar, qryChar);
+			run = i - prev - 1;
+			o << run << refChar;
+			prev = i;
 		}
+		run = (int)len - prev - 1;
 	} else {
-		for (int i = (int)len-1; i >= 0; -- i) {
-			if(mms->test(i)) {
-				nm++;
-				// There's a mismatch at this position
-				assert_gt((int)refcs->size(), i);
-				char refChar = toupper((*refcs)[i]);
-				ASSERT_ONLY(char qryChar = (h.fw ? (*pat)[i] : (*pat)[len-i-1]));
-				assert_neq(refChar, qryChar);
-				o << run << refChar;
-				run = 0;
-			} else {
-				run++;
-			}
+		int prev = (int)len;
+		for (size_t j = mms->size(); j > 0; -- j) {
+			// There's a mismatch at this position
+			const int i = (int)(*mms)[j-1].pos;
+			assert_lt(i, (int)len);
+			char refChar = toupper((char)(*mms)[j-1].chr);
+			ASSERT_ONLY(char qryChar = (*pat)[len-i-1]);
+			assert_neq(refChar, qryChar);
+			run = prev - i - 1;
+			o << run << refChar;
+			prev = i;
 		}
+		run = prev;
 	}
 	o << run;
 	// Add optional edit distance field
 	o << "\tNM:i:" << nm;
 	if(h.color) {
-		o << "\tCM:i:" << h.cmms.count();
+		o << "\tCM:i:" << h.cmms.size();
 	}
 	// Add optional fields reporting the primer base and the downstream color,
 	// which, if they were present, were clipped when the read was read in
@@ -0,0 +1,107 @@
+#!/usr/bin/perl -w
+
+##
+# shard_out.pl
+#
+# Basic tests to ensure that --shard-out writes the same records as a
+# normal run, each to the file for its reference range, and nothing to
+# the normal output.
+#
+
+use strict;
+use warnings;
+
+my $bowtie = "./bowtie";
+if(system("$bowtie --version > /dev/null") != 0) {
+	$bowtie = `which bowtie`;
+	chomp($bowtie);
+	if(system("$bowtie --version > /dev/null") != 0) {
+		die "Could not find bowtie in current directory or in PATH\n";
+	}
+}
+
+my $idx = "indexes/e_coli";
+my $reads = "reads/e_coli_1000.fq";
+my $mates = "-1 reads/e_coli_1000_1.fq -2 reads/e_coli_1000_2.fq";
+my $dir = ".shard_out.pl.d";
+my $outfn = ".shard_out.pl.out";
+
+# Each case: arguments, reads, bases per range (0 -> one per reference),
+# whether records are SAM and, optionally, shell commands to run first
+my @cases = (
+	[ "-S -v 2",                         $reads, 0,       1 ],
+	[ "-S -v 2 -p 3 --shard-size 100000", $reads, 100000, 1 ],
+	[ "-S -M 1 -v 1 -p 2",               $reads, 0,       1 ],
+	[ "-S -v 2 --shard-size 500000",     $mates, 500000,  1 ],
+	[ "-v 2 --shard-size 250000",        $reads, 250000,  0 ],
+	[ "-v 2 -p 3 --partition 1000",      $reads, 1000,    0 ],
+	[ "-v 2 -B 1 --partition 1000",      $reads, 1000,    0 ],
+	[ "-v 2 --partition 1000 --shard-size 5000",      $reads, 5000, 0 ],
+	[ "-v 2 -p 3 -B 1 --partition 1000 --shard-size 3000", $reads, 3000, 0 ],
+	# More shard files than file descriptors
+	[ "-S -v 2 -p 3 --shard-size 5000",   $reads, 5000,    1, "ulimit -n 32;" ],
+);
+
+sub run($) {
+	my $cmd = shift;
+	print "$cmd\n";
+	my @ls = ();
+	open(BT, "$cmd |") || die "Could not open pipe '$cmd |'";
+	while(<BT>) {
+		push @ls, $_ unless substr($_, 0, 1) eq "@";
+	}
+	close(BT);
+	$? == 0 || die "bowtie aborted with exitlevel $?\n";
+	return @ls;
+}
+
+for my $c (@cases) {
+	my ($args, $rds, $len, $sam, $pre) = @$c;
+	$pre = "" unless defined($pre);
+	my $partSz = ($args =~ /--partition (\d+)/) ? $1 : 0;
+	my @normal = run("$bowtie --debug $args $idx -q $rds");
+	scalar(@normal) > 0 || die "No records from normal run\n";
+	system("rm -rf $dir $outfn");
+	my @stdout = run("$pre $bowtie --debug $args --shard-out $dir $idx -q $rds $outfn");
+	scalar(@stdout) == 0 || die "Sharded run wrote records to standard out\n";
+	! -e $outfn || die "Sharded run created output file $outfn\n";
+	my @sharded = ();
+	opendir(D, $dir) || die "Could not open $dir\n";
+	my @fns = sort grep { !/^\./ } readdir(D);
+	closedir(D);
+	for my $fn (@fns) {
+		my $range = undef;
+		if($len > 0 && $fn =~ /_(\d+)\.\w+$/) {
+			$range = $1;
+		}
+		open(SH, "$dir/$fn") || die;
+		my $first = 1;
+		while(<SH>) {
+			if($first && $sam) {
+				substr($_, 0, 3) eq "\@HD" || die "$fn doesn't start with a SAM header\n";
+			}
+			$first = 0;
+			next if substr($_, 0, 1) eq "@";
+			push @sharded, $_;
+			next unless defined($range);
+			my @fs = split(/\t/, $_);
+			my $r;
+			if($partSz > 0) {
+				# Each line is filed by the start of its own partition
+				$r = int($fs[1] * $partSz / $len);
+			} elsif($sam) {
+				$r = int(($fs[3] - 1) / $len);
+			} else {
+				$r = int($fs[3] / $len);
+			}
+			$r == $range || die "Record for range $r in $fn:\n$_";
+		}
+		close(SH);
+	}
+	my $n = join("", sort @normal);
+	my $s = join("", sort @sharded);
+	$n eq $s || die "Shard files don't hold the same records as the normal output\n";
+	print "  ".scalar(@sharded)." records in ".scalar(@fns)." files\n";
+}
+system("rm -rf $dir $outfn");
+print "PASSED\n";
@@ -748,6 +748,17 @@ my @cases = (
 	                "-n 0" ],
 	  pairhits => [{ "2,16" => 1 }] },
 
+	# --learnins must not narrow the mate search when every pair counts
+
+	{ name     => "Paired-end learned inserts 1",
+	  ref      => [ "AAAACGAAAGCTTTTATAGATGGGGCATGTCCGTAGATGGGGTACCAGTGCTAGATGGGG" ],
+	  mate1s   => [ "AACGAAAG", "AACGAAAG", "AACGAAAG" ],
+	  mate2s   => [ "CCATCTA", "CCATCTA", "CCATCTA" ],
+	  args     => [ "--learnins 1 -v 0",
+	                "--learnins 1 -v 0 -X 100" ],
+	  same_as  => [ "-v 0",
+	                "-v 0 -X 100" ] },
+
 	{ name     => "Paired-end 2",
 	  ref      => [ "AAAACGAAAGCTTTTATAGATGGGG" ],
 	#                  AACGAAAG TTTTATA
@@ -887,6 +898,147 @@ my @cases = (
 	             "-n 0" ],
 	  hits  => [ { 2 => 1 } ] },
 
+	# Check -v 4 and -v 5, which only the search-scheme engine handles.
+	# The read is 4 mismatches from offset 8 and 5 from offset 48.
+
+	{ name   => "Search schemes 1",
+	  ref    => [ "CGAGTGACGATAGGTTATCAAGTAGACCGTCATGGCCAGCTATGGCGGGAATGGTTCTAAAGAAGTCCTTCAGGGGCAATGTGCAC" ],
+	  reads  => [ "GATTGGTTATAAAGTAGTCCGTCAGGGCCA" ],
+	  args   => [ "-v 4",
+	              "-v 4 -p 2",
+	              "-v 5 --best --strata" ],
+	  hits   => [ { 8 => 1 } ] },
+
+	{ name   => "Search schemes 2",
+	  ref    => [ "CGAGTGACGATAGGTTATCAAGTAGACCGTCATGGCCAGCTATGGCGGGAATGGTTCTAAAGAAGTCCTTCAGGGGCAATGTGCAC" ],
+	  reads  => [ "GATTGGTTATAAAGTAGTCCGTCAGGGCCA" ],
+	  args   => [ "-v 5",
+	              "-v 5 --best" ],
+	  hits   => [ { 8 => 1, 48 => 1 } ] },
+
+	{ name   => "Search schemes 3",
+	  ref    => [ "CGAGTGACGATAGGTTATCAAGTAGACCGTCATGGCCAGCTATGGCGGGAATGGTTCTAAAGAAGTCCTTCAGGGGCAATGTGCAC" ],
+	  reads  => [ "GATTGGTTATAAAGTAGTCCGTCAGGGCCA" ],
+	  args   => [ "-v 3" ],
+	  hits   => [ { } ] },
+
+	# --bidir must find what the classic engines find for -v 1 to 3
+
+	{ name    => "Search schemes 4",
+	  ref     => [ "CGAGTGACGATAGGTTATCAAGTAGACCGTCATGGCCAGCTATGGCGGGAATGGTTCTAAAGAAGTCCTTCAGGGGCAATGTGCAC" ],
+	  reads   => [ "CGAGTGACGATAGGTTATCA", "AGTAGCCCGTCATGGCCAGCTATG",
+	               "TCTGGCGGGCATGGTTCTAAAGAAGTCCTT", "TTCAAAAGAAGTGCTTCAGGGGCAAAGTGC",
+	               "GATTGGTTATAAAG", "AGAAGTCCTTCAGGGG" ],
+	  args    => [ "--bidir -v 1",
+	               "--bidir -v 2",
+	               "--bidir -v 3",
+	               "--bidir -v 3 --best --strata" ],
+	  same_as => [ "-v 1",
+	               "-v 2",
+	               "-v 3",
+	               "-v 3 --best --strata" ] },
+
+	# Paired-end reads can't go past -v 3
+
+	{ name         => "Search schemes 5",
+	  ref          => [ "AAAACGAAAGCTTTTATAGATGGGG" ],
+	  mate1s       => [ "AACGAAAG" ],
+	  mate2s       => [ "CCATCTA" ],
+	  args         => [ "-v 4" ],
+	  should_abort => 1 },
+
+	# --btsens 1.0 keeps the full backtracking limit, so it must report
+	# what a run without --btsens reports
+
+	{ name    => "Backtrack budget 1",
+	  ref     => [ "CGAGTGACGATAGGTTATCAAGTAGACCGTCATGGCCAGCTATGGCGGGAATGGTTCTAAAGAAGTCCTTCAGGGGCAATGTGCAC" ],
+	  reads   => [ "CGAGTGACGATAGGTTATCA", "AGTAGCCCGTCATGGCCAGCTATG",
+	               "TCTGGCGGGCATGGTTCTAAAGAAGTCCTT", "TTCAAAAGAAGTGCTTCAGGGGCAAAGTGC",
+	               "GATTGGTTATAAAG", "AGAAGTCCTTCAGGGG" ],
+	  args    => [ "--best --btsens 1.0 -n 2 -l 10",
+	               "--best --btsens 1.0 -n 3 -l 12 -p 2",
+	               "--best --strata --btsens 1.0 -n 2" ],
+	  same_as => [ "--best -n 2 -l 10",
+	               "--best -n 3 -l 12 -p 2",
+	               "--best --strata -n 2" ] },
+
+	{ name     => "Backtrack budget 2",
+	  ref      => [ "AAAACGAAAGCTTTTATAGATGGGG" ],
+	  mate1s   => [ "AACGAAAG", "AACGTAAG" ],
+	  mate2s   => [ "CCATCTA", "CCATCAA" ],
+	  args     => [ "--btsens 1.0 -n 1" ],
+	  same_as  => [ "-n 1" ] },
+
+	# Check coordinate-sorted output
+
+	{ name   => "Sorted output 1",
+	  ref    => [ "AGCATCGATCAGTATCTGA" ],
+	  reads  => [ "TCAGTATCTGA", "AGCATCGATCAG", "GGGGGGGGGG" ],
+	  args   => [ "--sort -v 0",
+	              "--sort --sort-mem 1 -p 2 -v 0" ],
+	  sorted => 1,
+	  hits   => [ { 8 => 1 }, { 0 => 1 }, { } ] },
+
+	{ name   => "Sorted output 2",
+	  ref    => [ "CCTACTACTCTCACCCCTTGCAAGAAATGGTTCAGCTTCAAACAATCGAGATATTAAGAC",
+	              "ACGGTGTTAACAATACAATAGTCAGCAAAATAGTGTAAACTCGCCTTGAACAACTCGACG" ],
+	  reads  => [ "TCGCCTTGAACAACTC", "TTCAGCTTCAAACAAT", "GGGGGGGGGGGGGGGG",
+	              "GTTAACAATACAATAG", "TACTACTCTCACCCCT", "ATCGAGATATTAAGAC",
+	              "CAGCAAAATAGTGTAA" ],
+	  args   => [ "--sort -v 0",
+	              "--sort --sort-mem 1 -p 3 -v 0" ],
+	  sorted => 1,
+	  hits   => [ { 40 => 1 }, { 30 => 1 }, { }, { 5 => 1 }, { 2 => 1 },
+	              { 44 => 1 }, { 22 => 1 } ] },
+
+	# Check that --dupcache gives copies of a read (under other names)
+	# the alignments a plain run gives them
+
+	{ name    => "Duplicate reads 1",
+	  ref     => [ "CAGTACGATCGGACTATTTTCAGTACGATCGGACTAGGGGCAGTACGTTCGGACTA" ],
+	  reads   => [ "CAGTACGATCGGACTA", "CAGTACGATCGGACTA", "ATTTTCAGTACG",
+	               "CAGTACGATCGGACTA", "ATTTTCAGTACG", "CAGTACGATCGGACTA" ],
+	  args    => [ "--dupcache 1 -v 1",
+	               "--dupcache 1 -p 3 -v 1",
+	               "--dupcache 1 -n 1" ],
+	  report  => "-k 3 -m 3",
+	  same_as => "-v 1",
+	  hits    => [ { 0 => 1, 20 => 1, 40 => 1 }, { 0 => 1, 20 => 1, 40 => 1 },
+	               { 15 => 1 }, { 0 => 1, 20 => 1, 40 => 1 }, { 15 => 1 },
+	               { 0 => 1, 20 => 1, 40 => 1 } ] },
+
+	{ name    => "Duplicate reads 2",
+	  ref     => [ "CAGTACGATCGGACTATTTTCAGTACGATCGGACTAGGGGCAGTACGTTCGGACTA" ],
+	  reads   => [ "CAGTACGATCGGACTA", "CAGTACGATCGGACTA", "CAGTACGATCGGACTA",
+	               "CAGTACGATCGGACTA", "CAGTACGATCGGACTA", "CAGTACGATCGGACTA",
+	               "CAGTACGATCGGACTA", "CAGTACGATCGGACTA" ],
+	  args    => [ "--dupcache 1 -M 1 -v 1",
+	               "--dupcache 1 -p 3 -M 1 -v 1" ],
+	  report  => "",
+	  same_as => "-M 1 -v 1" },
+
+	# -v 4 and 5 searches are exhaustive too, so they use the cache
+
+	{ name    => "Duplicate reads 3",
+	  ref     => [ "CAGTACGATCGGACTATTTTCAGTACGATCGGACTAGGGGCAGTACGTTCGGACTA" ],
+	  reads   => [ "CAGTACGATCGGACTATT", "CAGTACGATCGGACTATT", "ATTTTCAGTACGATCG",
+	               "CAGTACGATCGGACTATT", "ATTTTCAGTACGATCG", "CAGTACGATCGGACTATT" ],
+	  args    => [ "--dupcache 1 -v 4",
+	               "--dupcache 1 -p 3 -v 5" ],
+	  same_as => [ "-v 4", "-v 5" ] },
+
+	# -M picks must depend only on the read, not on which thread
+	# aligned it
+
+	{ name    => "Threads and -M 1",
+	  ref     => [ "CAGTACGATCGGACTATTTTCAGTACGATCGGACTAGGGGCAGTACGTTCGGACTA" ],
+	  reads   => [ ("CAGTACGATCGGACTA", "AGTACGATCGGACT", "CAGTACGATCGG") x 6 ],
+	  args    => [ "-p 3 -M 1 -v 1",
+	               "-p 3 -M 1 -n 1" ],
+	  report  => "",
+	  same_as => [ "-p 1 -M 1 -v 1",
+	               "-p 1 -M 1 -n 1" ] },
+
 	{ name  => "Colorspace 1",
 	  ref   => [ "AAACGAAAGCTTTTATAGATGGGG" ],
 	  reads => [    "132002320003332231" ],
@@ -1300,7 +1452,9 @@ foreach my $large_idx (undef,1) {
 			# 1-element array ref
 			$c->{args} = [] if not defined($c->{args});
 			$c->{args} = [$c->{args}] if not ref $c->{args} eq "ARRAY";
+			my $argi = -1;
 			for my $a (@{$c->{args}}) {
+				$argi++;
 				$last_ref = $c->{ref};
 				# For each set of arguments...
 				my $case_args = $a;
@@ -1463,6 +1617,40 @@ foreach my $large_idx (undef,1) {
 						my $l = scalar(@lines);
 						$l == $c->{lines} || die "Expected $c->{lines} lines, got $l";
 					}
+					if($c->{sorted}) {
+						# Aligned records must come in order of reference, then
+						# offset, and unaligned records after all of them
+						my ($lastref, $lastoff, $unal) = (-1, -1, 0);
+						for my $li (0 .. scalar(@lines)-1) {
+							my ($chr, $off) = @{$lines[$li]}[2..3];
+							if($chr eq "*") {
+								$unal = 1;
+								next;
+							}
+							!$unal ||
+								die "Aligned record after unaligned one:\n$rawlines[$li]\n";
+							($chr > $lastref || ($chr == $lastref && $off >= $lastoff)) ||
+								die "Record out of order after $lastref:$lastoff:\n$rawlines[$li]\n";
+							($lastref, $lastoff) = ($chr, $off);
+						}
+					}
+					if(defined($c->{same_as})) {
+						# Records must be the same, up to order, as those
+						# from a run with the 'same_as' arguments instead
+						# (given once, or once per element of 'args')
+						my $same_as = $c->{same_as};
+						$same_as = $same_as->[$argi] if ref $same_as eq "ARRAY";
+						my (@olines, @orawlines, @oheader_lines, @oheader_rawlines) = ();
+						runbowtie(
+							0, $large_idx, $color, $debug_mode,
+							"$same_as -S", $tmpfafn, $c->{report},
+							$read_file_format, $read_file, $mate1_file, $mate2_file,
+							$reads, $quals, $m1s, $q1s, $m2s, $q2s, $c->{names},
+							\@olines, \@orawlines, \@oheader_lines, \@oheader_rawlines,
+							0);
+						join("\n", sort @rawlines) eq join("\n", sort @orawlines) ||
+							die "Records differ from those given with \"$same_as\"\n";
+					}
 					for my $li (0 .. scalar(@lines)-1) {
 						my $l = $lines[$li];
 						my ($readname, $orient, $chr, $off_orig, $off, $seq, $qual, $mapq,
@@ -20,7 +20,6 @@
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s, s, s, s);
 		if(bt.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
@@ -32,14 +31,12 @@
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s, s, s, s);
 		if(bt.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
 
 	if(sink->finishedWithStratum(0)) { // no more exact hits are possible
 		// the sink tells us we needn't try 1-mismatch alignments
-		DONEMASK_SET(patid);
 		continue;
 	}
 	bt.setReportExacts(false);
@@ -49,7 +46,6 @@
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s5, s, s, s); // 1 mismatch allowed in 3' half
 		if(bt.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
@@ -60,7 +56,6 @@
 		bt.setQuery(patsrc->bufa());
 		bt.setOffs(0, 0, s5, s, s, s); // 1 mismatch allowed in 3' half
 		if(bt.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
@@ -25,7 +25,6 @@
 		btr1.setQuery(patsrc->bufa());
 		btr1.setOffs(0, 0, plen, plen, plen, plen);
 		if(btr1.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
@@ -36,12 +35,10 @@
 		btr1.setQuery(patsrc->bufa());
 		btr1.setOffs(0, 0, s5, s5, two ? s : s5, s);
 		if(btr1.backtrack()) {
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
 	if(nofw && sink->finishedWithStratum(0)) { // no more exact hits are possible
-		DONEMASK_SET(patid);
 		continue;
 	}
 }
@@ -0,0 +1,276 @@
+/*
+ * search_scheme.h
+ *
+ * Search schemes (Kucherov, Salikhov & Tsur) for finding end-to-end
+ * alignments with a bounded number of mismatches in one pass over a
+ * bidirectional index.  The read is cut into pieces and each search
+ * in a scheme matches the pieces in its own order, growing the aligned
+ * region by one piece at a time to the left or to the right, with
+ * bounds on the number of mismatches accumulated after each piece and
+ * on the number within it.  Together the searches of a scheme find
+ * every alignment with the scheme's number of mismatches, and find it
+ * only once.
+ *
+ * The schemes themselves are data: the tables at the bottom of this
+ * file hold one or more per number of mismatches.
+ */
+
+#ifndef SEARCH_SCHEME_H_
+#define SEARCH_SCHEME_H_
+
+#include <stdint.h>
+#include <vector>
+#include "assert_helpers.h"
+
+/// Most pieces a read is cut into
+static const int SEARCH_SCHEME_MAX_PIECES = 8;
+/// Most mismatches there's a scheme for
+static const int SEARCH_SCHEME_MAX_MMS = 5;
+
+/**
+ * One search of a scheme.  Step i matches piece order[i], which must
+ * be adjacent to the pieces matched before it.
+ */
+struct BidirSearch {
+	int pieces;                            /// # pieces read is cut into
+	int ends[SEARCH_SCHEME_MAX_PIECES+1];  /// piece i spans [ends[i], ends[i+1]) of ends[pieces]
+	int order[SEARCH_SCHEME_MAX_PIECES];   /// piece matched at each step
+	int lo[SEARCH_SCHEME_MAX_PIECES];      /// min mismatches after step
+	int hi[SEARCH_SCHEME_MAX_PIECES];      /// max mismatches after step
+	int pieceLo[SEARCH_SCHEME_MAX_PIECES]; /// min mismatches within step's piece
+	int pieceHi[SEARCH_SCHEME_MAX_PIECES]; /// max mismatches within step's piece
+
+	/**
+	 * Return true iff step i extends the aligned region to the left.
+	 * The first piece is matched right to left.
+	 */
+	bool left(int i) const {
+		return i == 0 || order[i] < order[i-1];
+	}
+
+	/**
+	 * Return the last step that extends the aligned region to the
+	 * right, or 0 if there is none.
+	 */
+	int lastRight() const {
+		int last = 0;
+		for(int i = 1; i < pieces; i++) {
+			if(!left(i)) last = i;
+		}
+		return last;
+	}
+
+	/**
+	 * Return true iff this search finds alignments with mms[i]
+	 * mismatches in piece i.
+	 */
+	bool covers(const int *mms) const {
+		int tot = 0;
+		for(int i = 0; i < pieces; i++) {
+			int m = mms[order[i]];
+			tot += m;
+			if(m < pieceLo[i] || m > pieceHi[i]) return false;
+			if(tot < lo[i] || tot > hi[i]) return false;
+		}
+		return true;
+	}
+};
+
+/**
+ * A search as written in the tables below: one digit per step for
+ * the piece matched, the min and max mismatches after the step, and
+ * the min and max mismatches within the step's piece.
+ */
+struct SchemeRow {
+	const char *order, *lo, *hi, *pieceLo, *pieceHi;
+};
+
+/**
+ * A scheme as listed in the tables below.  The read is cut into one
+ * piece per digit of 'partition', each as long relative to the others
+ * as its digit says.  A scheme is used for reads at least 'minLen'
+ * chars long, unless a later scheme for as many mismatches is too.
+ */
+struct SchemeTable {
+	int              mms;       /// # mismatches
+	uint32_t         minLen;    /// shortest read to use it for
+	const char      *partition; /// relative length of each piece
+	const SchemeRow *rows;      /// searches
+	size_t           nrows;     /// # searches
+};
+
+/**
+ * Return true iff the searches in 'ss' find every distribution of
+ * exactly 'k' mismatches among the pieces once and only once.
+ */
+static inline bool schemeRepOk(int k, const std::vector<BidirSearch>& ss) {
+	assert(!ss.empty());
+	const int p = ss[0].pieces;
+	int mms[SEARCH_SCHEME_MAX_PIECES];
+	for(int i = 0; i < p; i++) mms[i] = 0;
+	while(true) {
+		int tot = 0;
+		for(int i = 0; i < p; i++) tot += mms[i];
+		if(tot == k) {
+			int n = 0;
+			for(size_t i = 0; i < ss.size(); i++) {
+				assert_eq(p, ss[i].pieces);
+				if(ss[i].covers(mms)) n++;
+			}
+			assert_eq(1, n);
+			if(n != 1) return false;
+		}
+		// Next distribution
+		int i = 0;
+		while(i < p && mms[i] == k) mms[i++] = 0;
+		if(i == p) break;
+		mms[i]++;
+	}
+	return true;
+}
+
+/*
+ * The schemes.  They were picked, among schemes whose pieces each get
+ * a range of mismatches, to minimize the expected number of BW ranges
+ * visited in a random text of a few million chars, separately for
+ * reads shorter than 28 chars (guides, small RNAs) and for longer ones.
+ * Most searches start with a piece that matches exactly, so the search
+ * tree stays narrow until the range is small.
+ */
+static const SchemeRow searchScheme0[] = {
+	{ "0", "0", "0", "0", "0" },
+};
+static const SchemeRow searchScheme1[] = {
+	{ "01", "01", "01", "01", "01" },
+	{ "10", "01", "01", "01", "01" },
+};
+static const SchemeRow searchScheme2[] = {
+	{ "210", "002", "022", "000", "022" },
+	{ "012", "002", "012", "001", "012" },
+	{ "120", "012", "012", "011", "011" },
+};
+static const SchemeRow searchScheme2Long[] = {
+	{ "012", "002", "022", "000", "022" },
+	{ "120", "002", "012", "001", "012" },
+	{ "210", "012", "012", "011", "011" },
+};
+static const SchemeRow searchScheme3[] = {
+	{ "210", "003", "133", "000", "133" },
+	{ "012", "003", "013", "002", "013" },
+	{ "102", "013", "013", "012", "012" },
+};
+static const SchemeRow searchScheme3Long[] = {
+	{ "3210", "0003", "0333", "0000", "0333" },
+	{ "2103", "0003", "0223", "0001", "0223" },
+	{ "0123", "0013", "0123", "0011", "0122" },
+	{ "1230", "0123", "0123", "0111", "0111" },
+};
+static const SchemeRow searchScheme4[] = {
+	{ "012", "004", "044", "000", "044" },
+	{ "210", "004", "134", "001", "134" },
+	{ "012", "114", "124", "102", "113" },
+	{ "120", "024", "024", "022", "022" },
+};
+static const SchemeRow searchScheme4Long[] = {
+	{ "3210", "0004", "1444", "0000", "1444" },
+	{ "2103", "0004", "0224", "0002", "0224" },
+	{ "0123", "0014", "0124", "0012", "0123" },
+	{ "1203", "0124", "0124", "0112", "0112" },
+};
+static const SchemeRow searchScheme5[] = {
+	{ "012", "005", "255", "000", "255" },
+	{ "120", "005", "025", "003", "025" },
+	{ "210", "015", "125", "013", "124" },
+};
+static const SchemeRow searchScheme5Long[] = {
+	{ "3210", "0005", "0555", "0000", "0555" },
+	{ "3210", "1115", "1455", "1000", "1344" },
+	{ "2103", "0005", "1335", "0002", "1335" },
+	{ "0123", "0025", "0135", "0022", "0133" },
+	{ "1023", "0135", "0135", "0122", "0122" },
+	{ "0123", "0045", "0045", "0041", "0041" },
+};
+
+#define SEARCH_SCHEME(k, len, part, rows) \
+	{ k, len, part, rows, sizeof(rows) / sizeof(SchemeRow) }
+
+static const SchemeTable searchSchemes[] = {
+	SEARCH_SCHEME(0,  0, "1", searchScheme0),
+	SEARCH_SCHEME(1,  0, "11", searchScheme1),
+	SEARCH_SCHEME(2,  0, "223", searchScheme2),
+	SEARCH_SCHEME(2, 28, "111", searchScheme2Long),
+	SEARCH_SCHEME(3,  0, "112", searchScheme3),
+	SEARCH_SCHEME(3, 28, "2233", searchScheme3Long),
+	SEARCH_SCHEME(4,  0, "313", searchScheme4),
+	SEARCH_SCHEME(4, 28, "1223", searchScheme4Long),
+	SEARCH_SCHEME(5,  0, "211", searchScheme5),
+	SEARCH_SCHEME(5, 28, "2133", searchScheme5Long),
+};
+
+#undef SEARCH_SCHEME
+
+/**
+ * The searches for exactly 'k' mismatches, with a scheme for each
+ * range of read lengths the tables have one for.
+ */
+class SearchSchemes {
+public:
+	explicit SearchSchemes(int k = 0) {
+		assert_geq(k, 0);
+		assert_leq(k, SEARCH_SCHEME_MAX_MMS);
+		const size_t n = sizeof(searchSchemes) / sizeof(SchemeTable);
+		for(size_t i = 0; i < n; i++) {
+			const SchemeTable& t = searchSchemes[i];
+			if(t.mms != k) continue;
+			assert(minLens_.empty() || minLens_.back() < t.minLen);
+			minLens_.push_back(t.minLen);
+			schemes_.resize(schemes_.size() + 1);
+			for(size_t j = 0; j < t.nrows; j++) {
+				schemes_.back().push_back(parse(t, t.rows[j]));
+			}
+			assert(schemeRepOk(k, schemes_.back()));
+		}
+		assert(!minLens_.empty());
+		assert_eq(0, minLens_[0]);
+	}
+
+	/**
+	 * Return the searches to use for a read of 'len' chars.
+	 */
+	const std::vector<BidirSearch>& get(size_t len) const {
+		size_t i = minLens_.size() - 1;
+		while(len < minLens_[i]) i--;
+		return schemes_[i];
+	}
+
+private:
+
+	/**
+	 * Turn a table row into a search.
+	 */
+	static BidirSearch parse(const SchemeTable& t, const SchemeRow& row) {
+		BidirSearch s;
+		s.pieces = 0;
+		s.ends[0] = 0;
+		for(const char *c = row.order; *c != '\0'; c++) {
+			int j = s.pieces++;
+			assert_lt(j, SEARCH_SCHEME_MAX_PIECES);
+			assert(t.partition[j] != '\0');
+			s.ends[j+1]  = s.ends[j] + (t.partition[j] - '0');
+			s.order[j]   = *c - '0';
+			s.lo[j]      = row.lo[j] - '0';
+			s.hi[j]      = row.hi[j] - '0';
+			s.pieceLo[j] = row.pieceLo[j] - '0';
+			s.pieceHi[j] = row.pieceHi[j] - '0';
+		}
+		assert(t.partition[s.pieces] == '\0');
+		assert_eq(t.mms, s.lo[s.pieces-1]);
+		assert_eq(t.mms, s.hi[s.pieces-1]);
+		return s;
+	}
+
+	std::vector<uint32_t> minLens_;
+	std::vector<std::vector<BidirSearch> > schemes_;
+};
+
+#endif /* SEARCH_SCHEME_H_ */
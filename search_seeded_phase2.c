@@ -34,12 +34,10 @@
 		if(btf2.backtrack()) {
 			// The reverse complement hit, so we're done with this
 			// read
-			DONEMASK_SET(patid);
 			continue;
 		}
 
 		if(sink->finishedWithStratum(0)) { // no more exact hits are possible
-			DONEMASK_SET(patid);
 			continue;
 		}
 	}
@@ -15,9 +15,7 @@
 		// complement
 		pals.clear();
 		if(pamRc != NULL && pamRc->size() > 0) {
-			// We can get away with an unsynchronized call because there
-			// are no writers for pamRc in this phase
-			pamRc->getPartialsUnsync(patid, pals);
+			pamRc->getPartials(patid, pals);
 			pamRc->clear(patid);
 			assert_eq(0, pamRc->size());
 		}
@@ -47,7 +45,6 @@
 				if(done) {
 					// The reverse complement hit, so we're done with this
 					// read
-					DONEMASK_SET(patid);
 					// Got a hit; stop processing partial
 					// alignments
 					break;
@@ -83,7 +80,6 @@
 			//	gaveUp = true;
 			//}
 			if(done) {
-				DONEMASK_SET(patid);
 				btr23.resetNumBacktracks();
 				continue;
 			}
@@ -92,7 +88,6 @@
 	}
 
 	if(nofw) { // no more 1-mm-in-seed hits are possible
-		//DONEMASK_SET(patid);
 		continue;
 	}
 
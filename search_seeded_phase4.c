@@ -14,9 +14,7 @@
 		// complement
 		pals.clear();
 		if(pamFw != NULL && pamFw->size() > 0) {
-			// We can get away with an unsynchronized call because there
-			// are no writers for pamFw in this phase
-			pamFw->getPartialsUnsync(patid, pals);
+			pamFw->getPartials(patid, pals);
 			pamFw->clear(patid);
 			assert_eq(0, pamFw->size());
 		}
@@ -0,0 +1,343 @@
+/*
+ * server.cpp
+ *
+ * Alignment server and client; see server.h.
+ */
+
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef __GLIBC__
+#include <stdio_ext.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include "server.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+/// First word of every job request
+static const uint32_t JOB_MAGIC = 0x626f776a; // "bowj"
+/// Longest argument we'll accept from a client
+static const uint32_t JOB_MAX_ARG = 1024 * 1024;
+/// Most arguments we'll accept from a client
+static const uint32_t JOB_MAX_ARGS = 64 * 1024;
+
+static bool writeAll(int fd, const void *buf, size_t len) {
+	const char *p = (const char *)buf;
+	while(len > 0) {
+		ssize_t r = write(fd, p, len);
+		if(r < 0 && errno == EINTR) continue;
+		if(r <= 0) return false;
+		p += r;
+		len -= (size_t)r;
+	}
+	return true;
+}
+
+static bool readAll(int fd, void *buf, size_t len) {
+	char *p = (char *)buf;
+	while(len > 0) {
+		ssize_t r = read(fd, p, len);
+		if(r < 0 && errno == EINTR) continue;
+		if(r <= 0) return false;
+		p += r;
+		len -= (size_t)r;
+	}
+	return true;
+}
+
+static bool writeString(int fd, const string& s) {
+	uint32_t len = (uint32_t)s.length();
+	return writeAll(fd, &len, 4) && writeAll(fd, s.data(), len);
+}
+
+static bool readString(int fd, string& s) {
+	uint32_t len = 0;
+	if(!readAll(fd, &len, 4) || len > JOB_MAX_ARG) return false;
+	s.resize(len);
+	return len == 0 || readAll(fd, &s[0], len);
+}
+
+/**
+ * Fill in a Unix socket address for 'path'; return false if the path
+ * is too long.
+ */
+static bool socketAddr(const string& path, struct sockaddr_un& addr) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.length() >= sizeof(addr.sun_path)) {
+		cerr << "Error: Socket path " << path << " is too long" << endl;
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+/**
+ * Connect to the server at 'path'; return the socket, or -1.
+ */
+static int connectTo(const string& path) {
+	struct sockaddr_un addr;
+	if(!socketAddr(path, addr)) return -1;
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s < 0) return -1;
+	if(connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+/**
+ * Read a job request from 'c': the client's stdin, stdout and stderr
+ * (passed as ancillary data), its working directory, and its
+ * arguments.  On success, the caller must close the fds.
+ */
+static bool recvJob(int c, int fds[3], string& cwd, vector<string>& args) {
+	uint32_t magic = 0;
+	struct iovec iov;
+	iov.iov_base = &magic;
+	iov.iov_len = 4;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if(recvmsg(c, &msg, 0) != 4 || magic != JOB_MAGIC) return false;
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	if(cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS ||
+	   cm->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+	{
+		return false;
+	}
+	memcpy(fds, CMSG_DATA(cm), 3 * sizeof(int));
+	uint32_t nargs = 0;
+	bool ok = readString(c, cwd) && readAll(c, &nargs, 4) && nargs <= JOB_MAX_ARGS;
+	for(uint32_t i = 0; ok && i < nargs; i++) {
+		args.push_back(string());
+		ok = readString(c, args.back());
+	}
+	if(!ok) {
+		for(int i = 0; i < 3; i++) close(fds[i]);
+	}
+	return ok;
+}
+
+/**
+ * Throw away anything left in stdin's buffer so that a job never sees
+ * input read ahead by an earlier job (e.g. one stopped early by -u).
+ */
+static void purgeStdin() {
+#if defined(__GLIBC__)
+	__fpurge(stdin);
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	fpurge(stdin);
+#else
+	// Reopening stdin drops its buffer wherever fpurge is missing
+	freopen(NULL, "r", stdin);
+#endif
+	clearerr(stdin);
+}
+
+/**
+ * True iff 'args' would start a server or client of its own.
+ */
+static bool nestedServerArg(const vector<string>& args) {
+	for(size_t i = 0; i < args.size(); i++) {
+		const string& a = args[i];
+		if(a == "--server" || a == "--client" ||
+		   a.compare(0, 9, "--server=") == 0 || a.compare(0, 9, "--client=") == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Run a job with the client's standard streams and working directory
+ * standing in for the server's.
+ */
+static int runJobAs(
+	const int fds[3],
+	const string& cwd,
+	const char *argv0,
+	const vector<string>& baseArgs,
+	const vector<string>& args,
+	JobRunner runJob)
+{
+	fflush(stdout);
+	fflush(stderr);
+	int saved[3];
+	for(int i = 0; i < 3; i++) {
+		saved[i] = dup(i);
+		dup2(fds[i], i);
+	}
+	purgeStdin();
+	int ret = 1;
+	if(chdir(cwd.c_str()) != 0) {
+		cerr << "Error: Server could not change to directory " << cwd
+		     << ": " << strerror(errno) << endl;
+	} else {
+		vector<const char*> argv;
+		argv.push_back(argv0);
+		for(size_t i = 0; i < baseArgs.size(); i++) argv.push_back(baseArgs[i].c_str());
+		for(size_t i = 0; i < args.size(); i++) argv.push_back(args[i].c_str());
+		argv.push_back(NULL);
+		ret = runJob((int)argv.size() - 1, &argv[0]);
+	}
+	cout.flush();
+	fflush(stdout);
+	fflush(stderr);
+	for(int i = 0; i < 3; i++) {
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	purgeStdin();
+	return ret;
+}
+
+int serveJobs(
+	const string& sockPath,
+	const char *argv0,
+	const vector<string>& baseArgs,
+	JobRunner runJob)
+{
+	// A client going away mid-job should fail the job, not the server
+	signal(SIGPIPE, SIG_IGN);
+	struct sockaddr_un addr;
+	if(!socketAddr(sockPath, addr)) throw 1;
+	int probe = connectTo(sockPath);
+	if(probe >= 0) {
+		close(probe);
+		cerr << "Error: A server is already listening on " << sockPath << endl;
+		throw 1;
+	}
+	unlink(sockPath.c_str());
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s < 0 ||
+	   bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	   listen(s, SOMAXCONN) != 0)
+	{
+		cerr << "Error: Could not listen on " << sockPath << ": " << strerror(errno) << endl;
+		throw 1;
+	}
+	int home = open(".", O_RDONLY);
+	cerr << "Listening for jobs on " << sockPath << endl;
+	bool stop = false;
+	while(!stop) {
+		int c = accept(s, NULL, NULL);
+		if(c < 0) {
+			if(errno == EINTR) continue;
+			cerr << "Error: accept() failed: " << strerror(errno) << endl;
+			break;
+		}
+		int fds[3];
+		string cwd;
+		vector<string> args;
+		if(!recvJob(c, fds, cwd, args)) {
+			cerr << "Warning: Ignoring malformed job request" << endl;
+			close(c);
+			continue;
+		}
+		int32_t ret = 0;
+		if(args.size() == 1 && args[0] == "--shutdown") {
+			stop = true;
+		} else if(nestedServerArg(args)) {
+			const char *msg = "Error: --server and --client cannot be given in a job sent to a server\n";
+			writeAll(fds[2], msg, strlen(msg));
+			ret = 1;
+		} else {
+			ret = runJobAs(fds, cwd, argv0, baseArgs, args, runJob);
+			if(home >= 0 && fchdir(home) != 0) {
+				cerr << "Warning: Could not return to server's working directory" << endl;
+			}
+		}
+		for(int i = 0; i < 3; i++) close(fds[i]);
+		writeAll(c, &ret, 4);
+		close(c);
+	}
+	if(home >= 0) close(home);
+	close(s);
+	unlink(sockPath.c_str());
+	return 0;
+}
+
+int submitJob(const string& sockPath, int argc, const char **argv) {
+	int s = connectTo(sockPath);
+	if(s < 0) {
+		cerr << "Error: Could not connect to bowtie server at " << sockPath
+		     << ": " << strerror(errno) << endl;
+		return 1;
+	}
+	// Hand our standard streams to the server along with the magic word
+	uint32_t magic = JOB_MAGIC;
+	struct iovec iov;
+	iov.iov_base = &magic;
+	iov.iov_len = 4;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	memset(cbuf, 0, sizeof(cbuf));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	int fds[3] = { 0, 1, 2 };
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	char cwd[4096];
+	if(getcwd(cwd, sizeof(cwd)) == NULL) {
+		cerr << "Error: Could not determine working directory" << endl;
+		close(s);
+		return 1;
+	}
+	uint32_t nargs = (uint32_t)argc;
+	bool ok = sendmsg(s, &msg, 0) == 4 &&
+	          writeString(s, cwd) &&
+	          writeAll(s, &nargs, 4);
+	for(int i = 0; ok && i < argc; i++) {
+		ok = writeString(s, argv[i]);
+	}
+	int32_t ret = 1;
+	if(!ok || !readAll(s, &ret, 4)) {
+		cerr << "Error: Lost connection to bowtie server at " << sockPath << endl;
+		ret = 1;
+	}
+	close(s);
+	return ret;
+}
+
+#else
+
+int serveJobs(
+	const string& sockPath,
+	const char *argv0,
+	const vector<string>& baseArgs,
+	JobRunner runJob)
+{
+	cerr << "Error: --server is not supported on this platform" << endl;
+	throw 1;
+}
+
+int submitJob(const string& sockPath, int argc, const char **argv) {
+	cerr << "Error: --client is not supported on this platform" << endl;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * server.h
+ *
+ * Support for running bowtie as a long-lived alignment server
+ * (--server) that keeps its index in memory and accepts jobs from thin
+ * clients (--client) over a Unix domain socket.
+ *
+ * A job is just a bowtie argument list.  Along with it the client
+ * passes its working directory and its stdin, stdout and stderr file
+ * descriptors, so reads can be streamed in and alignments streamed out
+ * exactly as if the client had run bowtie itself.  Jobs are run one at
+ * a time, in the order they arrive; each gets all of the server's
+ * search threads.
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <string>
+#include <vector>
+
+/// Runs one job given a complete argv; returns its exit status
+typedef int (*JobRunner)(int argc, const char **argv);
+
+/**
+ * Listen on Unix socket 'sockPath' and run each job that arrives by
+ * calling 'runJob' with argv0, then 'baseArgs', then the job's own
+ * arguments.  Returns once a client asks the server to shut down.
+ */
+extern int serveJobs(
+	const std::string& sockPath,
+	const char *argv0,
+	const std::vector<std::string>& baseArgs,
+	JobRunner runJob);
+
+/**
+ * Send the arguments in argv[0..argc) as a job to the server listening
+ * on 'sockPath', wait for it to finish, and return its exit status.
+ * The single argument "--shutdown" asks the server to exit.
+ */
+extern int submitJob(const std::string& sockPath, int argc, const char **argv);
+
+#endif /* SERVER_H_ */
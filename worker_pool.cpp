@@ -0,0 +1,394 @@
+/*
+ * worker_pool.cpp
+ *
+ * Elastic pool of search threads; see worker_pool.h.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "worker_pool.h"
+
+using namespace std;
+
+#ifdef WITH_TBB
+typedef std::lock_guard<std::mutex> ParkGuard;
+#else
+typedef tthread::lock_guard<tthread::mutex> ParkGuard;
+#endif
+
+/// Milliseconds between the controller's looks at the budget
+static const int POOL_TICK_MS = 5;
+/// Controller ticks between re-reads of the affinity mask and cgroup
+static const int POOL_CPU_TICKS = 200;
+
+/**
+ * Return ceil(quota/period) for a cgroup CPU quota, or 0 if there's
+ * no quota.
+ */
+static int quotaCpus(long long quota, long long period) {
+	if(quota <= 0 || period <= 0) return 0;
+	return (int)((quota + period - 1) / period);
+}
+
+/**
+ * Return the CPU limit imposed by this process's cgroup, or 0 if
+ * there is none.  Looks where the cgroup filesystem is mounted in a
+ * container, i.e. at the process's own group.
+ */
+static int cgroupCpus() {
+	{
+		// cgroup v2: "<quota|max> <period>"
+		ifstream in("/sys/fs/cgroup/cpu.max");
+		string quota;
+		long long period = 0;
+		if(in >> quota >> period) {
+			if(quota == "max") return 0;
+			return quotaCpus(atoll(quota.c_str()), period);
+		}
+	}
+	{
+		// cgroup v1: quota is -1 if unlimited
+		ifstream q("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+		ifstream p("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+		long long quota = 0, period = 0;
+		if((q >> quota) && (p >> period)) {
+			return quotaCpus(quota, period);
+		}
+	}
+	return 0;
+}
+
+int availableCpus() {
+	int cpus = 0;
+#ifdef __linux__
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if(sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+		cpus = CPU_COUNT(&mask);
+	}
+#endif
+#ifndef _WIN32
+	if(cpus <= 0) {
+		cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+#endif
+	int quota = cgroupCpus();
+	if(quota > 0 && (cpus <= 0 || quota < cpus)) {
+		cpus = quota;
+	}
+	return max(cpus, 0);
+}
+
+#ifndef _WIN32
+
+CpuLedger::CpuLedger(const string& dir) :
+	fname_(dir + "/bowtie-cpu-ledger"),
+	fd_(-1),
+	table_(NULL),
+	slot_(-1)
+{
+	mkdir(dir.c_str(), 0777);
+	fd_ = open(fname_.c_str(), O_RDWR | O_CREAT, 0666);
+	if(fd_ < 0) {
+		cerr << "Warning: Could not open CPU ledger " << fname_
+		     << "; not coordinating threads with other processes" << endl;
+		return;
+	}
+	// Make sure the file is big enough; new bytes read as zero
+	struct stat st;
+	if(fstat(fd_, &st) != 0 ||
+	   ((size_t)st.st_size < sizeof(Table) && ftruncate(fd_, sizeof(Table)) != 0))
+	{
+		cerr << "Warning: Could not size CPU ledger " << fname_ << endl;
+		close(fd_);
+		fd_ = -1;
+		return;
+	}
+	void *p = mmap(NULL, sizeof(Table), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if(p == MAP_FAILED) {
+		cerr << "Warning: Could not map CPU ledger " << fname_ << endl;
+		close(fd_);
+		fd_ = -1;
+		return;
+	}
+	Table *t = reinterpret_cast<Table*>(p);
+	lock();
+	if(t->magic == 0) {
+		t->magic = LEDGER_MAGIC;
+		t->nslots = LEDGER_SLOTS;
+	}
+	if(t->magic == LEDGER_MAGIC && t->nslots == (uint32_t)LEDGER_SLOTS) {
+		int32_t pid = (int32_t)getpid();
+		for(int i = 0; i < LEDGER_SLOTS; i++) {
+			Slot& s = t->slots[i];
+			if(s.pid == 0 || (kill(s.pid, 0) != 0 && errno == ESRCH) || s.pid == pid) {
+				s.pid = pid;
+				s.floor = s.want = 0;
+				slot_ = i;
+				break;
+			}
+		}
+	}
+	unlock();
+	if(slot_ < 0) {
+		cerr << "Warning: CPU ledger " << fname_ << " is full or incompatible; "
+		     << "not coordinating threads with other processes" << endl;
+		munmap(p, sizeof(Table));
+		close(fd_);
+		fd_ = -1;
+		return;
+	}
+	table_ = t;
+}
+
+CpuLedger::~CpuLedger() {
+	if(table_ != NULL) {
+		lock();
+		table_->slots[slot_].pid = 0;
+		unlock();
+		munmap(table_, sizeof(Table));
+	}
+	if(fd_ >= 0) close(fd_);
+}
+
+void CpuLedger::lock() {
+	while(flock(fd_, LOCK_EX) != 0 && errno == EINTR) { }
+}
+
+void CpuLedger::unlock() {
+	flock(fd_, LOCK_UN);
+}
+
+/**
+ * Every live process first gets its floor; whatever is left of the
+ * budget is handed out one thread at a time, in slot order, to the
+ * processes that can use more.
+ */
+int CpuLedger::share(int budget, int floor, int want) {
+	assert(table_ != NULL);
+	lock();
+	Slot *slots = table_->slots;
+	slots[slot_].floor = floor;
+	slots[slot_].want = want;
+	int alloc[LEDGER_SLOTS];
+	int spare = budget;
+	for(int i = 0; i < LEDGER_SLOTS; i++) {
+		alloc[i] = 0;
+		if(slots[i].pid == 0) continue;
+		if(i != slot_ && kill(slots[i].pid, 0) != 0 && errno == ESRCH) {
+			// Process went away without releasing its slot
+			slots[i].pid = 0;
+			continue;
+		}
+		alloc[i] = slots[i].floor;
+		spare -= slots[i].floor;
+	}
+	bool grew = true;
+	while(spare > 0 && grew) {
+		grew = false;
+		for(int i = 0; i < LEDGER_SLOTS && spare > 0; i++) {
+			if(slots[i].pid != 0 && alloc[i] < slots[i].want) {
+				alloc[i]++;
+				spare--;
+				grew = true;
+			}
+		}
+	}
+	unlock();
+	return alloc[slot_];
+}
+
+#else
+
+CpuLedger::CpuLedger(const string& dir) : fname_(), fd_(-1), table_(NULL), slot_(-1) { }
+CpuLedger::~CpuLedger() { }
+void CpuLedger::lock() { }
+void CpuLedger::unlock() { }
+int CpuLedger::share(int budget, int floor, int want) { return floor; }
+
+#endif
+
+WorkerPool::WorkerPool(
+	int nthreads,
+	int ceiling,
+	const string& ledgerDir,
+	bool verbose) :
+	nthreads_(max(nthreads, 1)),
+	ceiling_(max(nthreads, ceiling)),
+	ledgerDir_(ledgerDir),
+	verbose_(verbose),
+	worker_(NULL),
+	target_(0),
+	live_(0),
+	exhausted_(false),
+	aborted_(false),
+	args_(),
+	threads_(),
+	lock_()
+{
+	if(ledgerDir_.empty()) {
+		struct stat st;
+		const char *env = getenv("TMPDIR");
+		if(stat("/dev/shm", &st) == 0) {
+			ledgerDir_ = "/dev/shm";
+		} else {
+			ledgerDir_ = (env != NULL && env[0] != '\0') ? env : "/tmp";
+		}
+	}
+	// Thread ids index args_, so it must never reallocate
+	args_.resize(ceiling_);
+	for(int i = 0; i < ceiling_; i++) {
+		args_[i].pool = this;
+		args_[i].tid = i;
+	}
+}
+
+/**
+ * Entry point for pool threads.
+ */
+void WorkerPool::launch(void *vp) {
+	Arg *a = reinterpret_cast<Arg*>(vp);
+	WorkerPool *pool = a->pool;
+	pool->worker_((void*)&a->tid);
+	pool->returned(a->tid);
+	ThreadSafe _ts(&pool->lock_);
+	pool->live_--;
+}
+
+/**
+ * Worker 'tid' has returned.  A worker only returns once the input is
+ * exhausted or it has read all it will (-u); if neither happened,
+ * something went wrong, so call off the search instead of letting the
+ * other workers carry on as if all were well.
+ */
+void WorkerPool::returned(int tid) {
+	ParkGuard g(parkLock_);
+	if(exhausted_ || aborted_) return;
+	cerr << "Error: search thread " << tid
+	     << " stopped before the input was exhausted" << endl;
+	aborted_ = true;
+	parked_.notify_all();
+}
+
+bool WorkerPool::enter(int tid) {
+	if(tid >= target_ && !exhausted_ && !aborted_) {
+#ifdef WITH_TBB
+		std::unique_lock<std::mutex> g(parkLock_);
+		while(tid >= target_ && !exhausted_ && !aborted_) {
+			parked_.wait(g);
+		}
+#else
+		ParkGuard g(parkLock_);
+		while(tid >= target_ && !exhausted_ && !aborted_) {
+			parked_.wait(parkLock_);
+		}
+#endif
+	}
+	return !aborted_;
+}
+
+void WorkerPool::exhausted() {
+	ParkGuard g(parkLock_);
+	exhausted_ = true;
+	parked_.notify_all();
+}
+
+/**
+ * Change the number of workers that should be active, waking parked
+ * workers that are now below it.
+ */
+void WorkerPool::setTarget(int t) {
+	ParkGuard g(parkLock_);
+	target_ = t;
+	parked_.notify_all();
+}
+
+void WorkerPool::spawn(int tid) {
+	assert_eq((int)threads_.size(), tid);
+	{
+		ThreadSafe _ts(&lock_);
+		live_++;
+	}
+#ifdef WITH_TBB
+	threads_.push_back(new std::thread(WorkerPool::launch, (void*)&args_[tid]));
+#else
+	threads_.push_back(new tthread::thread(WorkerPool::launch, (void*)&args_[tid]));
+#endif
+}
+
+void WorkerPool::joinAll() {
+	for(size_t i = 0; i < threads_.size(); i++) {
+		threads_[i]->join();
+		delete threads_[i];
+	}
+	threads_.clear();
+}
+
+/**
+ * Return the number of workers that should be active right now.
+ */
+int WorkerPool::target(CpuLedger *ledger, int cpus) {
+	int budget = ceiling_;
+	if(cpus > 0) budget = min(budget, cpus);
+	int t = budget;
+	if(ledger != NULL && ledger->ok()) {
+		t = ledger->share(budget, nthreads_, ceiling_);
+	}
+	return max(nthreads_, min(t, ceiling_));
+}
+
+void WorkerPool::run(Worker worker) {
+	worker_ = worker;
+	exhausted_ = false;
+	aborted_ = false;
+	live_ = 0;
+	target_ = nthreads_;
+	if(!elastic()) {
+		// Fixed-size pool; the calling thread is the last worker
+		for(int i = 0; i < nthreads_ - 1; i++) {
+			spawn(i);
+		}
+		worker_((void*)&args_[nthreads_ - 1].tid);
+		returned(nthreads_ - 1);
+		joinAll();
+		if(aborted_) throw 1;
+		return;
+	}
+	CpuLedger ledger(ledgerDir_);
+	int cpus = availableCpus();
+	target_ = target(&ledger, cpus);
+	for(int i = 0; i < target_; i++) {
+		spawn(i);
+	}
+	for(int tick = 1; live_ > 0; tick++) {
+		SLEEP(POOL_TICK_MS);
+		if(tick % POOL_CPU_TICKS == 0) {
+			cpus = availableCpus();
+		}
+		int t = target(&ledger, cpus);
+		if(t != target_ && verbose_) {
+			cerr << "Worker pool: " << target_ << " -> " << t << " active threads" << endl;
+		}
+		setTarget(t);
+		while((int)threads_.size() < t && !exhausted_ && !aborted_) {
+			spawn((int)threads_.size());
+		}
+	}
+	joinAll();
+	if(aborted_) throw 1;
+}
@@ -0,0 +1,189 @@
+/*
+ * worker_pool.h
+ *
+ * The pool of search threads used by all of the search drivers.  The
+ * unit of work is a read batch: each worker pulls batches from the
+ * shared PatternComposer until the input is exhausted, passing through
+ * the pool's BatchGate before every pull.
+ *
+ * When --thread-ceiling exceeds -p, the pool is elastic.  The calling
+ * thread becomes a controller that, every few milliseconds, works out
+ * how many workers this process may run given the CPUs available to it
+ * (affinity mask and cgroup quota) and the other elastic bowtie
+ * processes registered in a small shared-memory ledger.  Workers above
+ * that number park at their next batch boundary and resume when
+ * capacity frees up, so concurrent jobs on a node rebalance within a
+ * batch or two.
+ */
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#ifdef WITH_TBB
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+#include "threading.h"
+#include "pat.h"
+
+/**
+ * Return the number of CPUs this process may use, considering its
+ * affinity mask and any cgroup (v1 or v2) CPU quota; 0 if unknown.
+ */
+extern int availableCpus();
+
+/**
+ * A table, kept in a memory-mapped file, in which elastic bowtie
+ * processes on the same node register how many threads they are
+ * guaranteed (-p) and how many they could use (--thread-ceiling).
+ * Every process computes the same division of the CPU budget from the
+ * table, so no process has to signal another.
+ */
+class CpuLedger {
+
+public:
+
+	/**
+	 * Open (creating if necessary) the ledger in directory 'dir' and
+	 * claim a slot for this process.  If anything goes wrong, ok()
+	 * returns false and the caller should proceed on its own.
+	 */
+	CpuLedger(const std::string& dir);
+
+	/**
+	 * Release this process's slot.
+	 */
+	~CpuLedger();
+
+	bool ok() const { return table_ != NULL; }
+
+	/**
+	 * Record that this process needs 'floor' threads and could use
+	 * 'want', and return how many it may run out of a node-wide
+	 * budget of 'budget' threads.
+	 */
+	int share(int budget, int floor, int want);
+
+private:
+
+	static const uint32_t LEDGER_MAGIC = 0xb0771e01;
+	static const int      LEDGER_SLOTS = 256;
+
+	struct Slot {
+		int32_t pid;   /// 0 -> slot is free
+		int32_t floor; /// threads the process always runs
+		int32_t want;  /// threads the process could use
+	};
+
+	struct Table {
+		uint32_t magic;
+		uint32_t nslots;
+		Slot     slots[LEDGER_SLOTS];
+	};
+
+	void lock();
+	void unlock();
+
+	std::string fname_;
+	int         fd_;
+	Table      *table_;
+	int         slot_;  /// index of this process's slot
+};
+
+/**
+ * Runs a search worker function on a pool of threads and, if the pool
+ * is elastic, keeps the number of active threads in line with the CPU
+ * budget.  Worker functions take a pointer to their int thread id.
+ */
+class WorkerPool : public BatchGate {
+
+public:
+
+	typedef void (*Worker)(void *tid);
+
+	/**
+	 * Create a pool that always runs 'nthreads' workers and may run up
+	 * to 'ceiling' when CPUs are free.  Processes coordinate through a
+	 * ledger in 'ledgerDir' (a shared-memory directory by default).
+	 */
+	WorkerPool(
+		int nthreads,
+		int ceiling,
+		const std::string& ledgerDir,
+		bool verbose);
+
+	virtual ~WorkerPool() { }
+
+	/**
+	 * Maximum number of workers, and so of distinct thread ids, that
+	 * the pool will ever run.
+	 */
+	int maxThreads() const { return ceiling_; }
+
+	/**
+	 * Return true iff the number of workers changes with the budget.
+	 */
+	bool elastic() const { return ceiling_ > nthreads_; }
+
+	/**
+	 * Run 'worker' on the pool and return once every worker has
+	 * returned.
+	 */
+	void run(Worker worker);
+
+	/**
+	 * Park worker 'tid' while it's above the current target.  Returns
+	 * false if the pool was aborted.
+	 */
+	virtual bool enter(int tid);
+
+	/**
+	 * Input has run out; let parked workers go find that out.
+	 */
+	virtual void exhausted();
+
+private:
+
+	/// What a pool thread needs to run a worker
+	struct Arg {
+		WorkerPool *pool;
+		int         tid;
+	};
+
+	static void launch(void *vp);
+	void returned(int tid);
+	void setTarget(int t);
+	void spawn(int tid);
+	void joinAll();
+	int target(CpuLedger *ledger, int cpus);
+
+	int                 nthreads_;
+	int                 ceiling_;
+	std::string         ledgerDir_;
+	bool                verbose_;
+	Worker              worker_;
+	volatile int        target_;    /// workers with tid >= target_ park
+	volatile int        live_;      /// workers that haven't returned yet
+	volatile bool       exhausted_; /// input has run out
+	volatile bool       aborted_;   /// a worker quit before the input ran out
+	std::vector<Arg>    args_;
+#ifdef WITH_TBB
+	std::vector<std::thread*>     threads_;
+#else
+	std::vector<tthread::thread*> threads_;
+#endif
+	MUTEX_T             lock_;      /// protects live_
+#ifdef WITH_TBB
+	std::mutex              parkLock_; /// held while changing what parked workers wait on
+	std::condition_variable parked_;   /// signaled when they may have to wake
+#else
+	tthread::mutex              parkLock_; /// held while changing what parked workers wait on
+	tthread::condition_variable parked_;   /// signaled when they may have to wake
+#endif
+};
+
+#endif /* WORKER_POOL_H_ */